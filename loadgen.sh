@@ -0,0 +1,3 @@
+#!/bin/bash
+export LD_LIBRARY_PATH="`pwd`/bin"
+./bin/loadgen "$@"
@@ -182,6 +182,9 @@ solution "blowmorph"
 
     links { "base", "engine", "net" }
 
+    configuration "linux"
+      links { "pthread" }
+
     configuration "windows"
       resource("data", "data")
 
@@ -204,6 +207,9 @@ solution "blowmorph"
 
     links { "base", "engine", "net" }
 
+    configuration "linux"
+      links { "pthread" }
+
     configuration "windows"
       resource("data", "data")
 
@@ -234,6 +240,20 @@ solution "blowmorph"
       windows_libdir("third-party/box2d/bin")
 	  links { "Box2D" }
 
+  project "loadgen"
+    kind "ConsoleApp"
+    language "C++"
+    targetname "loadgen"
+
+    includedirs { "src" }
+    files { "src/loadgen/**.cpp",
+            "src/loadgen/**.h" }
+
+    links { "base", "engine", "net" }
+
+    configuration "linux"
+      links { "pthread" }
+
   project "interpolator"
     kind "StaticLib"
     language "C++"
@@ -11,4 +11,4 @@ trap sigint_handler SIGINT
 python src/master-server/notify.py true
 
 export LD_LIBRARY_PATH="`pwd`/bin"
-./bin/server
+./bin/server "$@"
@@ -0,0 +1,93 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "base/bit_stream.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+namespace bm {
+
+BitWriter::BitWriter() : bit_count_(0) { }
+BitWriter::~BitWriter() { }
+
+void BitWriter::Write(uint64_t value, size_t count) {
+  CHECK(count <= 64);
+  while (count > 0) {
+    size_t bit_offset = bit_count_ % 8;
+    if (bit_offset == 0) {
+      data_.push_back(0);
+    }
+    size_t chunk = std::min(count, 8 - bit_offset);
+    uint8_t bits = static_cast<uint8_t>(value & ((1u << chunk) - 1));
+    data_.back() = static_cast<char>(
+        static_cast<uint8_t>(data_.back()) | (bits << bit_offset));
+    value >>= chunk;
+    count -= chunk;
+    bit_count_ += chunk;
+  }
+}
+
+void BitWriter::Write(const BitWriter& other) {
+  CHECK(&other != this);
+  size_t bits_left = other.bit_count_;
+  for (size_t i = 0; bits_left > 0; i++) {
+    size_t chunk = std::min(bits_left, static_cast<size_t>(8));
+    Write(static_cast<uint8_t>(other.data_[i]), chunk);
+    bits_left -= chunk;
+  }
+}
+
+void BitWriter::Clear() {
+  data_.clear();
+  bit_count_ = 0;
+}
+
+size_t BitWriter::GetBitCount() const {
+  return bit_count_;
+}
+
+const std::vector<char>& BitWriter::GetData() const {
+  return data_;
+}
+
+BitReader::BitReader(const std::vector<char>& data, size_t offset)
+    : data_(data.empty() ? NULL : &data[0]), size_(data.size()),
+      position_(offset * 8) {
+  CHECK(offset <= size_);
+}
+
+BitReader::BitReader(const char* data, size_t size, size_t offset)
+    : data_(data), size_(size), position_(offset * 8) {
+  CHECK(data != NULL || size == 0);
+  CHECK(offset <= size_);
+}
+BitReader::~BitReader() { }
+
+bool BitReader::Read(uint64_t* value, size_t count) {
+  CHECK(value != NULL);
+  CHECK(count <= 64);
+  if (size_ * 8 - position_ < count) {
+    return false;
+  }
+  *value = 0;
+  size_t done = 0;
+  while (done < count) {
+    size_t bit_offset = position_ % 8;
+    size_t chunk = std::min(count - done, 8 - bit_offset);
+    uint8_t byte = static_cast<uint8_t>(data_[position_ / 8]);
+    uint64_t bits = (byte >> bit_offset) & ((1u << chunk) - 1);
+    *value |= bits << done;
+    done += chunk;
+    position_ += chunk;
+  }
+  return true;
+}
+
+bool BitReader::IsAtEnd() const {
+  return size_ * 8 - position_ < 8;
+}
+
+}  // namespace bm
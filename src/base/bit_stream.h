@@ -0,0 +1,67 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef BASE_BIT_STREAM_H_
+#define BASE_BIT_STREAM_H_
+
+#include <vector>
+
+#include "base/dll.h"
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+namespace bm {
+
+// Bits are stored starting from the least significant bit of every byte
+// and values are written starting from their least significant bit, so
+// the stream doesn't depend on the endianness of the host. Values written
+// with a multiple of 8 bits at a byte boundary have the little-endian layout.
+
+class BitWriter {
+ public:
+  BM_BASE_DECL BitWriter();
+  BM_BASE_DECL ~BitWriter();
+
+  // Writes the lowest 'count' bits of 'value', 'count' is at most 64.
+  BM_BASE_DECL void Write(uint64_t value, size_t count);
+
+  // Writes all the bits written to 'other'.
+  BM_BASE_DECL void Write(const BitWriter& other);
+
+  BM_BASE_DECL void Clear();
+
+  BM_BASE_DECL size_t GetBitCount() const;
+
+  // The last byte is padded with zero bits.
+  BM_BASE_DECL const std::vector<char>& GetData() const;
+
+ private:
+  std::vector<char> data_;
+  size_t bit_count_;
+};
+
+class BitReader {
+ public:
+  // Reads the bits of 'data' starting from the byte 'offset'.
+  // 'data' should outlive the reader.
+  BM_BASE_DECL BitReader(const std::vector<char>& data, size_t offset);
+  BM_BASE_DECL BitReader(const char* data, size_t size, size_t offset);
+  BM_BASE_DECL ~BitReader();
+
+  // Reads 'count' bits into the lowest bits of 'value', 'count' is
+  // at most 64. Returns 'false' if there are fewer than 'count' bits left.
+  BM_BASE_DECL bool Read(uint64_t* value, size_t count);
+
+  // Returns 'true' if only the padding of the last byte is left.
+  BM_BASE_DECL bool IsAtEnd() const;
+
+ private:
+  const char* data_;
+  size_t size_;
+  size_t position_;
+
+  DISALLOW_COPY_AND_ASSIGN(BitReader);
+};
+
+}  // namespace bm
+
+#endif  // BASE_BIT_STREAM_H_
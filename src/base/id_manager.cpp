@@ -4,18 +4,58 @@
 
 #include <climits>
 
+#include <deque>
+#include <vector>
+
 #include "base/macros.h"
 #include "base/pstdint.h"
 
 namespace bm {
 
-IdManager::IdManager() : max_id_(0) { }
+static const uint32_t GENERATION_COUNT = 1u << (32 - IdManager::INDEX_BITS);
+
+IdManager::IdManager() : generations_(1, 0) { }
 IdManager::~IdManager() { }
 
 uint32_t IdManager::NewId() {
-  max_id_ += 1;
-  CHECK(max_id_ < UINT_MAX);
-  return max_id_;
+  uint32_t index;
+  if (!free_indices_.empty()) {
+    index = free_indices_.front();
+    free_indices_.pop_front();
+  } else {
+    index = static_cast<uint32_t>(generations_.size());
+    // The last index would give 'BAD_ID' in the last generation.
+    CHECK(index < INDEX_MASK);
+    generations_.push_back(0);
+  }
+  return (generations_[index] << INDEX_BITS) | index;
+}
+
+void IdManager::FreeId(uint32_t id, uint32_t epoch) {
+  uint32_t index = GetIndex(id);
+  CHECK(index != 0 && index < generations_.size());
+  CHECK(GetGeneration(id) == generations_[index]);
+  generations_[index] = (generations_[index] + 1) % GENERATION_COUNT;
+  FreedId freed;
+  freed.id = id;
+  freed.epoch = epoch;
+  quarantine_.push_back(freed);
+}
+
+void IdManager::ReleaseIds(uint32_t epoch) {
+  while (!quarantine_.empty() &&
+         static_cast<int32_t>(epoch - quarantine_.front().epoch) >= 0) {
+    free_indices_.push_back(GetIndex(quarantine_.front().id));
+    quarantine_.pop_front();
+  }
+}
+
+size_t IdManager::GetAllocatedCount() const {
+  return generations_.size() - 1;
+}
+
+size_t IdManager::GetQuarantinedCount() const {
+  return quarantine_.size();
 }
 
 }  // namespace bm
@@ -5,24 +5,65 @@
 
 #include <climits>
 
+#include <deque>
+#include <vector>
+
 #include <base/pstdint.h>
 
 #include "base/dll.h"
 
 namespace bm {
 
+// Hands out ids and recycles the freed ones. An id is an index in its low
+// 'INDEX_BITS' and the generation of the index in the rest. The generation
+// changes every time the index is reused, so an id kept after it was
+// freed never matches the new owner of the index. Freed ids are kept in
+// quarantine until they are released by the epoch they were freed at,
+// e.g. until every client has seen the entity disappear.
 class IdManager {
  public:
   static const uint32_t BAD_ID = UINT_MAX;
 
+  static const uint32_t INDEX_BITS = 22;
+  static const uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+
  public:
   BM_BASE_DECL IdManager();
   BM_BASE_DECL ~IdManager();
 
+  // Never returns 0 or 'BAD_ID'.
   BM_BASE_DECL uint32_t NewId();
 
+  // Quarantines 'id', which was freed at 'epoch'. Epochs wrap around and
+  // must not decrease between calls.
+  BM_BASE_DECL void FreeId(uint32_t id, uint32_t epoch);
+  // Lets the ids freed at 'epoch' and before it be reused.
+  BM_BASE_DECL void ReleaseIds(uint32_t epoch);
+
+  // The number of indices in use or in quarantine.
+  BM_BASE_DECL size_t GetAllocatedCount() const;
+  BM_BASE_DECL size_t GetQuarantinedCount() const;
+
+  static uint32_t GetIndex(uint32_t id) {
+    return id & INDEX_MASK;
+  }
+  static uint32_t GetGeneration(uint32_t id) {
+    return id >> INDEX_BITS;
+  }
+
  private:
-  uint32_t max_id_;
+  struct FreedId {
+    uint32_t id;
+    uint32_t epoch;
+  };
+
+  // Generations of the next ids of the used indices, index 0 is never
+  // used so that 0 is never an id.
+  std::vector<uint32_t> generations_;
+  // Reused in the order they were released, so the generations of the
+  // indices wrap around as late as possible.
+  std::deque<uint32_t> free_indices_;
+  std::deque<FreedId> quarantine_;
 };
 
 }  // namespace bm
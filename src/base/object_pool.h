@@ -0,0 +1,72 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef BASE_OBJECT_POOL_H_
+#define BASE_OBJECT_POOL_H_
+
+#include <new>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+namespace bm {
+
+// Free list of memory blocks for objects of type 'T'. The objects are
+// constructed in the blocks with placement new and destroyed with
+// 'Delete()', which keeps the block for the next allocation instead of
+// returning it to the heap. At most 'max_free_blocks' are kept, the ones
+// beyond are freed. The blocks come from '::operator new', so an object
+// from the pool may also be destroyed with 'delete'.
+template<class T>
+class ObjectPool {
+ public:
+  explicit ObjectPool(size_t max_free_blocks)
+      : max_free_blocks_(max_free_blocks), hit_count_(0), miss_count_(0) { }
+  ~ObjectPool() {
+    for (size_t i = 0; i < free_blocks_.size(); i++) {
+      ::operator delete(free_blocks_[i]);
+    }
+  }
+
+  // Returns a block to construct a 'T' in.
+  void* Allocate() {
+    if (free_blocks_.empty()) {
+      miss_count_++;
+      return ::operator new(sizeof(T));
+    }
+    hit_count_++;
+    void* block = free_blocks_.back();
+    free_blocks_.pop_back();
+    return block;
+  }
+
+  void Delete(T* object) {
+    CHECK(object != NULL);
+    object->~T();
+    if (free_blocks_.size() >= max_free_blocks_) {
+      ::operator delete(object);
+      return;
+    }
+    free_blocks_.push_back(object);
+  }
+
+  // The number of allocations that reused a block and that didn't.
+  uint64_t GetHitCount() const {
+    return hit_count_;
+  }
+  uint64_t GetMissCount() const {
+    return miss_count_;
+  }
+
+ private:
+  std::vector<void*> free_blocks_;
+  size_t max_free_blocks_;
+  uint64_t hit_count_;
+  uint64_t miss_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(ObjectPool);
+};
+
+}  // namespace bm
+
+#endif  // BASE_OBJECT_POOL_H_
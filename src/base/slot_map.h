@@ -0,0 +1,166 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef BASE_SLOT_MAP_H_
+#define BASE_SLOT_MAP_H_
+
+#include <utility>
+#include <vector>
+
+#include "base/id_manager.h"
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+namespace bm {
+
+// Maps ids given out by 'IdManager' to values with constant time lookup,
+// insertion and erasure. The items are kept densely in one array, so
+// iterating over them walks contiguous memory. The indices of the ids are
+// mapped to their items by a sparse table split into pages, which are
+// allocated when the first index in their range is inserted and freed
+// when the last one is erased. An id of another generation than the one
+// inserted with its index isn't found. Erasing an item moves the last
+// item into its place, so the order of the items is arbitrary, and loops
+// that erase go from the end.
+template<class T>
+class SlotMap {
+ public:
+  typedef std::pair<uint32_t, T> Item;
+  typedef typename std::vector<Item>::iterator iterator;
+  typedef typename std::vector<Item>::const_iterator const_iterator;
+
+  SlotMap() { }
+  ~SlotMap() {
+    Clear();
+  }
+
+  size_t GetSize() const {
+    return items_.size();
+  }
+  Item& GetItem(size_t index) {
+    return items_[index];
+  }
+  const Item& GetItem(size_t index) const {
+    return items_[index];
+  }
+
+  // Returns 'NULL' if there is no value with 'id'.
+  T* Find(uint32_t id) {
+    Item* item = FindByIndex(id);
+    return (item != NULL && item->first == id) ? &item->second : NULL;
+  }
+  const T* Find(uint32_t id) const {
+    const Item* item = FindByIndex(id);
+    return (item != NULL && item->first == id) ? &item->second : NULL;
+  }
+  bool Contains(uint32_t id) const {
+    return Find(id) != NULL;
+  }
+
+  // Returns the item with the index of 'id' of any generation or 'NULL'.
+  Item* FindByIndex(uint32_t id) {
+    const uint32_t* slot = FindSlot(id);
+    return (slot != NULL) ? &items_[*slot] : NULL;
+  }
+  const Item* FindByIndex(uint32_t id) const {
+    const uint32_t* slot = FindSlot(id);
+    return (slot != NULL) ? &items_[*slot] : NULL;
+  }
+
+  // The index of 'id' must not be in the map.
+  void Insert(uint32_t id, const T& value) {
+    size_t page_index = IdManager::GetIndex(id) >> PAGE_BITS;
+    if (page_index >= pages_.size()) {
+      pages_.resize(page_index + 1, NULL);
+    }
+    Page* page = pages_[page_index];
+    if (page == NULL) {
+      page = new Page();
+      CHECK(page != NULL);
+      for (size_t i = 0; i < PAGE_SIZE; i++) {
+        page->slots[i] = EMPTY_SLOT;
+      }
+      page->count = 0;
+      pages_[page_index] = page;
+    }
+    uint32_t* slot = &page->slots[id & PAGE_MASK];
+    CHECK(*slot == EMPTY_SLOT);
+    *slot = static_cast<uint32_t>(items_.size());
+    page->count++;
+    items_.push_back(Item(id, value));
+  }
+
+  void Erase(uint32_t id) {
+    size_t page_index = IdManager::GetIndex(id) >> PAGE_BITS;
+    CHECK(page_index < pages_.size() && pages_[page_index] != NULL);
+    Page* page = pages_[page_index];
+    uint32_t* slot = &page->slots[id & PAGE_MASK];
+    CHECK(*slot != EMPTY_SLOT && items_[*slot].first == id);
+    uint32_t index = *slot;
+    if (index + 1 != items_.size()) {
+      items_[index] = items_.back();
+      *FindSlot(items_[index].first) = index;
+    }
+    items_.pop_back();
+    *slot = EMPTY_SLOT;
+    page->count--;
+    if (page->count == 0) {
+      delete page;
+      pages_[page_index] = NULL;
+    }
+  }
+
+  void Clear() {
+    items_.clear();
+    for (size_t i = 0; i < pages_.size(); i++) {
+      delete pages_[i];
+    }
+    pages_.clear();
+  }
+
+  iterator begin() {
+    return items_.begin();
+  }
+  iterator end() {
+    return items_.end();
+  }
+  const_iterator begin() const {
+    return items_.begin();
+  }
+  const_iterator end() const {
+    return items_.end();
+  }
+
+ private:
+  static const uint32_t PAGE_BITS = 10;
+  static const uint32_t PAGE_SIZE = 1 << PAGE_BITS;
+  static const uint32_t PAGE_MASK = PAGE_SIZE - 1;
+  static const uint32_t EMPTY_SLOT = 0xffffffff;
+
+  struct Page {
+    // Indices of the items, 'EMPTY_SLOT' for the absent ids.
+    uint32_t slots[PAGE_SIZE];
+    uint32_t count;
+  };
+
+  const uint32_t* FindSlot(uint32_t id) const {
+    size_t page_index = IdManager::GetIndex(id) >> PAGE_BITS;
+    if (page_index >= pages_.size() || pages_[page_index] == NULL) {
+      return NULL;
+    }
+    const uint32_t* slot = &pages_[page_index]->slots[id & PAGE_MASK];
+    return (*slot != EMPTY_SLOT) ? slot : NULL;
+  }
+  uint32_t* FindSlot(uint32_t id) {
+    return const_cast<uint32_t*>(
+        static_cast<const SlotMap*>(this)->FindSlot(id));
+  }
+
+  std::vector<Item> items_;
+  std::vector<Page*> pages_;
+
+  DISALLOW_COPY_AND_ASSIGN(SlotMap);
+};
+
+}  // namespace bm
+
+#endif  // BASE_SLOT_MAP_H_
@@ -0,0 +1,74 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef BASE_SPSC_QUEUE_H_
+#define BASE_SPSC_QUEUE_H_
+
+#include <atomic>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+namespace bm {
+
+// Bounded lock-free queue between exactly one producer thread and one
+// consumer thread. The items live in a ring of preallocated slots that are
+// filled and read in place, so the buffers inside them keep their capacity
+// and the queue doesn't allocate once it's warmed up.
+template<class T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity)
+      : slots_(capacity), head_(0), tail_(0) {
+    CHECK(capacity > 0);
+  }
+  ~SpscQueue() { }
+
+  // Producer side. Returns the slot to fill or 'NULL' if the queue is
+  // full. The slot holds whatever was there before and becomes visible to
+  // the consumer on 'Push()'.
+  T* Reserve() {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+      return NULL;
+    }
+    return &slots_[tail % slots_.size()];
+  }
+  void Push() {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    DCHECK(tail - head_.load(std::memory_order_acquire) < slots_.size());
+    tail_.store(tail + 1, std::memory_order_release);
+  }
+
+  // Consumer side. Returns the oldest item or 'NULL' if the queue is
+  // empty. The item stays valid until 'Pop()'.
+  T* Front() {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return NULL;
+    }
+    return &slots_[head % slots_.size()];
+  }
+  void Pop() {
+    size_t head = head_.load(std::memory_order_relaxed);
+    DCHECK(head != tail_.load(std::memory_order_acquire));
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+ private:
+  std::vector<T> slots_;
+
+  // Keep the indices written by different threads on separate cache lines.
+  static const size_t CACHE_LINE_SIZE = 64;
+
+  std::atomic<size_t> head_;
+  char head_padding_[CACHE_LINE_SIZE];
+  std::atomic<size_t> tail_;
+  char tail_padding_[CACHE_LINE_SIZE];
+
+  DISALLOW_COPY_AND_ASSIGN(SpscQueue);
+};
+
+}  // namespace bm
+
+#endif  // BASE_SPSC_QUEUE_H_
@@ -12,4 +12,9 @@ int64_t Timestamp() {
   return timer.GetTime();
 }
 
+int64_t TimestampUs() {
+  static bm::Timer timer;
+  return timer.GetTimeUs();
+}
+
 }  // namespace bm
@@ -11,6 +11,9 @@ namespace bm {
 // Returns time since some moment in ms.
 BM_BASE_DECL int64_t Timestamp();
 
+// Returns time since some moment in microseconds.
+BM_BASE_DECL int64_t TimestampUs();
+
 }  // namespace bm
 
 #endif  // BASE_TIME_H_
@@ -18,6 +18,12 @@ int64_t Timer::GetTime() const {
   return result;
 }
 
+int64_t Timer::GetTimeUs() const {
+  int64_t clock_diff = static_cast<int64_t>(clock() - _start);
+  int64_t result = clock_diff * 1000000 / CLOCKS_PER_SEC;
+  return result;
+}
+
 #else
 
 Timer::Timer() {
@@ -35,6 +41,16 @@ int64_t Timer::GetTime() const {
   return time;
 }
 
+int64_t Timer::GetTimeUs() const {
+  timeval current;
+  int rv = gettimeofday(&current, NULL);
+  CHECK(rv == 0);
+  int64_t seconds = current.tv_sec - _start.tv_sec;
+  int64_t useconds = current.tv_usec - _start.tv_usec;
+  int64_t time = seconds * 1000000 + useconds;
+  return time;
+}
+
 #endif
 
 }  // namespace bm
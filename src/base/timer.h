@@ -25,6 +25,9 @@ class Timer {
   // Returns elapsed time in ms since timer's creation.
   BM_BASE_DECL int64_t GetTime() const;
 
+  // Returns elapsed time in microseconds since timer's creation.
+  BM_BASE_DECL int64_t GetTimeUs() const;
+
  private:
 #ifdef WIN32
   clock_t _start;
@@ -15,6 +15,7 @@
 
 #include <SFML/Graphics.hpp>
 
+#include "base/bit_stream.h"
 #include "base/error.h"
 #include "base/macros.h"
 #include "base/pstdint.h"
@@ -27,7 +28,9 @@
 #include "engine/config.h"
 #include "engine/map.h"
 #include "engine/protocol.h"
+#include "engine/snapshot_delta.h"
 #include "engine/utils.h"
+#include "engine/wire_format.h"
 
 #include "client/contact_listener.h"
 #include "client/entity.h"
@@ -38,6 +41,10 @@
 
 namespace bm {
 
+// The player isn't reconciled while the snapshots are within this many
+// world units of the prediction, well above the position quantization.
+static const float32_t MAX_PREDICTION_ERROR = 1.0f;
+
 Application::Application()
   : client_(NULL),
     peer_(NULL),
@@ -76,19 +83,29 @@ bool Application::Initialize() {
 
   tick_rate_ = Config::GetInstance()->GetClientConfig().tick_rate;
 
-  time_correction_ = 0;
+  last_sync_request_ = 0;
   last_tick_ = 0;
+  last_snapshot_sequence_ = 0;
+  pending_sequence_ = 0;
+  pending_fragments_ = 0;
   last_physics_simulation_ = 0;
+  input_sequence_ = 0;
+  sent_keys_ = 0;
+  sent_aim_.SetZero();
+  input_history_.Clear();
+  player_correction_.SetZero();
 
   show_score_table_ = false;
 
   player_health_ = 0;
   player_energy_ = 0;
 
-  max_player_misposition_ =
-      Config::GetInstance()->GetClientConfig().max_player_misposition;
-  interpolation_offset_ =
-      Config::GetInstance()->GetClientConfig().interpolation_offset;
+  const Config::ClientConfig& config =
+      Config::GetInstance()->GetClientConfig();
+  max_player_misposition_ = config.max_player_misposition;
+  interpolation_delay_.Reset(config.interpolation_offset,
+      config.min_interpolation_offset, config.max_interpolation_offset,
+      config.interpolation_underrun_rate);
 
   state_ = STATE_INITIALIZED;
   return true;
@@ -108,10 +125,14 @@ bool Application::Run() {
   // FIXME(xairy): move to a separate method.
   // FIXME(xairy): use entity_settings_.
   b2Vec2 position(client_options_.x, client_options_.y);
-  Sprite* sprite = resource_manager_.CreateSprite("man");
+  uint32_t prototype_id = Config::GetInstance()->FindPrototypeId(
+      Config::Prototype::KIND_PLAYER, "player");
+  CHECK(prototype_id != Config::BAD_PROTOTYPE_ID);
+  Sprite* sprite = resource_manager_.CreateSprite(
+      Config::GetInstance()->GetPrototype(prototype_id).sprite_name);
   CHECK(sprite != NULL);
   player_ = new ClientEntity(world_.GetBox2DWorld(), client_options_.id,
-    Entity::TYPE_PLAYER, "player", position, sprite);
+    Entity::TYPE_PLAYER, prototype_id, position, sprite);
   CHECK(player_ != NULL);
   const Config::ClientConfig& config =
     Config::GetInstance()->GetClientConfig();
@@ -131,12 +152,19 @@ bool Application::Run() {
     }
 
     SimulatePhysics();
+    InterpolateEntities();
     Render();
 
+    // Keep the clock estimate up to date in the background.
+    if (Timestamp() - last_sync_request_ >= SYNC_PERIOD &&
+        !SendSyncTimeRequest()) {
+      return false;
+    }
+
     int64_t current_time = GetServerTime();
     if (current_time - last_tick_ > 1000.0 / tick_rate_) {
       last_tick_ = current_time;
-      if (!SendInputEvents()) {
+      if (!SendInputCommand()) {
         return false;
       }
     }
@@ -156,12 +184,13 @@ void Application::Finalize() {
   for (auto i : *world_.GetStaticEntities()) {
     delete i.second;
   }
-  world_.GetStaticEntities()->clear();
+  world_.GetStaticEntities()->Clear();
 
   for (auto i : *world_.GetDynamicEntities()) {
     delete i.second;
   }
-  world_.GetDynamicEntities()->clear();
+  world_.GetDynamicEntities()->Clear();
+  interpolators_.Clear();
 
   if (player_ != NULL) delete player_;
 
@@ -215,7 +244,7 @@ bool Application::InitializeNetwork() {
     return false;
   }
 
-  std::auto_ptr<ClientHost> client(enet_.CreateClientHost());
+  std::auto_ptr<ClientHost> client(enet_.CreateClientHost(CHANNEL_COUNT));
   if (client.get() == NULL) {
     return false;
   }
@@ -239,7 +268,8 @@ bool Application::Connect() {
   const Config::ClientConfig& config =
     Config::GetInstance()->GetClientConfig();
 
-  peer_ = client_->Connect(config.server_host, config.server_port);
+  peer_ = client_->Connect(config.server_host, config.server_port,
+      CHANNEL_COUNT);
   if (peer_ == NULL) {
     return false;
   }
@@ -276,19 +306,24 @@ bool Application::Synchronize() {
   // Send login data.
 
   CHECK(config.player_name.size() <= LoginData::MAX_LOGIN_LENGTH);
+  CHECK(config.server_room.size() <= LoginData::MAX_ROOM_LENGTH);
   LoginData login_data;
   std::copy(config.player_name.begin(), config.player_name.end(),
       &login_data.login[0]);
   login_data.login[config.player_name.size()] = '\0';
-  bool rv = SendPacket(peer_, Packet::TYPE_LOGIN, login_data, true);
+  std::copy(config.server_room.begin(), config.server_room.end(),
+      &login_data.room[0]);
+  login_data.room[config.server_room.size()] = '\0';
+  bool rv = SendPacket(peer_, Packet::TYPE_LOGIN, login_data);
   if (rv == false) {
     return false;
   }
 
   printf("Login data sent, login: %s.\n", login_data.login);
 
-  // Receive client options.
+  // Receive client options and the entity kinds.
 
+  bool options_received = false;
   while (true) {
     int64_t time = Timestamp();
     if (time - start_time > sync_timeout) {
@@ -306,46 +341,56 @@ bool Application::Synchronize() {
       continue;
     }
 
-    std::vector<char> buffer;
-    event_->GetData(&buffer);
+    PacketView packet = event_->GetDataView();
 
     Packet::Type type;
-    rv = ExtractPacketType(buffer, &type);
+    rv = ExtractPacketType(packet, &type);
     if (rv == false) {
       REPORT_ERROR("Incorrect client options packet format.");
       return false;
     }
+
+    // The kinds are sent right after the options on the same channel.
+    if (type == Packet::TYPE_ENTITY_KINDS && options_received) {
+      if (!OnEntityKinds(packet)) {
+        return false;
+      }
+      break;
+    }
     if (type != Packet::TYPE_CLIENT_OPTIONS) {
       continue;
     }
 
     rv = ExtractPacketData<Packet::Type, ClientOptions>(
-            buffer, &client_options_);
+            packet, &client_options_);
     if (rv == false) {
       REPORT_ERROR("Incorrect client options packet format.");
       return false;
     }
 
-    break;
+    wire_format_.packed_types = client_options_.packed_types;
+    wire_format_.bound = client_options_.bound;
+    wire_format_.position_precision = client_options_.position_precision;
+    options_received = true;
   }
 
   printf("Client options received.\n");
 
-  // Send a time synchronization request.
+  // Make a few time synchronization round trips one after another,
+  // a single one may be delayed.
 
-  TimeSyncData request_data;
-  request_data.client_time = Timestamp();
-
-  rv = SendPacket(peer_, Packet::TYPE_SYNC_TIME_REQUEST, request_data, true);
-  if (rv == false) {
+  clock_sync_.Reset();
+  if (!SendSyncTimeRequest()) {
     return false;
   }
 
-  // Receive a time synchronization response.
-
-  while (true) {
+  size_t sample_count = 0;
+  while (sample_count < INITIAL_SYNC_SAMPLES) {
     int64_t time = Timestamp();
     if (time - start_time > sync_timeout) {
+      if (sample_count > 0) {
+        break;
+      }
       REPORT_ERROR("Synchronization failed: time's out.");
       return false;
     }
@@ -360,31 +405,37 @@ bool Application::Synchronize() {
       continue;
     }
 
-    std::vector<char> message;
-    event_->GetData(&message);
-    const Packet::Type* type = reinterpret_cast<Packet::Type*>(&message[0]);
-    if (*type != Packet::TYPE_SYNC_TIME_RESPONSE) {
+    PacketView packet = event_->GetDataView();
+    Packet::Type type;
+    if (!ExtractPacketType(packet, &type) ||
+        type != Packet::TYPE_SYNC_TIME_RESPONSE) {
       continue;
     }
-    const TimeSyncData* response_data =
-        reinterpret_cast<const TimeSyncData*>(&message[0] + sizeof(*type));
-
-    // Calculate the time correction.
-    int64_t client_time = Timestamp();
-    latency_ = (client_time - response_data->client_time) / 2;
-    time_correction_ = response_data->server_time + latency_ - client_time;
+    TimeSyncData response_data;
+    rv = ExtractPacketData<Packet::Type, TimeSyncData>(packet,
+        &response_data);
+    if (rv == false) {
+      REPORT_ERROR("Incorrect time sync packet format.");
+      return false;
+    }
 
-    break;
+    clock_sync_.AddSample(response_data.client_time,
+        response_data.server_time, Timestamp());
+    sample_count++;
+    if (sample_count < INITIAL_SYNC_SAMPLES && !SendSyncTimeRequest()) {
+      return false;
+    }
   }
 
-  printf("Synchronized time, latency: %d ms.\n", static_cast<int>(latency_));
+  printf("Synchronized time, latency: %d ms.\n",
+      static_cast<int>(clock_sync_.GetLatency()));
 
   // Notify the server that the client has synchronized.
 
   ClientStatus client_status;
   client_status.status = ClientStatus::STATUS_SYNCHRONIZED;
 
-  rv = SendPacket(peer_, Packet::TYPE_CLIENT_STATUS, client_status, true);
+  rv = SendPacket(peer_, Packet::TYPE_CLIENT_STATUS, client_status);
   if (rv == false) {
     return false;
   }
@@ -395,10 +446,95 @@ bool Application::Synchronize() {
   return true;
 }
 
+// Returns 'false' if 'snapshot_type' isn't a known entity type.
+static bool GetEntityType(EntitySnapshot::EntityType snapshot_type,
+    Entity::Type* type, Config::Prototype::Kind* kind) {
+  switch (snapshot_type) {
+    case EntitySnapshot::ENTITY_TYPE_ACTIVATOR:
+      *type = Entity::TYPE_ACTIVATOR;
+      *kind = Config::Prototype::KIND_ACTIVATOR;
+      return true;
+    case EntitySnapshot::ENTITY_TYPE_CRITTER:
+      *type = Entity::TYPE_CRITTER;
+      *kind = Config::Prototype::KIND_CRITTER;
+      return true;
+    case EntitySnapshot::ENTITY_TYPE_DOOR:
+      *type = Entity::TYPE_DOOR;
+      *kind = Config::Prototype::KIND_DOOR;
+      return true;
+    case EntitySnapshot::ENTITY_TYPE_KIT:
+      *type = Entity::TYPE_KIT;
+      *kind = Config::Prototype::KIND_KIT;
+      return true;
+    case EntitySnapshot::ENTITY_TYPE_PLAYER:
+      *type = Entity::TYPE_PLAYER;
+      *kind = Config::Prototype::KIND_PLAYER;
+      return true;
+    case EntitySnapshot::ENTITY_TYPE_PROJECTILE:
+      *type = Entity::TYPE_PROJECTILE;
+      *kind = Config::Prototype::KIND_PROJECTILE;
+      return true;
+    case EntitySnapshot::ENTITY_TYPE_WALL:
+      *type = Entity::TYPE_WALL;
+      *kind = Config::Prototype::KIND_WALL;
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool Application::OnEntityKinds(const PacketView& packet) {
+  EntityKindTable table;
+  std::vector<EntityKind> kinds;
+  bool rv = ExtractPacketData<Packet::Type, EntityKindTable, EntityKind>(
+      packet, &table, &kinds);
+  if (rv == false || table.kind_count != kinds.size() ||
+      kinds.size() > static_cast<size_t>(EntitySnapshot::MAX_KIND_COUNT)) {
+    REPORT_ERROR("Incorrect entity kinds packet format.");
+    return false;
+  }
+
+  entity_kinds_.resize(kinds.size());
+  for (size_t i = 0; i < kinds.size(); i++) {
+    EntityKind* kind = &kinds[i];
+    kind->name[EntityKind::MAX_NAME_LENGTH] = '\0';
+    kind->sprite_name[EntityKind::MAX_NAME_LENGTH] = '\0';
+
+    Config::Prototype::Kind prototype_kind;
+    EntityKindInfo* info = &entity_kinds_[i];
+    if (!GetEntityType(kind->type, &info->type, &prototype_kind)) {
+      REPORT_ERROR("Incorrect entity kinds packet format.");
+      return false;
+    }
+    info->prototype_id = Config::GetInstance()->FindPrototypeId(
+        prototype_kind, kind->name);
+    if (info->prototype_id == Config::BAD_PROTOTYPE_ID) {
+      REPORT_ERROR("Entity '%s' of the server not found.", kind->name);
+      return false;
+    }
+    info->sprite_name = kind->sprite_name;
+    if (Config::GetInstance()->GetSpritesConfig().count(
+        info->sprite_name) == 0) {
+      REPORT_ERROR("Sprite '%s' of the server not found.",
+          info->sprite_name.c_str());
+      return false;
+    }
+  }
+
+  return true;
+}
+
 int64_t Application::GetServerTime() {
   CHECK(state_ == STATE_INITIALIZED);
   CHECK(network_state_ == NETWORK_STATE_LOGGED_IN);
-  return Timestamp() + time_correction_;
+  return clock_sync_.GetServerTime(Timestamp());
+}
+
+bool Application::SendSyncTimeRequest() {
+  TimeSyncData request_data;
+  request_data.client_time = Timestamp();
+  last_sync_request_ = request_data.client_time;
+  return SendPacket(peer_, Packet::TYPE_SYNC_TIME_REQUEST, request_data);
 }
 
 bool Application::PumpEvents() {
@@ -446,6 +582,12 @@ bool Application::OnQuitEvent() {
     return false;
   } else {
     printf("Disconnected.\n");
+    printf("Interpolation delay: %d ms, snapshots: %u, lost: %u, "
+        "underruns: %u.\n",
+        static_cast<int>(interpolation_delay_.GetTargetDelay()),
+        interpolation_delay_.GetSnapshotCount(),
+        interpolation_delay_.GetLossCount(),
+        interpolation_delay_.GetUnderrunCount());
   }
 
   return true;
@@ -454,8 +596,7 @@ bool Application::OnQuitEvent() {
 bool Application::OnMouseButtonEvent(const sf::Event& event) {
   CHECK(state_ == STATE_INITIALIZED);
 
-  MouseEvent mouse_event;
-  mouse_event.time = GetServerTime();
+  InputCommand::ButtonEvent mouse_event;
 
   if (event.type == sf::Event::MouseButtonReleased) {
     mouse_event.event_type = MouseEvent::EVENT_KEYUP;
@@ -491,7 +632,7 @@ bool Application::OnMouseButtonEvent(const sf::Event& event) {
   mouse_event.y = (event.mouseButton.y - screen_height / 2) +
     player_->GetPosition().y;
 
-  mouse_events_.push_back(mouse_event);
+  button_events_.push_back(mouse_event);
 
   return true;
 }
@@ -499,37 +640,29 @@ bool Application::OnMouseButtonEvent(const sf::Event& event) {
 bool Application::OnKeyEvent(const sf::Event& event) {
   CHECK(state_ == STATE_INITIALIZED);
 
-  KeyboardEvent keyboard_event;
-  keyboard_event.time = GetServerTime();
-
   bool pressed;
 
   if (event.type == sf::Event::KeyReleased) {
-    keyboard_event.event_type = KeyboardEvent::EVENT_KEYUP;
     pressed = false;
   } else if (event.type == sf::Event::KeyPressed) {
-    keyboard_event.event_type = KeyboardEvent::EVENT_KEYDOWN;
     pressed = true;
   } else {
     CHECK(false);
   }
 
+  // The key state is sent with the next input command.
   switch (event.key.code) {
     case sf::Keyboard::A:
       keyboard_state_.left = pressed;
-      keyboard_event.key_type = KeyboardEvent::KEY_LEFT;
       break;
     case sf::Keyboard::D:
       keyboard_state_.right = pressed;
-      keyboard_event.key_type = KeyboardEvent::KEY_RIGHT;
       break;
     case sf::Keyboard::W:
       keyboard_state_.up = pressed;
-      keyboard_event.key_type = KeyboardEvent::KEY_UP;
       break;
     case sf::Keyboard::S:
       keyboard_state_.down = pressed;
-      keyboard_event.key_type = KeyboardEvent::KEY_DOWN;
       break;
     case sf::Keyboard::E:
       if (event.type == sf::Event::KeyPressed) {
@@ -556,8 +689,6 @@ bool Application::OnKeyEvent(const sf::Event& event) {
       return true;
   }
 
-  keyboard_events_.push_back(keyboard_event);
-
   return true;
 }
 
@@ -565,8 +696,6 @@ bool Application::PumpPackets() {
   CHECK(state_ == STATE_INITIALIZED);
   CHECK(network_state_ == NETWORK_STATE_LOGGED_IN);
 
-  std::vector<char> buffer;
-
   do {
     bool rv = client_->Service(event_, 0);
     if (rv == false) {
@@ -575,8 +704,7 @@ bool Application::PumpPackets() {
 
     switch (event_->GetType()) {
       case Event::TYPE_RECEIVE: {
-        event_->GetData(&buffer);
-        bool rv = ProcessPacket(buffer);
+        bool rv = ProcessPacket(event_->GetDataView());
         if (rv == false) {
           return false;
         }
@@ -600,44 +728,28 @@ bool Application::PumpPackets() {
   return true;
 }
 
-bool Application::ProcessPacket(const std::vector<char>& buffer) {
+bool Application::ProcessPacket(const PacketView& packet) {
   CHECK(state_ == STATE_INITIALIZED);
   CHECK(network_state_ == NETWORK_STATE_LOGGED_IN);
 
   Packet::Type type;
-  bool rv = ExtractPacketType(buffer, &type);
+  bool rv = ExtractPacketType(packet, &type);
   if (rv == false) {
     REPORT_ERROR("Incorrect packet format!");
     return false;
   }
 
   switch (type) {
-    case Packet::TYPE_ENTITY_APPEARED:
-    case Packet::TYPE_ENTITY_UPDATED: {
-      EntitySnapshot snapshot;
-      bool rv = ExtractPacketData<Packet::Type, EntitySnapshot>(
-                  buffer, &snapshot);
-      if (rv == false) {
-        REPORT_ERROR("Incorrect entity packet format!");
+    case Packet::TYPE_WORLD_SNAPSHOT:
+    case Packet::TYPE_WORLD_UPDATE: {
+      if (!OnWorldSnapshotPacket(type, packet)) {
         return false;
       }
-      if (snapshot.type == EntitySnapshot::ENTITY_TYPE_PLAYER) {
-        player_scores_[snapshot.id] = static_cast<int>(snapshot.data[2]);
-      }
-      if (snapshot.id == player_->GetId()) {
-        OnPlayerUpdate(&snapshot);
-        break;
-      }
-      if (world_.GetEntity(snapshot.id) != NULL) {
-        OnEntityUpdate(&snapshot);
-      } else {
-        OnEntityAppearance(&snapshot);
-      }
     } break;
 
     case Packet::TYPE_GAME_EVENT: {
       GameEvent event;
-      bool rv = ExtractPacketData<Packet::Type, GameEvent>(buffer, &event);
+      bool rv = ExtractPacketData<Packet::Type, GameEvent>(packet, &event);
       if (rv == false) {
         REPORT_ERROR("Incorrect game event packet format!");
         return false;
@@ -651,6 +763,9 @@ bool Application::ProcessPacket(const std::vector<char>& buffer) {
         explosion->Play();
         explosions_.push_back(explosion);
       } else if (event.type == GameEvent::TYPE_ENTITY_DISAPPEARED) {
+        // Snapshots are not ordered with game events, so an older snapshot
+        // may still arrive and should not bring the entity back.
+        removed_entities_[event.entity.id] = event.entity.time;
         if (event.entity.type == EntitySnapshot::ENTITY_TYPE_PLAYER) {
           player_scores_.erase(event.entity.id);
         }
@@ -660,10 +775,22 @@ bool Application::ProcessPacket(const std::vector<char>& buffer) {
       }
     } break;
 
+    case Packet::TYPE_SYNC_TIME_RESPONSE: {
+      TimeSyncData response_data;
+      bool rv = ExtractPacketData<Packet::Type, TimeSyncData>(
+                  packet, &response_data);
+      if (rv == false) {
+        REPORT_ERROR("Incorrect time sync packet format!");
+        return false;
+      }
+      clock_sync_.AddSample(response_data.client_time,
+          response_data.server_time, Timestamp());
+    } break;
+
     case Packet::TYPE_PLAYER_INFO: {
       PlayerInfo player_info;
       bool rv = ExtractPacketData<Packet::Type, PlayerInfo>(
-                  buffer, &player_info);
+                  packet, &player_info);
       if (rv == false) {
         REPORT_ERROR("Incorrect player info packet format!");
         return false;
@@ -685,72 +812,225 @@ bool Application::ProcessPacket(const std::vector<char>& buffer) {
   return true;
 }
 
-void Application::OnEntityAppearance(const EntitySnapshot* snapshot) {
+bool Application::OnWorldSnapshotPacket(Packet::Type type,
+    const PacketView& packet) {
   CHECK(state_ == STATE_INITIALIZED);
-  CHECK(snapshot != NULL);
+  CHECK(type == Packet::TYPE_WORLD_SNAPSHOT ||
+        type == Packet::TYPE_WORLD_UPDATE);
+
+  BitReader reader(packet.data, packet.size, sizeof(Packet::Type));
+  int64_t reference_time = GetServerTime();
+  FieldReader fields(wire_format_, wire_format_.IsPacked(type),
+      reference_time, &reader);
+
+  WorldSnapshot world_snapshot;
+  bool rv = ReadWorldSnapshot(wire_format_, type, reference_time, &reader,
+      &world_snapshot);
+  if (rv == false || world_snapshot.fragment_index >=
+      world_snapshot.fragment_count) {
+    REPORT_ERROR("Incorrect world snapshot packet format!");
+    return false;
+  }
 
-  uint32_t id = snapshot->id;
-  b2Vec2 position = b2Vec2(snapshot->x, snapshot->y);
-  std::string entity_name = std::string(&snapshot->name[0]);
+  if (type == Packet::TYPE_WORLD_UPDATE) {
+    if (world_snapshot.baseline != 0) {
+      REPORT_ERROR("Incorrect world update packet format!");
+      return false;
+    }
+    // Static entities that have left the area of interest.
+    for (size_t i = 0; i < world_snapshot.removed_count; i++) {
+      uint32_t id;
+      if (!fields.ReadUInt32(&id, 32)) {
+        REPORT_ERROR("Incorrect world update packet format!");
+        return false;
+      }
+      DeleteEntity(id);
+    }
+    std::vector<EntitySnapshot> snapshots(world_snapshot.entity_count);
+    for (size_t i = 0; i < snapshots.size(); i++) {
+      if (!ReadEntityDelta(&fields, empty_snapshot_, &snapshots[i]) ||
+          snapshots[i].kind >= entity_kinds_.size()) {
+        REPORT_ERROR("Incorrect world update packet format!");
+        return false;
+      }
+      snapshots[i].time = world_snapshot.time;
+    }
+    if (!reader.IsAtEnd()) {
+      REPORT_ERROR("Incorrect world update packet format!");
+      return false;
+    }
+    OnWorldSnapshot(world_snapshot.time, snapshots);
+    return true;
+  }
 
-  Entity::Type type;
-  std::string sprite_name;
+  // Snapshots are unreliable, drop the ones older than the last applied one.
+  int32_t age = static_cast<int32_t>(
+      last_snapshot_sequence_ - world_snapshot.sequence);
+  if (last_snapshot_sequence_ != 0 && age >= 0) {
+    return true;
+  }
 
-  switch (snapshot->type) {
-    case EntitySnapshot::ENTITY_TYPE_ACTIVATOR: {
-      type = Entity::TYPE_ACTIVATOR;
-      sprite_name = Config::GetInstance()->
-        GetActivatorsConfig().at(entity_name).sprite_name;
-    } break;
+  if (world_snapshot.fragment_index == 0) {
+    pending_sequence_ = world_snapshot.sequence;
+    pending_fragments_ = 0;
+    pending_removed_.clear();
+    pending_entities_.clear();
+  }
+  // A fragment was lost, wait for the next snapshot.
+  if (world_snapshot.sequence != pending_sequence_ ||
+      world_snapshot.fragment_index != pending_fragments_) {
+    return true;
+  }
 
-    case EntitySnapshot::ENTITY_TYPE_CRITTER: {
-      type = Entity::TYPE_CRITTER;
-      sprite_name = Config::GetInstance()->
-        GetCrittersConfig().at(entity_name).sprite_name;
-    } break;
+  // The baseline isn't kept anymore, wait for the server to notice.
+  const std::vector<EntitySnapshot>* baseline = &empty_snapshot_;
+  if (world_snapshot.baseline != 0) {
+    baseline = snapshot_history_.Get(world_snapshot.baseline);
+    if (baseline == NULL) {
+      pending_sequence_ = 0;
+      return true;
+    }
+  }
 
-    case EntitySnapshot::ENTITY_TYPE_DOOR: {
-      type = Entity::TYPE_DOOR;
-      sprite_name = Config::GetInstance()->
-        GetDoorsConfig().at(entity_name).sprite_name;
-    } break;
+  for (size_t i = 0; i < world_snapshot.removed_count; i++) {
+    uint32_t id;
+    if (!fields.ReadUInt32(&id, 32)) {
+      REPORT_ERROR("Incorrect world snapshot packet format!");
+      return false;
+    }
+    pending_removed_.push_back(id);
+  }
+  for (size_t i = 0; i < world_snapshot.entity_count; i++) {
+    pending_entities_.push_back(EntitySnapshot());
+    if (!ReadEntityDelta(&fields, *baseline, &pending_entities_.back()) ||
+        pending_entities_.back().kind >= entity_kinds_.size()) {
+      REPORT_ERROR("Incorrect world snapshot packet format!");
+      return false;
+    }
+  }
+  if (!reader.IsAtEnd()) {
+    REPORT_ERROR("Incorrect world snapshot packet format!");
+    return false;
+  }
 
-    case EntitySnapshot::ENTITY_TYPE_KIT: {
-      type = Entity::TYPE_KIT;
-      sprite_name = Config::GetInstance()->
-        GetKitsConfig().at(entity_name).sprite_name;
-    } break;
+  pending_fragments_++;
+  if (pending_fragments_ < world_snapshot.fragment_count) {
+    return true;
+  }
 
-    case EntitySnapshot::ENTITY_TYPE_PROJECTILE: {
-      type = Entity::TYPE_PROJECTILE;
-      sprite_name = Config::GetInstance()->
-        GetProjectilesConfig().at(entity_name).sprite_name;
-    } break;
+  // The snapshot is complete. Entities unchanged since the baseline
+  // are taken from it.
+  std::vector<EntitySnapshot> snapshots;
+  RebuildSnapshot(*baseline, pending_removed_, &pending_entities_,
+      &snapshots);
+  for (size_t i = 0; i < snapshots.size(); i++) {
+    snapshots[i].time = world_snapshot.time;
+  }
+  snapshot_history_.Put(world_snapshot.sequence)->swap(snapshots);
+  last_snapshot_sequence_ = world_snapshot.sequence;
+  interpolation_delay_.OnSnapshot(world_snapshot.sequence,
+      world_snapshot.time, GetServerTime());
+  pending_sequence_ = 0;
+
+  SnapshotAck ack;
+  ack.sequence = world_snapshot.sequence;
+  rv = SendPacket(peer_, Packet::TYPE_SNAPSHOT_ACK, ack);
+  if (rv == false) {
+    return false;
+  }
 
-    case EntitySnapshot::ENTITY_TYPE_PLAYER: {
-      type = Entity::TYPE_PLAYER;
-      sprite_name = Config::GetInstance()->
-        GetPlayersConfig().at(entity_name).sprite_name;
-    } break;
+  const std::vector<EntitySnapshot>& applied =
+      *snapshot_history_.Get(world_snapshot.sequence);
+  OnWorldSnapshot(world_snapshot.time, applied);
+
+  // Dynamic entities missing from the snapshot have left the area of
+  // interest. The snapshot is sorted by id. Deleting an entity moves
+  // the last one into its place, so the loop goes from the end.
+  EntityMap* entities = world_.GetDynamicEntities();
+  for (size_t i = entities->GetSize(); i > 0; i--) {
+    uint32_t id = entities->GetItem(i - 1).first;
+    if (FindEntitySnapshot(applied, id) == NULL) {
+      DeleteEntity(id);
+    }
+  }
 
-    case EntitySnapshot::ENTITY_TYPE_WALL: {
-      type = Entity::TYPE_WALL;
-      sprite_name = Config::GetInstance()->
-        GetWallsConfig().at(entity_name).sprite_name;
-    } break;
+  // Reused ids are of another generation and snapshots older than this
+  // one are dropped, so removals that happened before it no longer need
+  // to be tracked.
+  auto itr = removed_entities_.begin();
+  while (itr != removed_entities_.end()) {
+    if (itr->second < world_snapshot.time) {
+      itr = removed_entities_.erase(itr);
+    } else {
+      ++itr;
+    }
+  }
 
-    default:
-      CHECK(false);  // Unreachable.
+  return true;
+}
+
+void Application::OnWorldSnapshot(int64_t time,
+    const std::vector<EntitySnapshot>& snapshots) {
+  CHECK(state_ == STATE_INITIALIZED);
+
+  for (size_t i = 0; i < snapshots.size(); i++) {
+    const EntitySnapshot* snapshot = &snapshots[i];
+    auto removed = removed_entities_.find(snapshot->id);
+    if (removed != removed_entities_.end() && removed->second >= time) {
+      continue;
+    }
+    OnEntitySnapshot(snapshot);
+  }
+}
+
+void Application::OnEntitySnapshot(const EntitySnapshot* snapshot) {
+  CHECK(state_ == STATE_INITIALIZED);
+  CHECK(snapshot != NULL);
+
+  if (snapshot->type == EntitySnapshot::ENTITY_TYPE_PLAYER) {
+    player_scores_[snapshot->id] = static_cast<int>(snapshot->data[2]);
+  }
+  if (snapshot->id == player_->GetId()) {
+    OnPlayerUpdate(snapshot);
+    return;
+  }
+  if (world_.GetEntity(snapshot->id) != NULL) {
+    OnEntityUpdate(snapshot);
+  } else {
+    OnEntityAppearance(snapshot);
   }
+}
+
+void Application::OnEntityAppearance(const EntitySnapshot* snapshot) {
+  CHECK(state_ == STATE_INITIALIZED);
+  CHECK(snapshot != NULL);
 
-  Sprite* sprite = resource_manager_.CreateSprite(sprite_name);
+  uint32_t id = snapshot->id;
+  b2Vec2 position = b2Vec2(snapshot->x, snapshot->y);
+  // The kinds are checked when the snapshots are read.
+  const EntityKindInfo& kind = entity_kinds_[snapshot->kind];
+
+  Sprite* sprite = resource_manager_.CreateSprite(kind.sprite_name);
   CHECK(sprite != NULL);
 
+  // The server reuses the index of a removed entity once the client has
+  // acknowledged a later snapshot, the removal event may still be late.
+  Entity* stale = world_.GetEntityByIndex(id);
+  if (stale != NULL) {
+    DeleteEntity(stale->GetId());
+  }
+
   ClientEntity* entity = new ClientEntity(world_.GetBox2DWorld(),
-      id, type, entity_name, position, sprite);
+      id, kind.type, kind.prototype_id, position, sprite);
   CHECK(entity != NULL);
 
   entity->SetRotation(snapshot->angle);
+  if (!entity->IsStatic()) {
+    EntityInterpolators::Interpolator interpolator(0, INTERPOLATION_FRAMES,
+        MAX_EXTRAPOLATION);
+    interpolator.Push(EntityFrame(position, snapshot->angle), snapshot->time);
+    entity->SetInterpolator(interpolators_.Add(interpolator));
+  }
   world_.AddEntity(id, entity);
 }
 
@@ -774,17 +1054,9 @@ void Application::OnEntityUpdate(const EntitySnapshot* snapshot) {
     entity->SetRotation(snapshot->angle);
   } else {
     CHECK(entity->IsStatic() == false);
-    int64_t server_time = GetServerTime();
-    if (server_time - interpolation_offset_ >= snapshot->time) {
-      // Ignore snapshots that are too old.
-      return;
-    }
-    entity->SetInterpolationPosition(position, snapshot->time,
-        interpolation_offset_, server_time);
-    entity->SetRotation(snapshot->angle);
-    // TODO(xairy): use SetInterpolationRotation.
-    // dynamic_entities_[snapshot->id]->SetInterpolationRotation(
-    //   snapshot->angle, snapshot->time, interpolation_offset_, server_time);
+    // Late snapshots still fill the history between the kept ones.
+    interpolators_.Get(entity->GetInterpolator()).Push(
+        EntityFrame(position, snapshot->angle), snapshot->time);
   }
 }
 
@@ -795,33 +1067,139 @@ void Application::OnPlayerUpdate(const EntitySnapshot* snapshot) {
   player_health_ = snapshot->data[0];
   player_energy_ = snapshot->data[1];
 
-  b2Vec2 position = b2Vec2(snapshot->x, snapshot->y);
-  b2Vec2 distance = player_->GetPosition() - position;
+  ReconcilePlayer(snapshot->time, static_cast<uint32_t>(snapshot->data[3]),
+      b2Vec2(snapshot->x, snapshot->y));
+}
+
+void Application::ReconcilePlayer(int64_t time, uint32_t acked_sequence,
+    const b2Vec2& position) {
+  input_history_.DropBefore(acked_sequence);
 
-  if (Length(distance) > max_player_misposition_) {
-    player_->SetPosition(position);
+  // Most snapshots agree with the prediction for their time, then there
+  // is nothing to replay.
+  b2Vec2 predicted_at_snapshot;
+  if (input_history_.GetPosition(time, &predicted_at_snapshot) &&
+      Length(predicted_at_snapshot - position) <= MAX_PREDICTION_ERROR) {
+    return;
+  }
+
+  EntityMap* entities = world_.GetDynamicEntities();
+  saved_bodies_.clear();
+  for (auto i : *entities) {
+    SavedBody body;
+    body.entity = i.second;
+    body.position = i.second->GetPosition();
+    body.velocity = i.second->GetVelocity();
+    saved_bodies_.push_back(body);
+    i.second->SetVelocity(b2Vec2(0.0f, 0.0f));
+  }
+
+  b2Vec2 predicted_position = player_->GetPosition();
+  player_->SetPosition(position);
+
+  // The server applies the keys of a command from its arrival until the
+  // next command arrives, so the acknowledged sequence tells which ticks
+  // to replay but not for how long the server has held their keys. It
+  // took the snapshot after applying the input sent until about a one-way
+  // latency earlier. The replay ends where the last physics step did.
+  int64_t replay_start = time - clock_sync_.GetLatency();
+  int64_t replay_end = clock_sync_.GetServerTime(last_physics_simulation_);
+  if (input_history_.GetSize() > 0) {
+    replay_start = std::max(replay_start, input_history_.Get(0).time);
+  }
+  // The whole world is stepped, so the number of steps is bounded.
+  int64_t step = REPLAY_STEP;
+  if (replay_end - replay_start > step * MAX_REPLAY_STEPS) {
+    step = (replay_end - replay_start + MAX_REPLAY_STEPS - 1) /
+        MAX_REPLAY_STEPS;
   }
+  // The ticks holding the same keys are replayed together.
+  int64_t start = replay_start;
+  for (size_t i = 0; i < input_history_.GetSize(); i++) {
+    const InputHistory::Input& input = input_history_.Get(i);
+    if (i + 1 < input_history_.GetSize() &&
+        input_history_.Get(i + 1).keys == input.keys) {
+      continue;
+    }
+    int64_t end = replay_end;
+    if (i + 1 < input_history_.GetSize()) {
+      end = std::min(end, input_history_.Get(i + 1).time);
+    }
+    if (end > start) {
+      ReplayInput(input.keys, end - start, step);
+      start = end;
+    }
+  }
+
+  for (size_t i = 0; i < saved_bodies_.size(); i++) {
+    saved_bodies_[i].entity->SetPosition(saved_bodies_[i].position);
+    saved_bodies_[i].entity->SetVelocity(saved_bodies_[i].velocity);
+  }
+
+  b2Vec2 error = player_->GetPosition() - predicted_position;
+  if (Length(error) > max_player_misposition_) {
+    // Teleported or too far off to be smoothed.
+    player_correction_.SetZero();
+    return;
+  }
+  player_->SetPosition(predicted_position);
+  player_correction_ = error;
+}
+
+void Application::ReplayInput(uint32_t keys, int64_t duration,
+    int64_t max_step) {
+  const int32_t velocity_iterations = 6;
+  const int32_t position_iterations = 2;
+  b2Vec2 velocity = GetPlayerVelocity(keys);
+  while (duration > 0) {
+    int64_t step = (duration < max_step) ? duration : max_step;
+    player_->SetImpulse(player_->GetMass() * velocity);
+    world_.GetBox2DWorld()->Step(static_cast<float>(step) / 1000,
+        velocity_iterations, position_iterations);
+    duration -= step;
+  }
+}
+
+b2Vec2 Application::GetPlayerVelocity(uint32_t keys) const {
+  float32_t speed = client_options_.speed;
+  b2Vec2 velocity(0.0f, 0.0f);
+  if ((keys & (1u << KeyboardEvent::KEY_LEFT)) != 0) {
+    velocity.x -= speed;
+  }
+  if ((keys & (1u << KeyboardEvent::KEY_RIGHT)) != 0) {
+    velocity.x += speed;
+  }
+  if ((keys & (1u << KeyboardEvent::KEY_UP)) != 0) {
+    velocity.y -= speed;
+  }
+  if ((keys & (1u << KeyboardEvent::KEY_DOWN)) != 0) {
+    velocity.y += speed;
+  }
+  return velocity;
 }
 
 bool Application::OnEntityDisappearance(const EntitySnapshot* snapshot) {
   CHECK(state_ == STATE_INITIALIZED);
   CHECK(snapshot != NULL);
 
-  auto i = world_.GetDynamicEntities()->find(snapshot->id);
-  if (i != world_.GetDynamicEntities()->end()) {
-    delete i->second;
-    world_.RemoveEntity(i->first);
-  }
-
-  i = world_.GetStaticEntities()->find(snapshot->id);
-  if (i != world_.GetStaticEntities()->end()) {
-    delete i->second;
-    world_.RemoveEntity(i->first);
-  }
+  DeleteEntity(snapshot->id);
 
   return true;
 }
 
+void Application::DeleteEntity(uint32_t id) {
+  CHECK(state_ == STATE_INITIALIZED);
+
+  ClientEntity* entity = static_cast<ClientEntity*>(world_.GetEntity(id));
+  if (entity != NULL) {
+    if (entity->GetInterpolator() != ClientEntity::NO_INTERPOLATOR) {
+      interpolators_.Remove(entity->GetInterpolator());
+    }
+    world_.RemoveEntity(id);
+    delete entity;
+  }
+}
+
 void Application::SimulatePhysics() {
   CHECK(state_ == STATE_INITIALIZED);
 
@@ -830,11 +1208,14 @@ void Application::SimulatePhysics() {
     int64_t delta_time = current_time - last_physics_simulation_;
     last_physics_simulation_ = current_time;
 
-    b2Vec2 velocity(0.0f, 0.0f);
-    velocity.x = keyboard_state_.left * (-client_options_.speed)
-      + keyboard_state_.right * (client_options_.speed);
-    velocity.y = keyboard_state_.up * (-client_options_.speed)
-      + keyboard_state_.down * (client_options_.speed);
+    // The prediction error is applied gradually.
+    float32_t fraction = std::min(1.0f,
+        static_cast<float32_t>(delta_time) / CORRECTION_TIME);
+    b2Vec2 correction = fraction * player_correction_;
+    player_->SetPosition(player_->GetPosition() + correction);
+    player_correction_ -= correction;
+
+    b2Vec2 velocity = GetPlayerVelocity(sent_keys_);
     player_->SetImpulse(player_->GetMass() * velocity);
 
     int32_t velocity_iterations = 6;
@@ -844,6 +1225,28 @@ void Application::SimulatePhysics() {
   }
 }
 
+void Application::InterpolateEntities() {
+  CHECK(state_ == STATE_INITIALIZED);
+
+  if (network_state_ != NETWORK_STATE_LOGGED_IN) {
+    return;
+  }
+
+  int64_t time = GetServerTime();
+  interpolators_.InterpolateAll(time - interpolation_delay_.GetDelay(time));
+
+  // The entities are placed after the physics step, so they are drawn
+  // where the interpolation puts them and only push the player around.
+  for (auto i : *world_.GetDynamicEntities()) {
+    ClientEntity* entity = static_cast<ClientEntity*>(i.second);
+    const EntityFrame& frame =
+        interpolators_.GetFrame(entity->GetInterpolator());
+    entity->SetPosition(frame.position);
+    entity->SetRotation(frame.angle);
+    entity->SetVelocity(b2Vec2(0.0f, 0.0f));
+  }
+}
+
 void Application::Render() {
   CHECK(state_ == STATE_INITIALIZED);
 
@@ -891,39 +1294,57 @@ void Application::Render() {
   render_window_.EndFrame();
 }
 
-bool Application::SendInputEvents() {
-  for (size_t i = 0; i < keyboard_events_.size(); i++) {
-    bool rv = SendPacket(peer_, Packet::TYPE_KEYBOARD_EVENT,
-        keyboard_events_[i]);
-    if (rv == false) {
-      return false;
-    }
-  }
-  keyboard_events_.clear();
-
-  // TODO(xairy): make mouse event actions.
-  for (size_t i = 0; i < mouse_events_.size(); i++) {
-    bool rv = SendPacket(peer_, Packet::TYPE_MOUSE_EVENT,
-        mouse_events_[i]);
-    if (rv == false) {
-      return false;
-    }
-  }
-  mouse_events_.clear();
+bool Application::SendInputCommand() {
+  uint32_t keys = 0;
+  keys |= keyboard_state_.up ? (1u << KeyboardEvent::KEY_UP) : 0;
+  keys |= keyboard_state_.down ? (1u << KeyboardEvent::KEY_DOWN) : 0;
+  keys |= keyboard_state_.right ? (1u << KeyboardEvent::KEY_RIGHT) : 0;
+  keys |= keyboard_state_.left ? (1u << KeyboardEvent::KEY_LEFT) : 0;
+  b2Vec2 aim = GetMousePosition();
+  int64_t time = GetServerTime();
+
+  if (input_sequence_ == 0 || !button_events_.empty() ||
+      keys != sent_keys_ || !(aim == sent_aim_)) {
+    InputCommand command;
+    command.time = time;
+    command.keys = keys;
+    command.x = aim.x;
+    command.y = aim.y;
+    command.interpolation_delay =
+        static_cast<uint32_t>(interpolation_delay_.GetDelay(time));
+
+    // Button events that don't fit into one command are sent in the next
+    // ones within the same tick.
+    size_t sent = 0;
+    do {
+      size_t count = button_events_.size() - sent;
+      if (count > InputCommand::MAX_BUTTON_EVENTS) {
+        count = InputCommand::MAX_BUTTON_EVENTS;
+      }
+      for (size_t i = 0; i < count; i++) {
+        command.button_events[i] = button_events_[sent + i];
+      }
+      command.button_event_count = static_cast<uint32_t>(count);
+      command.sequence = ++input_sequence_;
+
+      BitWriter writer;
+      WriteInputCommand(wire_format_, command, &writer);
+      std::vector<char> buffer;
+      AppendPacketToBuffer(buffer, Packet::TYPE_INPUT_COMMAND, writer);
+      if (!SendBuffer(peer_, Packet::TYPE_INPUT_COMMAND, buffer)) {
+        return false;
+      }
+      sent += count;
+    } while (sent < button_events_.size());
 
-  // Send mouse position.
-  MouseEvent event;
-  event.time = GetServerTime();
-  event.button_type =  MouseEvent::BUTTON_NONE;
-  event.event_type = MouseEvent::EVENT_MOVE;
-  b2Vec2 mouse_position = GetMousePosition();
-  event.x = mouse_position.x;
-  event.y = mouse_position.y;
-  bool rv = SendPacket(peer_, Packet::TYPE_MOUSE_EVENT, event);
-  if (rv == false) {
-    return false;
+    button_events_.clear();
+    sent_keys_ = keys;
+    sent_aim_ = aim;
   }
 
+  // The correction not applied yet is a part of the prediction.
+  input_history_.Push(input_sequence_, time, sent_keys_,
+      player_->GetPosition() + player_correction_);
   return true;
 }
 
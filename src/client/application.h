@@ -15,14 +15,20 @@
 #include "base/pstdint.h"
 
 #include "net/enet.h"
+#include "net/event.h"
 
 #include "engine/config.h"
 #include "engine/map.h"
 #include "engine/protocol.h"
+#include "engine/snapshot_delta.h"
+#include "engine/wire_format.h"
 #include "engine/world.h"
 
+#include "client/clock_sync.h"
 #include "client/contact_listener.h"
 #include "client/entity.h"
+#include "client/input_history.h"
+#include "client/interpolation_delay.h"
 #include "client/render_window.h"
 #include "client/resource_manager.h"
 #include "client/sprite.h"
@@ -45,9 +51,12 @@ class Application {
 
   bool Connect();
   bool Synchronize();
+  // Reads the kind table that follows the client options.
+  bool OnEntityKinds(const PacketView& packet);
 
   // Returns approximate server time.
   int64_t GetServerTime();
+  bool SendSyncTimeRequest();
 
   bool PumpEvents();
   bool ProcessEvent(const sf::Event& event);
@@ -57,20 +66,45 @@ class Application {
   bool OnKeyEvent(const sf::Event& event);
 
   bool PumpPackets();
-  bool ProcessPacket(const std::vector<char>& buffer);
-
+  bool ProcessPacket(const PacketView& packet);
+
+  // Collects the fragments of a 'TYPE_WORLD_SNAPSHOT', rebuilds it from
+  // the baseline and applies it once all the fragments are received.
+  // Applies 'TYPE_WORLD_UPDATE' right away.
+  bool OnWorldSnapshotPacket(Packet::Type type,
+      const PacketView& packet);
+  // Applies the entity snapshots from a world snapshot taken at 'time'.
+  void OnWorldSnapshot(int64_t time,
+      const std::vector<EntitySnapshot>& snapshots);
+  void OnEntitySnapshot(const EntitySnapshot* snapshot);
   void OnEntityAppearance(const EntitySnapshot* snapshot);
   void OnEntityUpdate(const EntitySnapshot* snapshot);
   void OnPlayerUpdate(const EntitySnapshot* snapshot);
   bool OnEntityDisappearance(const EntitySnapshot* snapshot);
+  // Deletes the entity if it exists.
+  void DeleteEntity(uint32_t id);
+
+  // Checks the authoritative 'position' the server had at 'time' after
+  // applying the input 'acked_sequence' against the position predicted
+  // for 'time'. If they differ, rewinds the player to 'position' and
+  // replays the input sent since then. Small differences from the
+  // predicted position are smoothed, large ones are snapped.
+  void ReconcilePlayer(int64_t time, uint32_t acked_sequence,
+      const b2Vec2& position);
+  // Moves the player with 'keys' held for 'duration' ms in steps of at
+  // most 'max_step' ms. Nothing but the player is moved.
+  void ReplayInput(uint32_t keys, int64_t duration, int64_t max_step);
+  b2Vec2 GetPlayerVelocity(uint32_t keys) const;
 
   void SimulatePhysics();
+  // Moves the other dynamic entities to their interpolated positions.
+  void InterpolateEntities();
 
   void Render();
 
-  // Sends input events to the server and
-  // clears the input event queues afterwards.
-  bool SendInputEvents();
+  // Sends the input of the tick to the server as one or more input
+  // commands, nothing is sent if the input hasn't changed.
+  bool SendInputCommand();
 
   bool OnActivateAction();
 
@@ -88,13 +122,28 @@ class Application {
 
   int tick_rate_;
 
-  int64_t latency_;
-  int64_t time_correction_;
+  // Time sync requests are sent every 'SYNC_PERIOD' ms during the game.
+  static const int64_t SYNC_PERIOD = 2000;
+  // Round trips made before the game starts.
+  static const size_t INITIAL_SYNC_SAMPLES = 5;
+
+  ClockSync clock_sync_;
+  int64_t last_sync_request_;
 
   int64_t last_tick_;
   int64_t last_physics_simulation_;
 
   ClientOptions client_options_;
+  WireFormat wire_format_;
+
+  // The entity kinds of the server indexed by the kinds in the snapshots,
+  // resolved to the local prototypes at login.
+  struct EntityKindInfo {
+    Entity::Type type;
+    uint32_t prototype_id;
+    std::string sprite_name;
+  };
+  std::vector<EntityKindInfo> entity_kinds_;
   ClientEntity* player_;
 
   World world_;
@@ -113,12 +162,58 @@ class Application {
   int player_health_;
   int player_energy_;
 
-  float max_player_misposition_;
-  int64_t interpolation_offset_;
+  // Sequence number of the last applied 'TYPE_WORLD_SNAPSHOT'.
+  uint32_t last_snapshot_sequence_;
+  // Applied world snapshots, used as delta baselines.
+  SnapshotHistory snapshot_history_;
+  const std::vector<EntitySnapshot> empty_snapshot_;
+
+  // The 'TYPE_WORLD_SNAPSHOT' being received, 0 if none, and the number
+  // of its fragments received so far.
+  uint32_t pending_sequence_;
+  uint16_t pending_fragments_;
+  std::vector<uint32_t> pending_removed_;
+  std::vector<EntitySnapshot> pending_entities_;
+  // Removed entity ids mapped to their removal time.
+  std::map<uint32_t, int64_t> removed_entities_;
 
-  // Input events since the last tick.
-  std::vector<KeyboardEvent> keyboard_events_;
-  std::vector<MouseEvent> mouse_events_;
+  float max_player_misposition_;
+  InterpolationDelay interpolation_delay_;
+
+  // Snapshots of the other dynamic entities kept per entity and how long
+  // their motion is extrapolated when the next snapshot is late, in ms.
+  static const size_t INTERPOLATION_FRAMES = 8;
+  static const int64_t MAX_EXTRAPOLATION = 100;
+
+  EntityInterpolators interpolators_;
+
+  // Mouse button presses and releases since the last tick.
+  std::vector<InputCommand::ButtonEvent> button_events_;
+  // Sequence number of the last sent input command and its input.
+  // The player is predicted with the sent keys, as the server moves it.
+  uint32_t input_sequence_;
+  uint32_t sent_keys_;
+  b2Vec2 sent_aim_;
+  InputHistory input_history_;
+
+  // Longest physics step used when replaying the input, in ms, unless
+  // the replay would take more than 'MAX_REPLAY_STEPS' steps.
+  static const int64_t REPLAY_STEP = 16;
+  static const int64_t MAX_REPLAY_STEPS = 32;
+  // Prediction errors are smoothed over about this many ms.
+  static const int64_t CORRECTION_TIME = 100;
+
+  // The part of the last prediction error not yet applied to the player.
+  b2Vec2 player_correction_;
+
+  // The other dynamic entities are kept in place while the input is
+  // replayed and restored afterwards.
+  struct SavedBody {
+    Entity* entity;
+    b2Vec2 position;
+    b2Vec2 velocity;
+  };
+  std::vector<SavedBody> saved_bodies_;
 
   struct KeyboardState {
     KeyboardState() : up(false), down(false), right(false), left(false) { }
@@ -0,0 +1,139 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "client/clock_sync.h"
+
+#include <cmath>
+
+#include <algorithm>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+namespace bm {
+
+// The drift is only fitted over at least this many ms of samples.
+static const int64_t MIN_DRIFT_SPAN = 10000;
+// Fitted drift beyond this, in ms per ms, is treated as noise.
+static const float64_t MAX_DRIFT = 0.001;
+// How fast corrections are applied, in ms per ms of local time.
+static const float64_t MAX_SLEW_RATE = 0.05;
+// Errors bigger than this many ms are corrected at once.
+static const float64_t MAX_SLEW_ERROR = 500.0;
+
+ClockSync::ClockSync() {
+  Reset();
+}
+
+ClockSync::~ClockSync() { }
+
+void ClockSync::Reset() {
+  next_sample_ = 0;
+  sample_count_ = 0;
+  estimate_time_ = 0;
+  estimate_offset_ = 0.0;
+  drift_ = 0.0;
+  latency_ = 0;
+  synchronized_ = false;
+  slew_time_ = 0;
+  offset_ = 0.0;
+}
+
+void ClockSync::AddSample(int64_t request_time, int64_t server_time,
+    int64_t response_time) {
+  if (response_time < request_time) {
+    return;
+  }
+  Sample* sample = &samples_[next_sample_];
+  sample->time = request_time + (response_time - request_time) / 2;
+  sample->round_trip_time = response_time - request_time;
+  sample->offset = server_time - sample->time;
+  next_sample_ = (next_sample_ + 1) % WINDOW_SIZE;
+  if (sample_count_ < WINDOW_SIZE) {
+    sample_count_++;
+  }
+
+  UpdateEstimate();
+
+  if (!synchronized_) {
+    synchronized_ = true;
+    slew_time_ = response_time;
+    offset_ = GetTargetOffset(response_time);
+  }
+}
+
+bool ClockSync::IsSynchronized() const {
+  return synchronized_;
+}
+
+int64_t ClockSync::GetServerTime(int64_t local_time) {
+  CHECK(synchronized_);
+  if (local_time > slew_time_) {
+    float64_t error = GetTargetOffset(local_time) - offset_;
+    float64_t max_step = MAX_SLEW_RATE * (local_time - slew_time_);
+    if (std::fabs(error) > MAX_SLEW_ERROR) {
+      offset_ += error;
+    } else {
+      offset_ += std::min(std::max(error, -max_step), max_step);
+    }
+    slew_time_ = local_time;
+  }
+  return local_time + static_cast<int64_t>(std::floor(offset_ + 0.5));
+}
+
+int64_t ClockSync::GetLatency() const {
+  return latency_;
+}
+
+bool ClockSync::HasLowerRoundTrip(const Sample& a, const Sample& b) {
+  return a.round_trip_time < b.round_trip_time;
+}
+
+void ClockSync::UpdateEstimate() {
+  CHECK(sample_count_ > 0);
+  Sample best[WINDOW_SIZE];
+  std::copy(samples_, samples_ + sample_count_, best);
+  size_t count =
+      (sample_count_ < BEST_SAMPLES) ? sample_count_ : BEST_SAMPLES;
+  std::partial_sort(best, best + count, best + sample_count_,
+      HasLowerRoundTrip);
+
+  float64_t mean_time = 0.0;
+  float64_t mean_offset = 0.0;
+  int64_t min_time = best[0].time;
+  int64_t max_time = best[0].time;
+  for (size_t i = 0; i < count; i++) {
+    mean_time += static_cast<float64_t>(best[i].time - best[0].time);
+    mean_offset += static_cast<float64_t>(best[i].offset);
+    min_time = std::min(min_time, best[i].time);
+    max_time = std::max(max_time, best[i].time);
+  }
+  // Times are relative to 'best[0]' to keep the precision.
+  mean_time /= count;
+  mean_offset /= count;
+
+  drift_ = 0.0;
+  if (count >= 3 && max_time - min_time >= MIN_DRIFT_SPAN) {
+    float64_t covariance = 0.0;
+    float64_t variance = 0.0;
+    for (size_t i = 0; i < count; i++) {
+      float64_t dt =
+          static_cast<float64_t>(best[i].time - best[0].time) - mean_time;
+      covariance += dt * (static_cast<float64_t>(best[i].offset) -
+          mean_offset);
+      variance += dt * dt;
+    }
+    drift_ = std::min(std::max(covariance / variance, -MAX_DRIFT),
+        MAX_DRIFT);
+  }
+
+  estimate_time_ = best[0].time +
+      static_cast<int64_t>(std::floor(mean_time + 0.5));
+  estimate_offset_ = mean_offset;
+  latency_ = best[0].round_trip_time / 2;
+}
+
+float64_t ClockSync::GetTargetOffset(int64_t local_time) const {
+  return estimate_offset_ + drift_ * (local_time - estimate_time_);
+}
+
+}  // namespace bm
@@ -0,0 +1,80 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef CLIENT_CLOCK_SYNC_H_
+#define CLIENT_CLOCK_SYNC_H_
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+namespace bm {
+
+// Estimates the server clock from time sync round trips. The offset is
+// taken from the samples with the lowest round trip time in a window of
+// recent ones, since their midpoint is the most accurate, and the drift
+// of the local clock is fitted across them. Once synchronized, the
+// estimated server time is slewed towards new estimates instead of
+// jumping, so it never goes back and snapshot times stay consistent.
+class ClockSync {
+ public:
+  // Recent samples taken into account.
+  static const size_t WINDOW_SIZE = 16;
+  // The lowest round trip samples of the window the estimate is based on.
+  static const size_t BEST_SAMPLES = 6;
+
+  ClockSync();
+  ~ClockSync();
+
+  void Reset();
+
+  // Adds a sample from a request sent at the local time 'request_time'
+  // and answered with 'server_time' at 'response_time'.
+  void AddSample(int64_t request_time, int64_t server_time,
+      int64_t response_time);
+
+  bool IsSynchronized() const;
+
+  // Returns the estimated server time at the local time 'local_time'.
+  // The first sample sets the clock right away, later corrections are
+  // applied gradually as 'local_time' advances.
+  int64_t GetServerTime(int64_t local_time);
+
+  // Half of the lowest round trip time in the window.
+  int64_t GetLatency() const;
+
+ private:
+  struct Sample {
+    // Local time in the middle of the round trip.
+    int64_t time;
+    int64_t round_trip_time;
+    // Server time minus local time at 'time'.
+    int64_t offset;
+  };
+
+  static bool HasLowerRoundTrip(const Sample& a, const Sample& b);
+
+  // Recomputes the estimate from the window.
+  void UpdateEstimate();
+  // Returns the estimated offset at 'local_time'.
+  float64_t GetTargetOffset(int64_t local_time) const;
+
+  Sample samples_[WINDOW_SIZE];
+  size_t next_sample_;
+  size_t sample_count_;
+
+  // Offset at 'estimate_time' and its change per ms.
+  int64_t estimate_time_;
+  float64_t estimate_offset_;
+  float64_t drift_;
+  int64_t latency_;
+
+  // The offset applied as of 'slew_time'.
+  bool synchronized_;
+  int64_t slew_time_;
+  float64_t offset_;
+
+  DISALLOW_COPY_AND_ASSIGN(ClockSync);
+};
+
+}  // namespace bm
+
+#endif  // CLIENT_CLOCK_SYNC_H_
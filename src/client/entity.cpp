@@ -13,6 +13,8 @@
 #include "base/time.h"
 #include "base/utils.h"
 
+#include "interpolator/interpolator.h"
+
 #include "engine/body.h"
 #include "engine/entity.h"
 
@@ -21,15 +23,26 @@
 
 namespace bm {
 
+EntityFrame EntityFrameTraits::lerp(const EntityFrame& a,
+    const EntityFrame& b, double ratio) {
+  b2Vec2 position = a.position +
+      static_cast<float32_t>(ratio) * (b.position - a.position);
+  float32_t angle = static_cast<float32_t>(
+      interpolator::lerpAngle(a.angle, b.angle, ratio));
+  return EntityFrame(position, angle);
+}
+
 ClientEntity::ClientEntity(
   b2World* world,
   uint32_t id,
   Type type,
-  const std::string& entity_name,
+  uint32_t prototype_id,
   b2Vec2 position,
   Sprite* sprite
-) : Entity(world, id, type, entity_name, position, FILTER_DEFAULT, FILTER_ALL),
+) : Entity(world, id, type, prototype_id, position, FILTER_DEFAULT, FILTER_ALL,
+           NULL),
     sprite_(sprite),
+    interpolator_(NO_INTERPOLATOR),
     caption_visible_(false) {
   // XXX(xairy): create Sprite here?
 }
@@ -51,17 +64,12 @@ sf::Text* ClientEntity::GetCaption() {
   return &caption_text_;
 }
 
-void ClientEntity::SetInterpolationPosition(
-  const b2Vec2& position,
-  int64_t snapshot_time,
-  int64_t interpolation_offset,
-  int64_t server_time
-) {
-  CHECK(server_time - interpolation_offset < snapshot_time);
-  b2Vec2 impulse = GetMass() /
-      (snapshot_time - (server_time - interpolation_offset)) * 1000 *
-      (b2Vec2(position.x, position.y) - GetPosition());
-  SetImpulse(impulse);
+size_t ClientEntity::GetInterpolator() const {
+  return interpolator_;
+}
+
+void ClientEntity::SetInterpolator(size_t index) {
+  interpolator_ = index;
 }
 
 void ClientEntity::EnableCaption(
@@ -11,6 +11,8 @@
 
 #include "base/pstdint.h"
 
+#include "interpolator/interpolator.h"
+
 #include "engine/body.h"
 #include "engine/entity.h"
 
@@ -18,13 +20,31 @@
 
 namespace bm {
 
+// State of a dynamic entity taken from its snapshots.
+struct EntityFrame {
+  EntityFrame() : position(0.0f, 0.0f), angle(0.0f) { }
+  EntityFrame(const b2Vec2& position, float32_t angle)
+    : position(position), angle(angle) { }
+
+  b2Vec2 position;
+  float32_t angle;
+};
+
+struct EntityFrameTraits {
+  static EntityFrame lerp(const EntityFrame& a, const EntityFrame& b,
+      double ratio);
+};
+
+typedef interpolator::InterpolatorArray<EntityFrame, int64_t, 8,
+    EntityFrameTraits> EntityInterpolators;
+
 class ClientEntity : public Entity {
  public:
   ClientEntity(
     b2World* world,
     uint32_t id,
     Type type,
-    const std::string& entity_name,
+    uint32_t prototype_id,
     b2Vec2 position,
     Sprite* sprite);
   ~ClientEntity();
@@ -34,15 +54,17 @@ class ClientEntity : public Entity {
   bool HasCaption();
   sf::Text* GetCaption();
 
-  // Makes object to start moving towards 'position' to be there when
-  // current time - 'interpolation_offset' == 'time'.
-  void SetInterpolationPosition(const b2Vec2& position,
-      int64_t snapshot_time, int64_t interpolation_offset, int64_t server_time);
+  // Index of the entity's interpolator in 'EntityInterpolators', which
+  // is 'NO_INTERPOLATOR' for static entities.
+  static const size_t NO_INTERPOLATOR = static_cast<size_t>(-1);
+  size_t GetInterpolator() const;
+  void SetInterpolator(size_t index);
 
   void EnableCaption(const std::string& caption, const sf::Font& font);
 
  private:
   Sprite* sprite_;
+  size_t interpolator_;
 
   bool caption_visible_;
   sf::Text caption_text_;
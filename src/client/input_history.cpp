@@ -0,0 +1,70 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "client/input_history.h"
+
+#include <Box2D/Box2D.h>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+namespace bm {
+
+InputHistory::InputHistory() {
+  Clear();
+}
+
+InputHistory::~InputHistory() { }
+
+void InputHistory::Push(uint32_t sequence, int64_t time, uint32_t keys,
+    const b2Vec2& position) {
+  if (size_ == SIZE) {
+    first_ = (first_ + 1) % SIZE;
+    size_--;
+  }
+  Input* input = &inputs_[(first_ + size_) % SIZE];
+  input->sequence = sequence;
+  input->time = time;
+  input->keys = keys;
+  input->position = position;
+  size_++;
+}
+
+void InputHistory::DropBefore(uint32_t sequence) {
+  while (size_ > 0 &&
+      static_cast<int32_t>(inputs_[first_].sequence - sequence) < 0) {
+    first_ = (first_ + 1) % SIZE;
+    size_--;
+  }
+}
+
+bool InputHistory::GetPosition(int64_t time, b2Vec2* position) const {
+  CHECK(position != NULL);
+  for (size_t i = 1; i < size_; i++) {
+    const Input& before = Get(i - 1);
+    const Input& after = Get(i);
+    if (before.time <= time && time <= after.time) {
+      float32_t alpha = (after.time == before.time) ? 1.0f :
+          static_cast<float32_t>(time - before.time) /
+          (after.time - before.time);
+      *position = before.position + alpha * (after.position - before.position);
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t InputHistory::GetSize() const {
+  return size_;
+}
+
+const InputHistory::Input& InputHistory::Get(size_t index) const {
+  CHECK(index < size_);
+  return inputs_[(first_ + index) % SIZE];
+}
+
+void InputHistory::Clear() {
+  first_ = 0;
+  size_ = 0;
+}
+
+}  // namespace bm
@@ -0,0 +1,68 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef CLIENT_INPUT_HISTORY_H_
+#define CLIENT_INPUT_HISTORY_H_
+
+#include <Box2D/Box2D.h>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+namespace bm {
+
+// The input of every client tick, oldest first, along with the player
+// position predicted at that tick. The ticks are kept while their input
+// command is either not applied by the server yet or still in effect
+// there. Used to check the prediction against the authoritative player
+// state and to replay the input on top of it.
+class InputHistory {
+ public:
+  // Two seconds of ticks at the usual tick rate, the older ones
+  // are dropped.
+  static const size_t SIZE = 64;
+
+  struct Input {
+    // The last input command sent by the tick.
+    uint32_t sequence;
+    // Server time of the tick.
+    int64_t time;
+    // The held keys, see 'InputCommand::keys'.
+    uint32_t keys;
+    // The predicted player position at 'time'.
+    b2Vec2 position;
+  };
+
+  InputHistory();
+  ~InputHistory();
+
+  // Adds the newest input, dropping the oldest one if the history is full.
+  void Push(uint32_t sequence, int64_t time, uint32_t keys,
+      const b2Vec2& position);
+
+  // Drops the inputs before 'sequence'. The input 'sequence' itself is
+  // kept, it stays in effect on the server until the next one arrives.
+  void DropBefore(uint32_t sequence);
+
+  // Sets '*position' to the predicted position at 'time', interpolated
+  // between the ticks. Returns 'false' if 'time' isn't between two kept
+  // ticks.
+  bool GetPosition(int64_t time, b2Vec2* position) const;
+
+  size_t GetSize() const;
+  // 'index' 0 is the oldest input.
+  const Input& Get(size_t index) const;
+
+  void Clear();
+
+ private:
+  Input inputs_[SIZE];
+  // Index of the oldest input.
+  size_t first_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(InputHistory);
+};
+
+}  // namespace bm
+
+#endif  // CLIENT_INPUT_HISTORY_H_
@@ -0,0 +1,117 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "client/interpolation_delay.h"
+
+#include <algorithm>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+namespace bm {
+
+// The delay grows quickly, slowing the shown time down by up to a fifth,
+// to stop underruns soon. It shrinks slowly, so a single calm period
+// doesn't bring them back.
+static const float64_t INCREASE_RATE = 0.2;
+static const float64_t DECREASE_RATE = 0.02;
+
+InterpolationDelay::InterpolationDelay() {
+  Reset(0, 0, 0, 0.0f);
+}
+
+InterpolationDelay::~InterpolationDelay() { }
+
+void InterpolationDelay::Reset(int64_t delay, int64_t min_delay,
+    int64_t max_delay, float32_t underrun_rate) {
+  CHECK(min_delay <= max_delay);
+  CHECK(0.0f <= underrun_rate && underrun_rate <= 1.0f);
+  min_delay_ = min_delay;
+  max_delay_ = max_delay;
+  underrun_rate_ = underrun_rate;
+  next_sample_ = 0;
+  sample_count_ = 0;
+  last_sequence_ = 0;
+  last_snapshot_time_ = 0;
+  target_delay_ = std::max(min_delay, std::min(max_delay, delay));
+  delay_ = static_cast<float64_t>(target_delay_);
+  delay_time_ = 0;
+  snapshot_count_ = 0;
+  loss_count_ = 0;
+  underrun_count_ = 0;
+}
+
+void InterpolationDelay::OnSnapshot(uint32_t sequence, int64_t snapshot_time,
+    int64_t arrival_time) {
+  if (last_sequence_ != 0 &&
+      static_cast<int32_t>(sequence - last_sequence_) <= 0) {
+    return;
+  }
+  snapshot_count_++;
+
+  if (last_sequence_ != 0) {
+    loss_count_ += sequence - last_sequence_ - 1;
+
+    // The previous snapshot was the last one to show until this one came.
+    int64_t needed_delay = arrival_time - last_snapshot_time_;
+    if (needed_delay > static_cast<int64_t>(delay_)) {
+      underrun_count_++;
+    }
+
+    samples_[next_sample_] = needed_delay;
+    next_sample_ = (next_sample_ + 1) % WINDOW_SIZE;
+    if (sample_count_ < WINDOW_SIZE) {
+      sample_count_++;
+    }
+    UpdateTarget();
+  }
+
+  last_sequence_ = sequence;
+  last_snapshot_time_ = snapshot_time;
+}
+
+int64_t InterpolationDelay::GetDelay(int64_t time) {
+  int64_t elapsed = (delay_time_ != 0) ? time - delay_time_ : 0;
+  delay_time_ = time;
+  if (elapsed > 0) {
+    float64_t target = static_cast<float64_t>(target_delay_);
+    if (delay_ < target) {
+      delay_ = std::min(target, delay_ + elapsed * INCREASE_RATE);
+    } else {
+      delay_ = std::max(target, delay_ - elapsed * DECREASE_RATE);
+    }
+  }
+  return static_cast<int64_t>(delay_);
+}
+
+int64_t InterpolationDelay::GetTargetDelay() const {
+  return target_delay_;
+}
+
+uint32_t InterpolationDelay::GetSnapshotCount() const {
+  return snapshot_count_;
+}
+
+uint32_t InterpolationDelay::GetLossCount() const {
+  return loss_count_;
+}
+
+uint32_t InterpolationDelay::GetUnderrunCount() const {
+  return underrun_count_;
+}
+
+void InterpolationDelay::UpdateTarget() {
+  if (sample_count_ < MIN_SAMPLES) {
+    return;
+  }
+  // The samples above the target would be underruns.
+  std::copy(&samples_[0], &samples_[0] + sample_count_, &sorted_samples_[0]);
+  size_t index = static_cast<size_t>(
+      (1.0f - underrun_rate_) * sample_count_);
+  index = std::min(index, sample_count_ - 1);
+  std::nth_element(&sorted_samples_[0], &sorted_samples_[0] + index,
+      &sorted_samples_[0] + sample_count_);
+  target_delay_ = std::max(min_delay_,
+      std::min(max_delay_, sorted_samples_[index]));
+}
+
+}  // namespace bm
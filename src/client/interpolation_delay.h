@@ -0,0 +1,78 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef CLIENT_INTERPOLATION_DELAY_H_
+#define CLIENT_INTERPOLATION_DELAY_H_
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+namespace bm {
+
+// Chooses how far behind the server time the other entities are shown.
+// An underrun happens when the entities are shown past the last received
+// snapshot before the next one arrives, so they have to be extrapolated.
+// For every snapshot the delay that would have avoided it is measured,
+// which covers both the jitter and the lost snapshots, and the delay
+// targets the quantile of the recent ones that gives the wanted underrun
+// rate.
+class InterpolationDelay {
+ public:
+  // Recent snapshots taken into account.
+  static const size_t WINDOW_SIZE = 64;
+  // Snapshots measured before the delay is adapted.
+  static const size_t MIN_SAMPLES = 8;
+
+  InterpolationDelay();
+  ~InterpolationDelay();
+
+  // Starts with 'delay' and adapts it within ['min_delay', 'max_delay']
+  // to make about 'underrun_rate' of the snapshots come too late.
+  void Reset(int64_t delay, int64_t min_delay, int64_t max_delay,
+      float32_t underrun_rate);
+
+  // Called when the snapshot 'sequence' taken at 'snapshot_time' is
+  // completely received at the server time 'arrival_time'. Snapshots are
+  // expected in order, the skipped sequences are counted as lost.
+  void OnSnapshot(uint32_t sequence, int64_t snapshot_time,
+      int64_t arrival_time);
+
+  // Returns the delay at the server time 'time'. The delay follows the
+  // target gradually, so the shown time doesn't jump.
+  int64_t GetDelay(int64_t time);
+  int64_t GetTargetDelay() const;
+
+  uint32_t GetSnapshotCount() const;
+  uint32_t GetLossCount() const;
+  uint32_t GetUnderrunCount() const;
+
+ private:
+  void UpdateTarget();
+
+  int64_t min_delay_;
+  int64_t max_delay_;
+  float32_t underrun_rate_;
+
+  // Delays that were needed for the recent snapshots.
+  int64_t samples_[WINDOW_SIZE];
+  int64_t sorted_samples_[WINDOW_SIZE];
+  size_t next_sample_;
+  size_t sample_count_;
+
+  uint32_t last_sequence_;
+  int64_t last_snapshot_time_;
+
+  int64_t target_delay_;
+  // The delay as of 'delay_time_'.
+  float64_t delay_;
+  int64_t delay_time_;
+
+  uint32_t snapshot_count_;
+  uint32_t loss_count_;
+  uint32_t underrun_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(InterpolationDelay);
+};
+
+}  // namespace bm
+
+#endif  // CLIENT_INTERPOLATION_DELAY_H_
@@ -2,19 +2,76 @@
 
 #include "engine/body.h"
 
+#include <map>
 #include <string>
 #include <vector>
 
 #include <Box2D/Box2D.h>
 
 #include "base/macros.h"
+#include "base/pstdint.h"
 
 #include "engine/config.h"
 #include "engine/utils.h"
 
 namespace bm {
 
-Body::Body() : world_(NULL), body_(NULL), state_(STATE_DESTROYED) { }
+BodyPool::BodyPool(b2World* world, size_t max_parked)
+    : world_(world), max_parked_(max_parked), hit_count_(0), miss_count_(0) {
+  CHECK(world != NULL);
+}
+
+BodyPool::~BodyPool() {
+  std::map<const Config::BodyConfig*, std::vector<b2Body*> >::iterator i;
+  for (i = parked_.begin(); i != parked_.end(); ++i) {
+    for (size_t j = 0; j < i->second.size(); j++) {
+      world_->DestroyBody(i->second[j]);
+    }
+  }
+}
+
+b2Body* BodyPool::Acquire(const Config::BodyConfig* config) {
+  std::vector<b2Body*>& bodies = parked_[config];
+  if (bodies.empty()) {
+    miss_count_++;
+    return NULL;
+  }
+  hit_count_++;
+  b2Body* body = bodies.back();
+  bodies.pop_back();
+  body->SetType(config->dynamic ? b2_dynamicBody : b2_staticBody);
+  body->SetTransform(b2Vec2(0.0f, 0.0f), 0.0f);
+  body->SetLinearVelocity(b2Vec2(0.0f, 0.0f));
+  body->SetAngularVelocity(0.0f);
+  body->SetActive(true);
+  body->SetAwake(true);
+  return body;
+}
+
+void BodyPool::Park(const Config::BodyConfig* config, b2Body* body) {
+  CHECK(body != NULL);
+  std::vector<b2Body*>& bodies = parked_[config];
+  if (bodies.size() >= max_parked_) {
+    world_->DestroyBody(body);
+    return;
+  }
+  // Inactive bodies are out of the broad-phase and have no contacts.
+  body->SetActive(false);
+  body->SetUserData(NULL);
+  bodies.push_back(body);
+}
+
+uint64_t BodyPool::GetHitCount() const {
+  return hit_count_;
+}
+
+uint64_t BodyPool::GetMissCount() const {
+  return miss_count_;
+}
+
+Body::Body()
+    : world_(NULL), body_(NULL), pool_(NULL), config_(NULL),
+      state_(STATE_DESTROYED) { }
 
 Body::~Body() {
   if (state_ == STATE_CREATED) {
@@ -22,16 +79,24 @@ Body::~Body() {
   }
 }
 
-void Body::Create(b2World* world, const std::string& body_name) {
+void Body::Create(b2World* world, const Config::BodyConfig* body_config,
+    BodyPool* pool) {
   CHECK(state_ == STATE_DESTROYED);
   CHECK(world != NULL);
+  CHECK(body_config != NULL);
 
   world_ = world;
-
-  // FIXME(xairy): check.
-  CHECK(Config::GetInstance()->GetBodiesConfig().count(body_name) > 0);
-  const Config::BodyConfig& config =
-    Config::GetInstance()->GetBodiesConfig().at(body_name);
+  pool_ = pool;
+  config_ = body_config;
+  const Config::BodyConfig& config = *body_config;
+
+  if (pool_ != NULL) {
+    body_ = pool_->Acquire(config_);
+    if (body_ != NULL) {
+      state_ = STATE_CREATED;
+      return;
+    }
+  }
 
   b2BodyDef body_def;
   body_def.type = config.dynamic ? b2_dynamicBody : b2_staticBody;
@@ -75,9 +140,15 @@ void Body::Create(b2World* world, const std::string& body_name) {
 
 void Body::Destroy() {
   CHECK(state_ == STATE_CREATED);
-  world_->DestroyBody(body_);
+  if (pool_ != NULL) {
+    pool_->Park(config_, body_);
+  } else {
+    world_->DestroyBody(body_);
+  }
   world_ = NULL;
   body_ = NULL;
+  pool_ = NULL;
+  config_ = NULL;
   state_ = STATE_DESTROYED;
 }
 
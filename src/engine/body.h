@@ -3,22 +3,61 @@
 #ifndef ENGINE_BODY_H_
 #define ENGINE_BODY_H_
 
+#include <map>
 #include <string>
+#include <vector>
 
 #include <Box2D/Box2D.h>
 
 #include "base/macros.h"
+#include "base/pstdint.h"
 
+#include "engine/config.h"
 #include "engine/dll.h"
 
 namespace bm {
 
+// Keeps the Box2D bodies of the destroyed 'Body' objects of a world
+// deactivated and hands them out to the new ones made from the same
+// config, so the bodies and their fixtures aren't recreated.
+class BM_ENGINE_DECL BodyPool {
+ public:
+  // Keeps at most 'max_parked' bodies made from every config.
+  BodyPool(b2World* world, size_t max_parked);
+  // Destroys the parked bodies.
+  ~BodyPool();
+
+  // Returns a parked body made from 'config' activated again, with its
+  // velocity reset, or 'NULL' if there is none.
+  b2Body* Acquire(const Config::BodyConfig* config);
+  // Deactivates 'body' made from 'config' and keeps it, or destroys it
+  // if there are enough parked bodies. Parked bodies are skipped by the
+  // broad-phase but still walked by 'b2World::Step()'.
+  void Park(const Config::BodyConfig* config, b2Body* body);
+
+  // The number of acquisitions that reused a body and that didn't.
+  uint64_t GetHitCount() const;
+  uint64_t GetMissCount() const;
+
+ private:
+  b2World* world_;
+  std::map<const Config::BodyConfig*, std::vector<b2Body*> > parked_;
+  size_t max_parked_;
+  uint64_t hit_count_;
+  uint64_t miss_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(BodyPool);
+};
+
 class BM_ENGINE_DECL Body {
  public:
   Body();
   virtual ~Body();
 
-  void Create(b2World* world, const std::string& body_config);
+  // The body is taken from 'pool' and parked there on 'Destroy()' if
+  // 'pool' isn't 'NULL'.
+  void Create(b2World* world, const Config::BodyConfig* config,
+      BodyPool* pool);
   void Destroy();
 
   b2Body* GetBody();
@@ -44,6 +83,8 @@ class BM_ENGINE_DECL Body {
  private:
   b2World* world_;
   b2Body* body_;
+  BodyPool* pool_;
+  const Config::BodyConfig* config_;
 
   enum {
     STATE_DESTROYED,
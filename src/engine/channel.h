@@ -0,0 +1,30 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef ENGINE_CHANNEL_H_
+#define ENGINE_CHANNEL_H_
+
+namespace bm {
+
+// Fixed channel layout used by both server and client hosts.
+enum Channel {
+  // Unreliable sequenced. For state that is superseded by every broadcast,
+  // so that fresh packets never wait for retransmits of stale ones.
+  CHANNEL_SNAPSHOTS,
+
+  // Reliable. Game events and player input.
+  CHANNEL_EVENTS,
+
+  // Reliable. Login, time synchronization and other connection control.
+  CHANNEL_CONTROL,
+
+  CHANNEL_COUNT
+};
+
+// Returns 'true' if packets sent through 'channel' are delivered reliably.
+inline bool IsChannelReliable(Channel channel) {
+  return channel != CHANNEL_SNAPSHOTS;
+}
+
+}  // namespace bm
+
+#endif  // ENGINE_CHANNEL_H_
@@ -13,6 +13,8 @@
 #include "base/pstdint.h"
 #include "base/singleton.h"
 
+#include "engine/protocol.h"
+
 namespace bm {
 
 Config* Config::GetInstance() {
@@ -39,6 +41,9 @@ bool Config::Initialize() {
   if (!LoadGunsConfig()) {
     return false;
   }
+  if (!BuildPrototypes()) {
+    return false;
+  }
   state_ = STATE_INITIALIZED;
   return true;
 }
@@ -124,6 +129,29 @@ Config::GetGunsConfig() const {
   return guns_;
 }
 
+size_t Config::GetPrototypeCount() const {
+  CHECK(state_ == STATE_INITIALIZED);
+  return prototypes_.size();
+}
+
+const Config::Prototype& Config::GetPrototype(uint32_t id) const {
+  CHECK(state_ == STATE_INITIALIZED);
+  CHECK(id < prototypes_.size());
+  return prototypes_[id];
+}
+
+uint32_t Config::FindPrototypeId(Prototype::Kind kind,
+    const std::string& name) const {
+  CHECK(state_ == STATE_INITIALIZED);
+  CHECK(kind < Prototype::KIND_COUNT);
+  std::map<std::string, uint32_t>::const_iterator itr =
+      prototype_ids_[kind].find(name);
+  if (itr == prototype_ids_[kind].end()) {
+    return BAD_PROTOTYPE_ID;
+  }
+  return itr->second;
+}
+
 bool Config::LoadMasterServerConfig() {
   std::string file = "data/master-server.json";
   Json::Reader reader;
@@ -177,6 +205,12 @@ bool Config::LoadServerConfig() {
     return false;
   }
   server_.port = static_cast<uint16_t>(port);
+  if (!GetInt32(server["max_clients"], &server_.max_clients) ||
+      server_.max_clients <= 0) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "server", "max_clients", "int", file.c_str());
+    return false;
+  }
   if (!GetInt32(server["broadcast_rate"], &server_.broadcast_rate)) {
     REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
         "server", "broadcast_rate", "int", file.c_str());
@@ -187,6 +221,12 @@ bool Config::LoadServerConfig() {
         "server", "tick_rate", "int", file.c_str());
     return false;
   }
+  if (!GetInt32(server["max_catch_up_steps"], &server_.max_catch_up_steps) ||
+      server_.max_catch_up_steps <= 0) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "server", "max_catch_up_steps", "int", file.c_str());
+    return false;
+  }
   if (!GetString(server["map"], &server_.map)) {
     REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
         "server", "map", "string", file.c_str());
@@ -197,6 +237,117 @@ bool Config::LoadServerConfig() {
         "server", "name", "string", file.c_str());
     return false;
   }
+  server_.rooms.clear();
+  Json::Value rooms = server["rooms"];
+  if (rooms.isNull()) {
+    RoomConfig room;
+    room.name = "default";
+    room.map = server_.map;
+    server_.rooms.push_back(room);
+  } else if (!rooms.isArray() || rooms.size() == 0) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "server", "rooms", "array", file.c_str());
+    return false;
+  }
+  for (int i = 0; i < static_cast<int>(rooms.size()); i++) {
+    RoomConfig room;
+    if (!GetString(rooms[i]["name"], &room.name) || room.name.empty() ||
+        room.name.size() > LoginData::MAX_ROOM_LENGTH) {
+      REPORT_ERROR("Config '%s.%s[%d].%s' of type '%s' not found in '%s'.",
+          "server", "rooms", i, "name", "string", file.c_str());
+      return false;
+    }
+    if (!GetString(rooms[i]["map"], &room.map)) {
+      REPORT_ERROR("Config '%s.%s[%d].%s' of type '%s' not found in '%s'.",
+          "server", "rooms", i, "map", "string", file.c_str());
+      return false;
+    }
+    for (size_t j = 0; j < server_.rooms.size(); j++) {
+      if (server_.rooms[j].name == room.name) {
+        REPORT_ERROR("Room '%s' is listed twice in '%s'.",
+            room.name.c_str(), file.c_str());
+        return false;
+      }
+    }
+    server_.rooms.push_back(room);
+  }
+
+  Json::Value net = root["net"];
+  if (net.isNull() || !net.isObject()) {
+    REPORT_ERROR("Config '%s' of type '%s' not found in '%s'.",
+        "net", "object", file.c_str());
+    return false;
+  }
+  if (!GetFloat32(net["position_precision"], &server_.position_precision) ||
+      server_.position_precision <= 0.0f) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "net", "position_precision", "float", file.c_str());
+    return false;
+  }
+  Json::Value packed_messages = net["packed_messages"];
+  if (packed_messages.isNull() || !packed_messages.isArray()) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "net", "packed_messages", "array", file.c_str());
+    return false;
+  }
+  server_.packed_messages.clear();
+  for (int i = 0; i < static_cast<int>(packed_messages.size()); i++) {
+    std::string message;
+    if (!GetString(packed_messages[i], &message)) {
+      REPORT_ERROR("Config '%s.%s[%d]' of type '%s' not found in '%s'.",
+          "net", "packed_messages", i, "string", file.c_str());
+      return false;
+    }
+    server_.packed_messages.push_back(message);
+  }
+  if (!GetFloat32(net["interest_radius"], &server_.interest_radius) ||
+      server_.interest_radius <= 0.0f) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "net", "interest_radius", "float", file.c_str());
+    return false;
+  }
+  if (!GetFloat32(net["interest_hysteresis"], &server_.interest_hysteresis) ||
+      server_.interest_hysteresis < 0.0f) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "net", "interest_hysteresis", "float", file.c_str());
+    return false;
+  }
+  if (!GetInt32(net["interpolation_offset"], &server_.interpolation_offset) ||
+      server_.interpolation_offset < 0) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "net", "interpolation_offset", "int", file.c_str());
+    return false;
+  }
+  if (!GetInt32(net["max_lag_compensation"],
+          &server_.max_lag_compensation) ||
+      server_.max_lag_compensation < 0) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "net", "max_lag_compensation", "int", file.c_str());
+    return false;
+  }
+
+  Json::Value profiler = root["profiler"];
+  if (profiler.isNull() || !profiler.isObject()) {
+    REPORT_ERROR("Config '%s' of type '%s' not found in '%s'.",
+        "profiler", "object", file.c_str());
+    return false;
+  }
+  if (!GetString(profiler["file"], &server_.profile_file)) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "profiler", "file", "string", file.c_str());
+    return false;
+  }
+  if (!GetInt32(profiler["report_period"], &server_.profile_report_period) ||
+      server_.profile_report_period <= 0) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "profiler", "report_period", "int", file.c_str());
+    return false;
+  }
+  if (!GetBool(profiler["stats"], &server_.profile_stats)) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "profiler", "stats", "bool", file.c_str());
+    return false;
+  }
 
   Json::Value master_server = root["master-server"];
   if (master_server.isNull() || !master_server.isObject()) {
@@ -249,6 +400,12 @@ bool Config::LoadClientConfig() {
     return false;
   }
   client_.server_port = static_cast<uint16_t>(port);
+  if (!GetString(server["room"], &client_.server_room) ||
+      client_.server_room.size() > LoginData::MAX_ROOM_LENGTH) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "server", "room", "string", file.c_str());
+    return false;
+  }
 
   Json::Value master_server = root["master-server"];
   if (master_server.isNull() || !master_server.isObject()) {
@@ -335,6 +492,29 @@ bool Config::LoadClientConfig() {
         "net", "interpolation_offset", "int", file.c_str());
     return false;
   }
+  if (!GetInt32(net["min_interpolation_offset"],
+          &client_.min_interpolation_offset) ||
+      client_.min_interpolation_offset < 0 ||
+      client_.min_interpolation_offset > client_.interpolation_offset) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "net", "min_interpolation_offset", "int", file.c_str());
+    return false;
+  }
+  if (!GetInt32(net["max_interpolation_offset"],
+          &client_.max_interpolation_offset) ||
+      client_.max_interpolation_offset < client_.interpolation_offset) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "net", "max_interpolation_offset", "int", file.c_str());
+    return false;
+  }
+  if (!GetFloat32(net["interpolation_underrun_rate"],
+          &client_.interpolation_underrun_rate) ||
+      client_.interpolation_underrun_rate < 0.0f ||
+      client_.interpolation_underrun_rate > 1.0f) {
+    REPORT_ERROR("Config '%s.%s' of type '%s' not found in '%s'.",
+        "net", "interpolation_underrun_rate", "float", file.c_str());
+    return false;
+  }
 
   return true;
 }
@@ -1130,4 +1310,142 @@ bool Config::LoadGunsConfig() {
   return true;
 }
 
+bool Config::BuildPrototypes() {
+  for (auto& item : activators_) {
+    const ActivatorConfig& config = item.second;
+    Prototype* prototype = AddPrototype(Prototype::KIND_ACTIVATOR,
+        config.name, config.body_name, config.sprite_name);
+    if (prototype == NULL) {
+      return false;
+    }
+    prototype->activation_distance = config.activation_distance;
+  }
+
+  for (auto& item : critters_) {
+    const CritterConfig& config = item.second;
+    Prototype* prototype = AddPrototype(Prototype::KIND_CRITTER,
+        config.name, config.body_name, config.sprite_name);
+    if (prototype == NULL) {
+      return false;
+    }
+    prototype->speed = config.speed;
+    prototype->damage = config.damage;
+    prototype->critter_type = config.type;
+  }
+
+  for (auto& item : doors_) {
+    const DoorConfig& config = item.second;
+    Prototype* prototype = AddPrototype(Prototype::KIND_DOOR,
+        config.name, config.body_name, config.sprite_name);
+    if (prototype == NULL) {
+      return false;
+    }
+    prototype->activation_distance = config.activation_distance;
+  }
+
+  for (auto& item : kits_) {
+    const KitConfig& config = item.second;
+    Prototype* prototype = AddPrototype(Prototype::KIND_KIT,
+        config.name, config.body_name, config.sprite_name);
+    if (prototype == NULL) {
+      return false;
+    }
+    prototype->health_regen = config.health_regen;
+    prototype->energy_regen = config.energy_regen;
+  }
+
+  for (auto& item : players_) {
+    const PlayerConfig& config = item.second;
+    Prototype* prototype = AddPrototype(Prototype::KIND_PLAYER,
+        config.name, config.body_name, config.sprite_name);
+    if (prototype == NULL) {
+      return false;
+    }
+    prototype->speed = config.speed;
+    prototype->health_max = config.health_max;
+    prototype->health_regen = config.health_regen;
+    prototype->energy_max = config.energy_max;
+    prototype->energy_regen = config.energy_regen;
+  }
+
+  for (auto& item : projectiles_) {
+    const ProjectileConfig& config = item.second;
+    Prototype* prototype = AddPrototype(Prototype::KIND_PROJECTILE,
+        config.name, config.body_name, config.sprite_name);
+    if (prototype == NULL) {
+      return false;
+    }
+    prototype->speed = config.speed;
+    prototype->projectile_type = config.type;
+    prototype->rocket_config = config.rocket_config;
+    prototype->slime_config = config.slime_config;
+  }
+
+  for (auto& item : walls_) {
+    const WallConfig& config = item.second;
+    Prototype* prototype = AddPrototype(Prototype::KIND_WALL,
+        config.name, config.body_name, config.sprite_name);
+    if (prototype == NULL) {
+      return false;
+    }
+    prototype->wall_type = config.type;
+  }
+
+  // The prototype ids are sent as entity kinds in the snapshots.
+  if (prototypes_.size() >
+      static_cast<size_t>(EntitySnapshot::MAX_KIND_COUNT)) {
+    REPORT_ERROR("More than %d entities defined.",
+        EntitySnapshot::MAX_KIND_COUNT);
+    return false;
+  }
+
+  for (auto& item : guns_) {
+    GunConfig* config = &item.second;
+    std::map<std::string, uint32_t>::const_iterator projectile =
+        prototype_ids_[Prototype::KIND_PROJECTILE].find(
+            config->projectile_name);
+    if (projectile == prototype_ids_[Prototype::KIND_PROJECTILE].end()) {
+      REPORT_ERROR("Projectile '%s' of gun '%s' not found.",
+          config->projectile_name.c_str(), config->name.c_str());
+      return false;
+    }
+    config->projectile_prototype = projectile->second;
+  }
+
+  return true;
+}
+
+Config::Prototype* Config::AddPrototype(Prototype::Kind kind,
+    const std::string& name, const std::string& body_name,
+    const std::string& sprite_name) {
+  std::map<std::string, BodyConfig>::const_iterator body =
+      bodies_.find(body_name);
+  if (body == bodies_.end()) {
+    REPORT_ERROR("Body '%s' of entity '%s' not found.",
+        body_name.c_str(), name.c_str());
+    return NULL;
+  }
+  if (name.size() > EntityKind::MAX_NAME_LENGTH ||
+      sprite_name.size() > EntityKind::MAX_NAME_LENGTH) {
+    REPORT_ERROR("Name of entity '%s' or its sprite is too long.",
+        name.c_str());
+    return NULL;
+  }
+  if (sprites_.count(sprite_name) == 0) {
+    REPORT_ERROR("Sprite '%s' of entity '%s' not found.",
+        sprite_name.c_str(), name.c_str());
+    return NULL;
+  }
+
+  Prototype prototype = Prototype();
+  prototype.id = static_cast<uint32_t>(prototypes_.size());
+  prototype.kind = kind;
+  prototype.name = name;
+  prototype.body = &body->second;
+  prototype.sprite_name = sprite_name;
+  prototype_ids_[kind][name] = prototype.id;
+  prototypes_.push_back(prototype);
+  return &prototypes_.back();
+}
+
 }  // namespace bm
@@ -22,12 +22,49 @@ class Config {
     uint16_t port;
   };
 
+  struct RoomConfig {
+    std::string name;
+    std::string map;
+  };
+
   struct ServerConfig {
     uint16_t port;
+    int32_t max_clients;
     int32_t tick_rate;
+    // Maximum number of simulation steps run at once to catch up with
+    // the real time. The rest of the lag is dropped.
+    int32_t max_catch_up_steps;
     int32_t broadcast_rate;
     std::string map;
     std::string name;
+    // Every room runs its own match on its own thread. Without the
+    // 'rooms' option there is a single room named 'default' with 'map'.
+    std::vector<RoomConfig> rooms;
+
+    // Size of the position quantization step in packed messages.
+    float32_t position_precision;
+    // Names of the message types sent in the packed wire format.
+    std::vector<std::string> packed_messages;
+    // Entities farther than 'interest_radius' from a player aren't sent to
+    // its client. Entities already sent stay until they are farther than
+    // 'interest_radius + interest_hysteresis'.
+    float32_t interest_radius;
+    float32_t interest_hysteresis;
+    // Rocket explosions caused by a player are checked against the other
+    // players as its client showed them: half of its round trip time plus
+    // its interpolation delay in the past, but at most
+    // 'max_lag_compensation' ms. The delay is reported by the client,
+    // 'interpolation_offset' is used until its first input command.
+    int32_t interpolation_offset;
+    int32_t max_lag_compensation;
+
+    // Tick phase timings are written to 'profile_file', or to stdout if
+    // it's empty, every 'profile_report_period' ms.
+    std::string profile_file;
+    int32_t profile_report_period;
+    // Whether the rooms print their snapshot sizes, packet buffer
+    // allocations and pool misses to stdout.
+    bool profile_stats;
 
     std::string master_server_host;
     uint16_t master_server_port;
@@ -36,6 +73,8 @@ class Config {
   struct ClientConfig {
     std::string server_host;
     uint16_t server_port;
+    // The room to join, the least loaded one if empty.
+    std::string server_room;
 
     std::string master_server_host;
     uint16_t master_server_port;
@@ -50,7 +89,12 @@ class Config {
     int32_t connect_timeout;
     int32_t sync_timeout;
     float32_t max_player_misposition;  // FIXME(xairy): rename.
+    // The initial interpolation delay, which is adapted within the bounds
+    // to make about 'interpolation_underrun_rate' of the snapshots late.
     int32_t interpolation_offset;
+    int32_t min_interpolation_offset;
+    int32_t max_interpolation_offset;
+    float32_t interpolation_underrun_rate;
   };
 
   struct BodyConfig {
@@ -194,9 +238,49 @@ class Config {
   struct GunConfig {
     std::string name;
     std::string projectile_name;
+    // The prototype of the projectile, see 'GetPrototype()'.
+    uint32_t projectile_prototype;
     int32_t energy_consumption;
   };
 
+  // An entity kind with everything needed to make its entities resolved
+  // when the config is loaded, so that names are only looked up when a
+  // map is loaded. The prototype ids are the indices in the table.
+  struct Prototype {
+    enum Kind {
+      KIND_ACTIVATOR,
+      KIND_CRITTER,
+      KIND_DOOR,
+      KIND_KIT,
+      KIND_PLAYER,
+      KIND_PROJECTILE,
+      KIND_WALL,
+      KIND_COUNT
+    };
+
+    uint32_t id;
+    Kind kind;
+    std::string name;
+    const BodyConfig* body;
+    std::string sprite_name;
+
+    // Only the parameters of 'kind' are set.
+    float32_t activation_distance;  // Activators and doors.
+    float32_t speed;  // Critters, players and projectiles.
+    int32_t damage;  // Critters.
+    int32_t health_max;  // Players.
+    int32_t health_regen;  // Kits and players.
+    int32_t energy_max;  // Players.
+    int32_t energy_regen;  // Kits and players.
+    CritterConfig::Type critter_type;
+    ProjectileConfig::Type projectile_type;
+    ProjectileConfig::RocketConfig rocket_config;
+    ProjectileConfig::SlimeConfig slime_config;
+    WallConfig::Type wall_type;
+  };
+
+  static const uint32_t BAD_PROTOTYPE_ID = 0xffffffff;
+
   BM_ENGINE_DECL static Config* GetInstance();
 
   BM_ENGINE_DECL Config();
@@ -222,6 +306,13 @@ class Config {
 
   BM_ENGINE_DECL const std::map<std::string, GunConfig>& GetGunsConfig() const;
 
+  BM_ENGINE_DECL size_t GetPrototypeCount() const;
+  BM_ENGINE_DECL const Prototype& GetPrototype(uint32_t id) const;
+  // Returns 'BAD_PROTOTYPE_ID' if there is no prototype of 'kind' named
+  // 'name'.
+  BM_ENGINE_DECL uint32_t FindPrototypeId(Prototype::Kind kind,
+      const std::string& name) const;
+
  private:
   bool LoadMasterServerConfig();
   bool LoadServerConfig();
@@ -241,6 +332,13 @@ class Config {
 
   bool LoadGunsConfig();
 
+  // Resolves the entity configs into the prototype table and the
+  // projectiles of the guns.
+  bool BuildPrototypes();
+  // Returns 'NULL' and reports an error if a name can't be resolved.
+  Prototype* AddPrototype(Prototype::Kind kind, const std::string& name,
+      const std::string& body_name, const std::string& sprite_name);
+
   MasterServerConfig master_server_;
   ServerConfig server_;
   ClientConfig client_;
@@ -259,6 +357,9 @@ class Config {
 
   std::map<std::string, GunConfig> guns_;
 
+  std::vector<Prototype> prototypes_;
+  std::map<std::string, uint32_t> prototype_ids_[Prototype::KIND_COUNT];
+
   enum {
     STATE_FINALIZED,
     STATE_INITIALIZED
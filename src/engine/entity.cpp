@@ -19,62 +19,46 @@
 
 namespace bm {
 
+// The kind of the prototypes of the entities of 'type'.
+static Config::Prototype::Kind GetPrototypeKind(Entity::Type type) {
+  switch (type) {
+    case Entity::TYPE_ACTIVATOR:
+      return Config::Prototype::KIND_ACTIVATOR;
+    case Entity::TYPE_CRITTER:
+      return Config::Prototype::KIND_CRITTER;
+    case Entity::TYPE_DOOR:
+      return Config::Prototype::KIND_DOOR;
+    case Entity::TYPE_KIT:
+      return Config::Prototype::KIND_KIT;
+    case Entity::TYPE_PLAYER:
+      return Config::Prototype::KIND_PLAYER;
+    case Entity::TYPE_PROJECTILE:
+      return Config::Prototype::KIND_PROJECTILE;
+    case Entity::TYPE_WALL:
+      return Config::Prototype::KIND_WALL;
+  }
+  CHECK(false);  // Unreachable.
+  return Config::Prototype::KIND_COUNT;
+}
+
 Entity::Entity(
   b2World* world,
   uint32_t id,
   Type type,
-  const std::string& entity_name,
+  uint32_t prototype_id,
   b2Vec2 position,
   uint16_t collision_category,
-  uint16_t collision_mask
+  uint16_t collision_mask,
+  BodyPool* body_pool
 ) : id_(id),
     type_(type),
-    body_(NULL),
-    name_(entity_name) {
-  std::string body_name;
-  switch (type) {
-    case TYPE_ACTIVATOR: {
-      auto config = Config::GetInstance()->GetActivatorsConfig();
-      CHECK(config.count(entity_name) == 1);
-      body_name = config.at(entity_name).body_name;
-    } break;
-    case TYPE_CRITTER: {
-      auto config = Config::GetInstance()->GetCrittersConfig();
-      CHECK(config.count(entity_name) == 1);
-      body_name = config.at(entity_name).body_name;
-    } break;
-    case TYPE_DOOR: {
-      auto config = Config::GetInstance()->GetDoorsConfig();
-      CHECK(config.count(entity_name) == 1);
-      body_name = config.at(entity_name).body_name;
-    } break;
-    case TYPE_KIT: {
-      auto config = Config::GetInstance()->GetKitsConfig();
-      CHECK(config.count(entity_name) == 1);
-      body_name = config.at(entity_name).body_name;
-    } break;
-    case TYPE_PLAYER: {
-      auto config = Config::GetInstance()->GetPlayersConfig();
-      CHECK(config.count(entity_name) == 1);
-      body_name = config.at(entity_name).body_name;
-    } break;
-    case TYPE_PROJECTILE: {
-      auto config = Config::GetInstance()->GetProjectilesConfig();
-      CHECK(config.count(entity_name) == 1);
-      body_name = config.at(entity_name).body_name;
-    } break;
-    case TYPE_WALL: {
-      auto config = Config::GetInstance()->GetWallsConfig();
-      CHECK(config.count(entity_name) == 1);
-      body_name = config.at(entity_name).body_name;
-    } break;
-    default:
-      CHECK(false);  // Unreachable.
-  }
+    prototype_(&Config::GetInstance()->GetPrototype(prototype_id)),
+    body_(NULL) {
+  CHECK(prototype_->kind == GetPrototypeKind(type));
 
   body_ = new Body();
   CHECK(body_ != NULL);
-  body_->Create(world, body_name);
+  body_->Create(world, prototype_->body, body_pool);
   body_->SetUserData(this);
   body_->SetPosition(position);
   body_->SetCollisionFilter(collision_category, collision_mask);
@@ -103,6 +87,14 @@ bool Entity::IsStatic() const {
   return false;
 }
 
+const Config::Prototype* Entity::GetPrototype() const {
+  return prototype_;
+}
+
+b2Body* Entity::GetBody() {
+  return body_->GetBody();
+}
+
 b2Vec2 Entity::GetPosition() const {
   return body_->GetPosition();
 }
@@ -11,6 +11,7 @@
 #include "base/pstdint.h"
 
 #include "engine/body.h"
+#include "engine/config.h"
 #include "engine/dll.h"
 #include "engine/protocol.h"
 
@@ -43,19 +44,25 @@ class Entity {
   };
 
  public:
+  // 'prototype_id' must be of a prototype of the kind of 'type'.
   BM_ENGINE_DECL Entity(
     b2World* world,
     uint32_t id,
     Type type,
-    const std::string& entity_name,
+    uint32_t prototype_id,
     b2Vec2 position,
     uint16_t collision_category,
-    uint16_t collision_mask);
+    uint16_t collision_mask,
+    BodyPool* body_pool);
   BM_ENGINE_DECL virtual ~Entity();
 
   BM_ENGINE_DECL uint32_t GetId() const;
   BM_ENGINE_DECL Type GetType() const;
   BM_ENGINE_DECL bool IsStatic() const;
+  BM_ENGINE_DECL const Config::Prototype* GetPrototype() const;
+
+  // The Box2D body, whose user data is the entity.
+  BM_ENGINE_DECL b2Body* GetBody();
 
   BM_ENGINE_DECL b2Vec2 GetPosition() const;
   BM_ENGINE_DECL void SetPosition(const b2Vec2& position);
@@ -73,8 +80,8 @@ class Entity {
  protected:
   uint32_t id_;
   Type type_;
+  const Config::Prototype* prototype_;
   Body* body_;
-  std::string name_;
 };
 
 }  // namespace bm
@@ -6,6 +6,7 @@
 #include "base/macros.h"
 #include "base/pstdint.h"
 
+#include "engine/channel.h"
 #include "engine/dll.h"
 
 namespace bm {
@@ -20,6 +21,9 @@ class Packet {
 
     // S -> C. Followed by 'ClientOptions'.
     TYPE_CLIENT_OPTIONS,
+    // S -> C. Followed by 'EntityKindTable' and its 'kind_count'
+    // 'EntityKind's. Sent right after 'TYPE_CLIENT_OPTIONS'.
+    TYPE_ENTITY_KINDS,
 
     // C -> S. Followed by 'ClientStatus'.
     TYPE_CLIENT_STATUS,
@@ -32,21 +36,37 @@ class Packet {
     // S -> C. Followed by 'PlayerInfo'.
     TYPE_PLAYER_INFO,
 
-    // S -> C. Followed by 'EntitySnapshot' with the entity description.
-    TYPE_ENTITY_APPEARED,  // FIXME(xairy): make a GameEvent.
-    TYPE_ENTITY_UPDATED,
+    // S -> C. Followed by 'WorldSnapshot', 'WorldSnapshot::removed_count'
+    // ids of the entities removed since the baseline and
+    // 'WorldSnapshot::entity_count' entity deltas (see 'AppendEntityDelta()'),
+    // all encoded in the 'WireFormat' as a bit stream.
+    // Large snapshots are split into several packets.
+    // Sent unreliably, carries the dynamic entities.
+    TYPE_WORLD_SNAPSHOT,
+    // S -> C. The same as 'TYPE_WORLD_SNAPSHOT' without a baseline, but
+    // sent reliably. Carries the static entities that entered the client's
+    // area of interest, the changes of the visible ones and, as removed ids,
+    // the ones that left it.
+    TYPE_WORLD_UPDATE,
+    // C -> S. Followed by 'SnapshotAck'.
+    TYPE_SNAPSHOT_ACK,
 
     // S -> C. Followed by 'GameEvent'.
     TYPE_GAME_EVENT,
 
-    // C -> S. Followed by 'KeyboardEvent'.
+    // C -> S. Followed by 'KeyboardEvent' encoded in the 'WireFormat'.
     TYPE_KEYBOARD_EVENT,
-    // C -> S. Followed by 'MouseEvent'.
+    // C -> S. Followed by 'MouseEvent' encoded in the 'WireFormat'.
     TYPE_MOUSE_EVENT,
 
     // C -> S. Followed by 'PlayerAction'.
     TYPE_PLAYER_ACTION,
 
+    // C -> S. Followed by 'InputCommand' encoded in the 'WireFormat'.
+    // Sent at most once per client tick instead of separate keyboard
+    // and mouse events.
+    TYPE_INPUT_COMMAND,
+
     TYPE_MAX_VALUE
   };
 
@@ -56,8 +76,11 @@ class Packet {
 
 struct LoginData {
   static const size_t MAX_LOGIN_LENGTH = 31;
+  static const size_t MAX_ROOM_LENGTH = 31;
 
   char login[MAX_LOGIN_LENGTH + 1];
+  // The room to join or an empty string to join the least loaded one.
+  char room[MAX_ROOM_LENGTH + 1];
 };
 
 struct ClientOptions {
@@ -66,6 +89,11 @@ struct ClientOptions {
   float32_t x, y;
   int32_t max_health;
   int32_t energy_capacity;
+
+  // The 'WireFormat' used by the server.
+  uint32_t packed_types;
+  float32_t bound;
+  float32_t position_precision;
 };
 
 struct TimeSyncData {
@@ -90,6 +118,7 @@ struct PlayerInfo {
 //   data[0] - health
 //   data[1] - energy
 //   data[2] - score
+//   data[3] - sequence number of the last applied 'InputCommand'
 // type == EntitySnapshot::ENTITY_TYPE_PROJECTILE:
 //    data[0] - projectile type
 // type == EntitySnapshot::ENTITY_TYPE_WALL:
@@ -138,19 +167,67 @@ struct EntitySnapshot {
     KIT_TYPE_MAX_VALUE
   };
 
-  static const size_t MAX_NAME_LENGTH = 16;
+  // Kinds take 10 bits in packed messages.
+  static const int MAX_KIND_COUNT = 1024;
 
   int64_t time;
   uint32_t id;
   float32_t x, y;
   float32_t angle;
 
-  // FIXME(xairy): use numerical id instead.
-  char name[MAX_NAME_LENGTH + 1];
+  // Index in the kind table sent at login, see 'EntityKindTable'.
+  uint32_t kind;
   EntityType type;
   int32_t data[4];
 };
 
+// The kinds of entities the server makes. The kinds in the snapshots are
+// indices in the table, so names are only sent once.
+struct EntityKindTable {
+  uint32_t kind_count;
+};
+
+struct EntityKind {
+  static const size_t MAX_NAME_LENGTH = 16;
+
+  EntitySnapshot::EntityType type;
+  char name[MAX_NAME_LENGTH + 1];
+  char sprite_name[MAX_NAME_LENGTH + 1];
+};
+
+// All the entities that follow 'WorldSnapshot' in the packet share its 'time'.
+// Entities are encoded as deltas against the world snapshot 'baseline'
+// that the client has acknowledged, entities unchanged since then are
+// omitted. The client rebuilds the full snapshot once all of its
+// 'fragment_count' packets are received.
+struct WorldSnapshot {
+  // Maximum size of a 'TYPE_WORLD_SNAPSHOT' packet. Keeps every packet
+  // within a single ENet fragment for the default MTU of 1400 bytes.
+  static const size_t MAX_PACKET_SIZE = 1200;
+
+  // Server time of the simulation step the snapshot was taken after.
+  int64_t time;
+  // Number of that simulation step.
+  uint32_t tick;
+
+  // Increased with every broadcast. All the packets of a split snapshot
+  // have the same sequence number.
+  uint32_t sequence;
+  // Sequence number of the baseline snapshot, 0 if there is none.
+  uint32_t baseline;
+
+  uint16_t fragment_index;
+  uint16_t fragment_count;
+
+  uint16_t removed_count;
+  uint16_t entity_count;
+};
+
+struct SnapshotAck {
+  // Sequence number of the last fully received world snapshot.
+  uint32_t sequence;
+};
+
 struct GameEvent {
   enum EventType {
     TYPE_EXPLOSION,
@@ -197,6 +274,33 @@ struct MouseEvent {
   float32_t x, y;
 };
 
+// The input of one client tick. Mouse moves within the tick are coalesced
+// into the latest aim position, the button presses and releases are kept.
+struct InputCommand {
+  static const size_t MAX_BUTTON_EVENTS = 8;
+
+  struct ButtonEvent {
+    MouseEvent::ButtonType button_type;
+    // Either 'EVENT_KEYDOWN' or 'EVENT_KEYUP'.
+    MouseEvent::EventType event_type;
+    // Mouse position at the time of the event.
+    float32_t x, y;
+  };
+
+  int64_t time;
+  // Increased with every command, stale commands are ignored.
+  uint32_t sequence;
+  // Bit '1 << KeyboardEvent::KeyType' is set for every held key.
+  uint32_t keys;
+  // The latest mouse position.
+  float32_t x, y;
+  // The other entities are shown this many ms in the past, the server
+  // rewinds them by as much for the lag compensation.
+  uint32_t interpolation_delay;
+  uint32_t button_event_count;
+  ButtonEvent button_events[MAX_BUTTON_EVENTS];
+};
+
 struct PlayerAction {
   enum ActionType {
     TYPE_ACTIVATE
@@ -206,6 +310,27 @@ struct PlayerAction {
   uint32_t target_id;
 };
 
+// Returns the channel the packets of type 'type' should be sent through.
+inline Channel GetPacketChannel(Packet::Type type) {
+  switch (type) {
+    case Packet::TYPE_WORLD_SNAPSHOT:
+    case Packet::TYPE_SNAPSHOT_ACK:
+      return CHANNEL_SNAPSHOTS;
+
+    case Packet::TYPE_PLAYER_INFO:
+    case Packet::TYPE_WORLD_UPDATE:
+    case Packet::TYPE_GAME_EVENT:
+    case Packet::TYPE_KEYBOARD_EVENT:
+    case Packet::TYPE_MOUSE_EVENT:
+    case Packet::TYPE_PLAYER_ACTION:
+    case Packet::TYPE_INPUT_COMMAND:
+      return CHANNEL_EVENTS;
+
+    default:
+      return CHANNEL_CONTROL;
+  }
+}
+
 }  // namespace bm
 
 #endif  // ENGINE_PROTOCOL_H_
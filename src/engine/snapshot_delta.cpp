@@ -0,0 +1,229 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "engine/snapshot_delta.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+#include "engine/protocol.h"
+#include "engine/wire_format.h"
+
+namespace bm {
+
+enum {
+  FIELD_X = 1 << 0,
+  FIELD_Y = 1 << 1,
+  FIELD_ANGLE = 1 << 2,
+  FIELD_KIND = 1 << 3,
+  FIELD_TYPE = 1 << 4,
+  // 'FIELD_DATA << i' stands for 'data[i]'.
+  FIELD_DATA = 1 << 5,
+
+  FIELD_COUNT = 9,
+  FIELD_ALL = (1 << FIELD_COUNT) - 1
+};
+
+static uint16_t GetChangedFields(const FieldWriter& writer,
+    const EntitySnapshot* baseline, const EntitySnapshot& snapshot) {
+  if (baseline == NULL) {
+    return FIELD_ALL;
+  }
+  uint16_t fields = 0;
+  if (writer.PositionsDiffer(baseline->x, snapshot.x)) {
+    fields |= FIELD_X;
+  }
+  if (writer.PositionsDiffer(baseline->y, snapshot.y)) {
+    fields |= FIELD_Y;
+  }
+  if (writer.AnglesDiffer(baseline->angle, snapshot.angle)) {
+    fields |= FIELD_ANGLE;
+  }
+  if (baseline->kind != snapshot.kind) {
+    fields |= FIELD_KIND;
+  }
+  if (baseline->type != snapshot.type) {
+    fields |= FIELD_TYPE;
+  }
+  for (int i = 0; i < 4; i++) {
+    if (baseline->data[i] != snapshot.data[i]) {
+      fields |= FIELD_DATA << i;
+    }
+  }
+  return fields;
+}
+
+static bool CompareIds(const EntitySnapshot& snapshot, uint32_t id) {
+  return snapshot.id < id;
+}
+
+static bool CompareSnapshots(const EntitySnapshot& a,
+    const EntitySnapshot& b) {
+  return a.id < b.id;
+}
+
+void SortEntitySnapshots(std::vector<EntitySnapshot>* snapshots) {
+  CHECK(snapshots != NULL);
+  std::sort(snapshots->begin(), snapshots->end(), CompareSnapshots);
+}
+
+const EntitySnapshot* FindEntitySnapshot(
+    const std::vector<EntitySnapshot>& snapshots, uint32_t id) {
+  std::vector<EntitySnapshot>::const_iterator itr =
+      std::lower_bound(snapshots.begin(), snapshots.end(), id, CompareIds);
+  if (itr == snapshots.end() || itr->id != id) {
+    return NULL;
+  }
+  return &*itr;
+}
+
+bool AppendEntityDelta(const EntitySnapshot* baseline,
+    const EntitySnapshot& snapshot, FieldWriter* writer) {
+  CHECK(writer != NULL);
+  CHECK(baseline == NULL || baseline->id == snapshot.id);
+
+  uint16_t fields = GetChangedFields(*writer, baseline, snapshot);
+  if (fields == 0) {
+    return false;
+  }
+
+  writer->WriteUInt32(snapshot.id, 32);
+  writer->WriteUInt32(fields, FIELD_COUNT);
+  if (fields & FIELD_X) {
+    writer->WritePosition(snapshot.x);
+  }
+  if (fields & FIELD_Y) {
+    writer->WritePosition(snapshot.y);
+  }
+  if (fields & FIELD_ANGLE) {
+    writer->WriteAngle(snapshot.angle);
+  }
+  if (fields & FIELD_KIND) {
+    writer->WriteEnum(snapshot.kind, EntitySnapshot::MAX_KIND_COUNT);
+  }
+  if (fields & FIELD_TYPE) {
+    writer->WriteEnum(snapshot.type, EntitySnapshot::ENTITY_TYPE_MAX_VALUE);
+  }
+  for (int i = 0; i < 4; i++) {
+    if (fields & (FIELD_DATA << i)) {
+      writer->WriteInt32(snapshot.data[i]);
+    }
+  }
+  return true;
+}
+
+bool ReadEntityDelta(FieldReader* reader,
+    const std::vector<EntitySnapshot>& baseline, EntitySnapshot* snapshot) {
+  CHECK(reader != NULL);
+  CHECK(snapshot != NULL);
+
+  uint32_t id;
+  uint32_t fields;
+  if (!reader->ReadUInt32(&id, 32) ||
+      !reader->ReadUInt32(&fields, FIELD_COUNT)) {
+    return false;
+  }
+  if ((fields & ~FIELD_ALL) != 0) {
+    return false;
+  }
+
+  const EntitySnapshot* base = FindEntitySnapshot(baseline, id);
+  if (base != NULL) {
+    *snapshot = *base;
+  } else if (fields != FIELD_ALL) {
+    return false;
+  }
+  snapshot->id = id;
+
+  if ((fields & FIELD_X) && !reader->ReadPosition(&snapshot->x)) {
+    return false;
+  }
+  if ((fields & FIELD_Y) && !reader->ReadPosition(&snapshot->y)) {
+    return false;
+  }
+  if ((fields & FIELD_ANGLE) && !reader->ReadAngle(&snapshot->angle)) {
+    return false;
+  }
+  if (fields & FIELD_KIND) {
+    int kind;
+    if (!reader->ReadEnum(&kind, EntitySnapshot::MAX_KIND_COUNT)) {
+      return false;
+    }
+    snapshot->kind = static_cast<uint32_t>(kind);
+  }
+  if (fields & FIELD_TYPE) {
+    int type;
+    if (!reader->ReadEnum(&type, EntitySnapshot::ENTITY_TYPE_MAX_VALUE)) {
+      return false;
+    }
+    snapshot->type = static_cast<EntitySnapshot::EntityType>(type);
+  }
+  for (int i = 0; i < 4; i++) {
+    if ((fields & (FIELD_DATA << i)) &&
+        !reader->ReadInt32(&snapshot->data[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void RebuildSnapshot(const std::vector<EntitySnapshot>& baseline,
+    const std::vector<uint32_t>& removed,
+    std::vector<EntitySnapshot>* changed,
+    std::vector<EntitySnapshot>* output) {
+  CHECK(changed != NULL);
+  CHECK(output != NULL);
+
+  SortEntitySnapshots(changed);
+
+  output->clear();
+  size_t next_changed = 0;
+  for (size_t i = 0; i < baseline.size(); i++) {
+    uint32_t id = baseline[i].id;
+    while (next_changed < changed->size() && (*changed)[next_changed].id < id) {
+      output->push_back((*changed)[next_changed++]);
+    }
+    if (next_changed < changed->size() && (*changed)[next_changed].id == id) {
+      output->push_back((*changed)[next_changed++]);
+      continue;
+    }
+    if (std::find(removed.begin(), removed.end(), id) == removed.end()) {
+      output->push_back(baseline[i]);
+    }
+  }
+  output->insert(output->end(), changed->begin() + next_changed,
+      changed->end());
+}
+
+SnapshotHistory::SnapshotHistory() {
+  Clear();
+}
+
+SnapshotHistory::~SnapshotHistory() { }
+
+const std::vector<EntitySnapshot>* SnapshotHistory::Get(
+    uint32_t sequence) const {
+  size_t index = sequence % SIZE;
+  if (sequence == 0 || sequences_[index] != sequence) {
+    return NULL;
+  }
+  return &entities_[index];
+}
+
+std::vector<EntitySnapshot>* SnapshotHistory::Put(uint32_t sequence) {
+  CHECK(sequence != 0);
+  size_t index = sequence % SIZE;
+  sequences_[index] = sequence;
+  return &entities_[index];
+}
+
+void SnapshotHistory::Clear() {
+  for (size_t i = 0; i < SIZE; i++) {
+    sequences_[i] = 0;
+    entities_[i].clear();
+  }
+}
+
+}  // namespace bm
@@ -0,0 +1,78 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef ENGINE_SNAPSHOT_DELTA_H_
+#define ENGINE_SNAPSHOT_DELTA_H_
+
+#include <vector>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+#include "engine/dll.h"
+#include "engine/protocol.h"
+#include "engine/wire_format.h"
+
+namespace bm {
+
+// Every entity in a delta is written as its id, a mask of the fields that
+// differ from the baseline snapshot of the same entity and the values of
+// these fields. 'time' is not written, it's shared by the whole world
+// snapshot. Entities absent from the baseline have all the fields written.
+
+// Returns the snapshot of the entity 'id' in 'snapshots' sorted by id
+// or 'NULL' if there is none.
+BM_ENGINE_DECL const EntitySnapshot* FindEntitySnapshot(
+    const std::vector<EntitySnapshot>& snapshots, uint32_t id);
+
+// Sorts 'snapshots' by id.
+BM_ENGINE_DECL void SortEntitySnapshots(std::vector<EntitySnapshot>* snapshots);
+
+// Writes 'snapshot' encoded against 'baseline' to 'writer'. 'baseline' may
+// be 'NULL', then all the fields are written. Returns 'false' and writes
+// nothing if 'snapshot' doesn't differ from 'baseline' on the wire.
+BM_ENGINE_DECL bool AppendEntityDelta(const EntitySnapshot* baseline,
+    const EntitySnapshot& snapshot, FieldWriter* writer);
+
+// Reads an entity delta from 'reader' and decodes it against 'baseline'
+// sorted by id. Returns 'false' when the format is incorrect.
+BM_ENGINE_DECL bool ReadEntityDelta(FieldReader* reader,
+    const std::vector<EntitySnapshot>& baseline, EntitySnapshot* snapshot);
+
+// Rebuilds the full snapshot in 'output' from 'baseline' sorted by id,
+// the ids of the 'removed' entities and the decoded 'changed' entities.
+// Sorts 'changed' by id. The result is sorted by id.
+BM_ENGINE_DECL void RebuildSnapshot(
+    const std::vector<EntitySnapshot>& baseline,
+    const std::vector<uint32_t>& removed,
+    std::vector<EntitySnapshot>* changed,
+    std::vector<EntitySnapshot>* output);
+
+// Keeps the entities of the last 'SIZE' world snapshots by sequence number.
+// Sequence number 0 is never stored and stands for "no baseline".
+class SnapshotHistory {
+ public:
+  static const size_t SIZE = 32;
+
+  BM_ENGINE_DECL SnapshotHistory();
+  BM_ENGINE_DECL ~SnapshotHistory();
+
+  // Returns 'NULL' if the snapshot 'sequence' isn't kept.
+  BM_ENGINE_DECL const std::vector<EntitySnapshot>* Get(
+      uint32_t sequence) const;
+
+  // Returns the storage for the snapshot 'sequence' in place
+  // of the one stored 'SIZE' sequence numbers ago.
+  BM_ENGINE_DECL std::vector<EntitySnapshot>* Put(uint32_t sequence);
+
+  BM_ENGINE_DECL void Clear();
+
+ private:
+  uint32_t sequences_[SIZE];
+  std::vector<EntitySnapshot> entities_[SIZE];
+
+  DISALLOW_COPY_AND_ASSIGN(SnapshotHistory);
+};
+
+}  // namespace bm
+
+#endif  // ENGINE_SNAPSHOT_DELTA_H_
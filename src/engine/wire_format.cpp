@@ -0,0 +1,464 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "engine/wire_format.h"
+
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <string>
+
+#include "base/bit_stream.h"
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+#include "engine/protocol.h"
+
+namespace bm {
+
+SCHECK(Packet::TYPE_MAX_VALUE <= 32);
+
+static const float32_t PI = 3.14159265358979f;
+
+// Returns the number of bits needed to store the values in [0, 'max'].
+static size_t GetBitWidth(uint32_t max) {
+  size_t width = 0;
+  while (width < 32 && (max >> width) != 0) {
+    width++;
+  }
+  return width;
+}
+
+static uint32_t GetPositionSteps(const WireFormat& format) {
+  float32_t steps = std::ceil(2 * format.bound / format.position_precision);
+  return static_cast<uint32_t>(std::min(std::max(steps, 1.0f), 4.0e9f));
+}
+
+static uint32_t QuantizePosition(const WireFormat& format, float32_t value) {
+  uint32_t steps = GetPositionSteps(format);
+  float32_t step = std::floor(
+      (value + format.bound) / format.position_precision + 0.5f);
+  step = std::min(std::max(step, 0.0f), static_cast<float32_t>(steps));
+  return static_cast<uint32_t>(step);
+}
+
+static uint32_t QuantizeAngle(float32_t value) {
+  const uint32_t steps = 1u << WireFormat::ANGLE_BITS;
+  float32_t turns = value / (2 * PI);
+  turns -= std::floor(turns);
+  return static_cast<uint32_t>(std::floor(turns * steps + 0.5f)) % steps;
+}
+
+WireFormat::WireFormat()
+    : packed_types(0), bound(0.0f), position_precision(1.0f) { }
+
+bool WireFormat::GetPackableType(const std::string& name,
+    Packet::Type* type) {
+  CHECK(type != NULL);
+  if (name == "world_snapshot") {
+    *type = Packet::TYPE_WORLD_SNAPSHOT;
+  } else if (name == "world_update") {
+    *type = Packet::TYPE_WORLD_UPDATE;
+  } else if (name == "keyboard_event") {
+    *type = Packet::TYPE_KEYBOARD_EVENT;
+  } else if (name == "mouse_event") {
+    *type = Packet::TYPE_MOUSE_EVENT;
+  } else if (name == "input_command") {
+    *type = Packet::TYPE_INPUT_COMMAND;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool WireFormat::IsPacked(Packet::Type type) const {
+  return (packed_types & (1u << type)) != 0;
+}
+
+void WireFormat::SetPacked(Packet::Type type, bool packed) {
+  if (packed) {
+    packed_types |= 1u << type;
+  } else {
+    packed_types &= ~(1u << type);
+  }
+}
+
+FieldWriter::FieldWriter(const WireFormat& format, bool packed,
+    BitWriter* writer) : format_(format), packed_(packed), writer_(writer) {
+  CHECK(writer != NULL);
+}
+FieldWriter::~FieldWriter() { }
+
+bool FieldWriter::IsPacked() const {
+  return packed_;
+}
+
+void FieldWriter::WriteUInt32(uint32_t value, size_t packed_bits) {
+  CHECK(packed_bits <= 32);
+  writer_->Write(value, packed_ ? packed_bits : 32);
+}
+
+void FieldWriter::WriteInt32(int32_t value) {
+  if (!packed_) {
+    writer_->Write(static_cast<uint32_t>(value), 32);
+    return;
+  }
+  // Zigzag encoding makes small negative values small, then they are
+  // written in 7-bit groups, each one preceded by a continuation bit.
+  uint32_t zigzag = (static_cast<uint32_t>(value) << 1) ^
+      static_cast<uint32_t>(value >> 31);
+  do {
+    writer_->Write(zigzag >= 0x80, 1);
+    writer_->Write(zigzag & 0x7f, 7);
+    zigzag >>= 7;
+  } while (zigzag != 0);
+}
+
+void FieldWriter::WriteEnum(int value, int value_count) {
+  CHECK(value >= 0 && value < value_count);
+  WriteUInt32(static_cast<uint32_t>(value), GetBitWidth(value_count - 1));
+}
+
+void FieldWriter::WritePosition(float32_t value) {
+  if (!packed_) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    writer_->Write(bits, 32);
+    return;
+  }
+  writer_->Write(QuantizePosition(format_, value),
+      GetBitWidth(GetPositionSteps(format_)));
+}
+
+void FieldWriter::WriteAngle(float32_t value) {
+  if (!packed_) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    writer_->Write(bits, 32);
+    return;
+  }
+  writer_->Write(QuantizeAngle(value), WireFormat::ANGLE_BITS);
+}
+
+void FieldWriter::WriteTime(int64_t value) {
+  writer_->Write(static_cast<uint64_t>(value), packed_ ? 32 : 64);
+}
+
+void FieldWriter::WriteString(const char* value, size_t max_length) {
+  CHECK(value != NULL);
+  size_t length = strnlen(value, max_length);
+  if (!packed_) {
+    for (size_t i = 0; i <= max_length; i++) {
+      writer_->Write(static_cast<uint8_t>(i < length ? value[i] : '\0'), 8);
+    }
+    return;
+  }
+  writer_->Write(length, GetBitWidth(max_length));
+  for (size_t i = 0; i < length; i++) {
+    writer_->Write(static_cast<uint8_t>(value[i]), 8);
+  }
+}
+
+bool FieldWriter::PositionsDiffer(float32_t a, float32_t b) const {
+  if (!packed_) {
+    return memcmp(&a, &b, sizeof(a)) != 0;
+  }
+  return QuantizePosition(format_, a) != QuantizePosition(format_, b);
+}
+
+bool FieldWriter::AnglesDiffer(float32_t a, float32_t b) const {
+  if (!packed_) {
+    return memcmp(&a, &b, sizeof(a)) != 0;
+  }
+  return QuantizeAngle(a) != QuantizeAngle(b);
+}
+
+FieldReader::FieldReader(const WireFormat& format, bool packed,
+    int64_t reference_time, BitReader* reader)
+    : format_(format), packed_(packed), reference_time_(reference_time),
+      reader_(reader) {
+  CHECK(reader != NULL);
+}
+FieldReader::~FieldReader() { }
+
+bool FieldReader::ReadUInt32(uint32_t* value, size_t packed_bits) {
+  CHECK(value != NULL);
+  CHECK(packed_bits <= 32);
+  uint64_t bits;
+  if (!reader_->Read(&bits, packed_ ? packed_bits : 32)) {
+    return false;
+  }
+  *value = static_cast<uint32_t>(bits);
+  return true;
+}
+
+bool FieldReader::ReadInt32(int32_t* value) {
+  CHECK(value != NULL);
+  uint64_t bits;
+  if (!packed_) {
+    if (!reader_->Read(&bits, 32)) {
+      return false;
+    }
+    *value = static_cast<int32_t>(static_cast<uint32_t>(bits));
+    return true;
+  }
+  uint32_t zigzag = 0;
+  for (size_t shift = 0; ; shift += 7) {
+    uint64_t more;
+    if (shift >= 32 || !reader_->Read(&more, 1) || !reader_->Read(&bits, 7)) {
+      return false;
+    }
+    zigzag |= static_cast<uint32_t>(bits) << shift;
+    if (more == 0) {
+      break;
+    }
+  }
+  *value = static_cast<int32_t>((zigzag >> 1) ^ (0u - (zigzag & 1)));
+  return true;
+}
+
+bool FieldReader::ReadEnum(int* value, int value_count) {
+  CHECK(value != NULL);
+  uint32_t bits;
+  if (!ReadUInt32(&bits, GetBitWidth(value_count - 1))) {
+    return false;
+  }
+  if (bits >= static_cast<uint32_t>(value_count)) {
+    return false;
+  }
+  *value = static_cast<int>(bits);
+  return true;
+}
+
+bool FieldReader::ReadPosition(float32_t* value) {
+  CHECK(value != NULL);
+  uint64_t bits;
+  if (!packed_) {
+    if (!reader_->Read(&bits, 32)) {
+      return false;
+    }
+    uint32_t raw = static_cast<uint32_t>(bits);
+    memcpy(value, &raw, sizeof(*value));
+    return true;
+  }
+  uint32_t steps = GetPositionSteps(format_);
+  if (!reader_->Read(&bits, GetBitWidth(steps)) || bits > steps) {
+    return false;
+  }
+  *value = static_cast<float32_t>(bits) * format_.position_precision -
+      format_.bound;
+  return true;
+}
+
+bool FieldReader::ReadAngle(float32_t* value) {
+  CHECK(value != NULL);
+  uint64_t bits;
+  if (!packed_) {
+    if (!reader_->Read(&bits, 32)) {
+      return false;
+    }
+    uint32_t raw = static_cast<uint32_t>(bits);
+    memcpy(value, &raw, sizeof(*value));
+    return true;
+  }
+  if (!reader_->Read(&bits, WireFormat::ANGLE_BITS)) {
+    return false;
+  }
+  *value = static_cast<float32_t>(bits) * 2 * PI /
+      (1u << WireFormat::ANGLE_BITS);
+  return true;
+}
+
+bool FieldReader::ReadTime(int64_t* value) {
+  CHECK(value != NULL);
+  uint64_t bits;
+  if (!reader_->Read(&bits, packed_ ? 32 : 64)) {
+    return false;
+  }
+  if (!packed_) {
+    *value = static_cast<int64_t>(bits);
+    return true;
+  }
+  uint32_t delta = static_cast<uint32_t>(bits) -
+      static_cast<uint32_t>(reference_time_);
+  *value = reference_time_ + static_cast<int32_t>(delta);
+  return true;
+}
+
+bool FieldReader::ReadString(char* value, size_t max_length) {
+  CHECK(value != NULL);
+  uint64_t bits;
+  size_t length = max_length + 1;
+  if (packed_) {
+    if (!reader_->Read(&bits, GetBitWidth(max_length)) || bits > max_length) {
+      return false;
+    }
+    length = static_cast<size_t>(bits);
+  }
+  for (size_t i = 0; i < length; i++) {
+    if (!reader_->Read(&bits, 8)) {
+      return false;
+    }
+    value[i] = static_cast<char>(bits);
+  }
+  std::fill(value + std::min(length, max_length), value + max_length + 1,
+      '\0');
+  return true;
+}
+
+void WriteWorldSnapshot(const WireFormat& format, Packet::Type type,
+    const WorldSnapshot& snapshot, BitWriter* writer) {
+  FieldWriter fields(format, format.IsPacked(type), writer);
+  fields.WriteTime(snapshot.time);
+  fields.WriteUInt32(snapshot.tick, 32);
+  fields.WriteUInt32(snapshot.sequence, 32);
+  fields.WriteUInt32(snapshot.baseline, 32);
+  writer->Write(snapshot.fragment_index, 16);
+  writer->Write(snapshot.fragment_count, 16);
+  writer->Write(snapshot.removed_count, 16);
+  writer->Write(snapshot.entity_count, 16);
+}
+
+bool ReadWorldSnapshot(const WireFormat& format, Packet::Type type,
+    int64_t reference_time, BitReader* reader, WorldSnapshot* snapshot) {
+  CHECK(snapshot != NULL);
+  FieldReader fields(format, format.IsPacked(type), reference_time, reader);
+  uint64_t counts[4];
+  if (!fields.ReadTime(&snapshot->time) ||
+      !fields.ReadUInt32(&snapshot->tick, 32) ||
+      !fields.ReadUInt32(&snapshot->sequence, 32) ||
+      !fields.ReadUInt32(&snapshot->baseline, 32)) {
+    return false;
+  }
+  for (size_t i = 0; i < 4; i++) {
+    if (!reader->Read(&counts[i], 16)) {
+      return false;
+    }
+  }
+  snapshot->fragment_index = static_cast<uint16_t>(counts[0]);
+  snapshot->fragment_count = static_cast<uint16_t>(counts[1]);
+  snapshot->removed_count = static_cast<uint16_t>(counts[2]);
+  snapshot->entity_count = static_cast<uint16_t>(counts[3]);
+  return true;
+}
+
+void WriteKeyboardEvent(const WireFormat& format, const KeyboardEvent& event,
+    BitWriter* writer) {
+  FieldWriter fields(format, format.IsPacked(Packet::TYPE_KEYBOARD_EVENT),
+      writer);
+  fields.WriteTime(event.time);
+  fields.WriteEnum(event.key_type, KeyboardEvent::KEY_LEFT + 1);
+  fields.WriteEnum(event.event_type, KeyboardEvent::EVENT_KEYUP + 1);
+}
+
+bool ReadKeyboardEvent(const WireFormat& format, int64_t reference_time,
+    BitReader* reader, KeyboardEvent* event) {
+  CHECK(event != NULL);
+  FieldReader fields(format, format.IsPacked(Packet::TYPE_KEYBOARD_EVENT),
+      reference_time, reader);
+  int key_type, event_type;
+  if (!fields.ReadTime(&event->time) ||
+      !fields.ReadEnum(&key_type, KeyboardEvent::KEY_LEFT + 1) ||
+      !fields.ReadEnum(&event_type, KeyboardEvent::EVENT_KEYUP + 1)) {
+    return false;
+  }
+  event->key_type = static_cast<KeyboardEvent::KeyType>(key_type);
+  event->event_type = static_cast<KeyboardEvent::EventType>(event_type);
+  return true;
+}
+
+void WriteMouseEvent(const WireFormat& format, const MouseEvent& event,
+    BitWriter* writer) {
+  FieldWriter fields(format, format.IsPacked(Packet::TYPE_MOUSE_EVENT),
+      writer);
+  fields.WriteTime(event.time);
+  fields.WriteEnum(event.event_type, MouseEvent::EVENT_MOVE + 1);
+  fields.WriteEnum(event.button_type, MouseEvent::BUTTON_RIGHT + 1);
+  fields.WritePosition(event.x);
+  fields.WritePosition(event.y);
+}
+
+bool ReadMouseEvent(const WireFormat& format, int64_t reference_time,
+    BitReader* reader, MouseEvent* event) {
+  CHECK(event != NULL);
+  FieldReader fields(format, format.IsPacked(Packet::TYPE_MOUSE_EVENT),
+      reference_time, reader);
+  int event_type, button_type;
+  if (!fields.ReadTime(&event->time) ||
+      !fields.ReadEnum(&event_type, MouseEvent::EVENT_MOVE + 1) ||
+      !fields.ReadEnum(&button_type, MouseEvent::BUTTON_RIGHT + 1) ||
+      !fields.ReadPosition(&event->x) ||
+      !fields.ReadPosition(&event->y)) {
+    return false;
+  }
+  event->event_type = static_cast<MouseEvent::EventType>(event_type);
+  event->button_type = static_cast<MouseEvent::ButtonType>(button_type);
+  return true;
+}
+
+static const size_t INPUT_KEY_BITS = KeyboardEvent::KEY_LEFT + 1;
+static const size_t INTERPOLATION_DELAY_BITS = 16;
+static const uint32_t MAX_INTERPOLATION_DELAY =
+    (1u << INTERPOLATION_DELAY_BITS) - 1;
+
+void WriteInputCommand(const WireFormat& format, const InputCommand& command,
+    BitWriter* writer) {
+  CHECK(command.button_event_count <= InputCommand::MAX_BUTTON_EVENTS);
+  FieldWriter fields(format, format.IsPacked(Packet::TYPE_INPUT_COMMAND),
+      writer);
+  fields.WriteTime(command.time);
+  fields.WriteUInt32(command.sequence, 32);
+  fields.WriteUInt32(command.keys, INPUT_KEY_BITS);
+  fields.WritePosition(command.x);
+  fields.WritePosition(command.y);
+  fields.WriteUInt32(command.interpolation_delay < MAX_INTERPOLATION_DELAY ?
+      command.interpolation_delay : MAX_INTERPOLATION_DELAY,
+      INTERPOLATION_DELAY_BITS);
+  fields.WriteUInt32(command.button_event_count,
+      GetBitWidth(InputCommand::MAX_BUTTON_EVENTS));
+  for (size_t i = 0; i < command.button_event_count; i++) {
+    const InputCommand::ButtonEvent& event = command.button_events[i];
+    fields.WriteEnum(event.button_type, MouseEvent::BUTTON_RIGHT + 1);
+    fields.WriteEnum(event.event_type, MouseEvent::EVENT_KEYUP + 1);
+    fields.WritePosition(event.x);
+    fields.WritePosition(event.y);
+  }
+}
+
+bool ReadInputCommand(const WireFormat& format, int64_t reference_time,
+    BitReader* reader, InputCommand* command) {
+  CHECK(command != NULL);
+  FieldReader fields(format, format.IsPacked(Packet::TYPE_INPUT_COMMAND),
+      reference_time, reader);
+  if (!fields.ReadTime(&command->time) ||
+      !fields.ReadUInt32(&command->sequence, 32) ||
+      !fields.ReadUInt32(&command->keys, INPUT_KEY_BITS) ||
+      !fields.ReadPosition(&command->x) ||
+      !fields.ReadPosition(&command->y) ||
+      !fields.ReadUInt32(&command->interpolation_delay,
+          INTERPOLATION_DELAY_BITS) ||
+      !fields.ReadUInt32(&command->button_event_count,
+          GetBitWidth(InputCommand::MAX_BUTTON_EVENTS))) {
+    return false;
+  }
+  if (command->keys >= (1u << INPUT_KEY_BITS) ||
+      command->interpolation_delay > MAX_INTERPOLATION_DELAY ||
+      command->button_event_count > InputCommand::MAX_BUTTON_EVENTS) {
+    return false;
+  }
+  for (size_t i = 0; i < command->button_event_count; i++) {
+    InputCommand::ButtonEvent* event = &command->button_events[i];
+    int button_type, event_type;
+    if (!fields.ReadEnum(&button_type, MouseEvent::BUTTON_RIGHT + 1) ||
+        !fields.ReadEnum(&event_type, MouseEvent::EVENT_KEYUP + 1) ||
+        !fields.ReadPosition(&event->x) ||
+        !fields.ReadPosition(&event->y)) {
+      return false;
+    }
+    event->button_type = static_cast<MouseEvent::ButtonType>(button_type);
+    event->event_type = static_cast<MouseEvent::EventType>(event_type);
+  }
+  return true;
+}
+
+}  // namespace bm
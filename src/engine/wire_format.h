@@ -0,0 +1,123 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef ENGINE_WIRE_FORMAT_H_
+#define ENGINE_WIRE_FORMAT_H_
+
+#include <string>
+
+#include "base/bit_stream.h"
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+#include "engine/dll.h"
+#include "engine/protocol.h"
+
+namespace bm {
+
+// Every message type that supports it is sent either raw, where all the
+// fields have their full width and the layout matches the protocol structs,
+// or packed. In packed messages positions are quantized within
+// [-bound, bound] with 'position_precision' steps, angles take 'ANGLE_BITS'
+// bits, enums take their minimum width, integers are variable-length and
+// times are sent as their lowest 32 bits.
+struct WireFormat {
+  static const size_t ANGLE_BITS = 12;
+
+  BM_ENGINE_DECL WireFormat();
+
+  // Returns 'false' if 'name' doesn't name a message type
+  // that can be packed.
+  BM_ENGINE_DECL static bool GetPackableType(const std::string& name,
+      Packet::Type* type);
+
+  BM_ENGINE_DECL bool IsPacked(Packet::Type type) const;
+  BM_ENGINE_DECL void SetPacked(Packet::Type type, bool packed);
+
+  // Bitmask of the packed 'Packet::Type's.
+  uint32_t packed_types;
+
+  float32_t bound;
+  float32_t position_precision;
+};
+
+class FieldWriter {
+ public:
+  BM_ENGINE_DECL FieldWriter(const WireFormat& format, bool packed,
+      BitWriter* writer);
+  BM_ENGINE_DECL ~FieldWriter();
+
+  BM_ENGINE_DECL bool IsPacked() const;
+
+  BM_ENGINE_DECL void WriteUInt32(uint32_t value, size_t packed_bits);
+  BM_ENGINE_DECL void WriteInt32(int32_t value);
+  // 'value' is in [0, 'value_count').
+  BM_ENGINE_DECL void WriteEnum(int value, int value_count);
+  BM_ENGINE_DECL void WritePosition(float32_t value);
+  BM_ENGINE_DECL void WriteAngle(float32_t value);
+  BM_ENGINE_DECL void WriteTime(int64_t value);
+  // 'value' is a zero-terminated string of at most 'max_length' characters
+  // stored in an array of 'max_length + 1' characters.
+  BM_ENGINE_DECL void WriteString(const char* value, size_t max_length);
+
+  // Return 'true' if 'a' and 'b' are written differently.
+  BM_ENGINE_DECL bool PositionsDiffer(float32_t a, float32_t b) const;
+  BM_ENGINE_DECL bool AnglesDiffer(float32_t a, float32_t b) const;
+
+ private:
+  const WireFormat& format_;
+  bool packed_;
+  BitWriter* writer_;
+
+  DISALLOW_COPY_AND_ASSIGN(FieldWriter);
+};
+
+// All the methods return 'false' when the format is incorrect.
+class FieldReader {
+ public:
+  // Packed times are restored as the ones closest to 'reference_time'.
+  BM_ENGINE_DECL FieldReader(const WireFormat& format, bool packed,
+      int64_t reference_time, BitReader* reader);
+  BM_ENGINE_DECL ~FieldReader();
+
+  BM_ENGINE_DECL bool ReadUInt32(uint32_t* value, size_t packed_bits);
+  BM_ENGINE_DECL bool ReadInt32(int32_t* value);
+  BM_ENGINE_DECL bool ReadEnum(int* value, int value_count);
+  BM_ENGINE_DECL bool ReadPosition(float32_t* value);
+  BM_ENGINE_DECL bool ReadAngle(float32_t* value);
+  BM_ENGINE_DECL bool ReadTime(int64_t* value);
+  BM_ENGINE_DECL bool ReadString(char* value, size_t max_length);
+
+ private:
+  const WireFormat& format_;
+  bool packed_;
+  int64_t reference_time_;
+  BitReader* reader_;
+
+  DISALLOW_COPY_AND_ASSIGN(FieldReader);
+};
+
+// 'type' is either 'TYPE_WORLD_SNAPSHOT' or 'TYPE_WORLD_UPDATE'.
+BM_ENGINE_DECL void WriteWorldSnapshot(const WireFormat& format,
+    Packet::Type type, const WorldSnapshot& snapshot, BitWriter* writer);
+BM_ENGINE_DECL bool ReadWorldSnapshot(const WireFormat& format,
+    Packet::Type type, int64_t reference_time, BitReader* reader,
+    WorldSnapshot* snapshot);
+
+BM_ENGINE_DECL void WriteKeyboardEvent(const WireFormat& format,
+    const KeyboardEvent& event, BitWriter* writer);
+BM_ENGINE_DECL bool ReadKeyboardEvent(const WireFormat& format,
+    int64_t reference_time, BitReader* reader, KeyboardEvent* event);
+
+BM_ENGINE_DECL void WriteMouseEvent(const WireFormat& format,
+    const MouseEvent& event, BitWriter* writer);
+BM_ENGINE_DECL bool ReadMouseEvent(const WireFormat& format,
+    int64_t reference_time, BitReader* reader, MouseEvent* event);
+
+BM_ENGINE_DECL void WriteInputCommand(const WireFormat& format,
+    const InputCommand& command, BitWriter* writer);
+BM_ENGINE_DECL bool ReadInputCommand(const WireFormat& format,
+    int64_t reference_time, BitReader* reader, InputCommand* command);
+
+}  // namespace bm
+
+#endif  // ENGINE_WIRE_FORMAT_H_
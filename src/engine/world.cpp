@@ -2,16 +2,18 @@
 
 #include "engine/world.h"
 
-#include <map>
-
 #include <Box2D/Box2D.h>
 
 #include "base/id_manager.h"
 #include "base/pstdint.h"
+#include "base/slot_map.h"
+
+#include "engine/body.h"
 
 namespace bm {
 
-World::World() : world_(b2Vec2(0.0f, 0.0f)) { }
+World::World()
+    : world_(b2Vec2(0.0f, 0.0f)), body_pool_(&world_, MAX_PARKED_BODIES) { }
 
 World::~World() {
   for (auto i : static_entities_) {
@@ -27,42 +29,48 @@ b2World* World::GetBox2DWorld() {
 }
 
 Entity* World::GetEntity(uint32_t id) {
-  if (static_entities_.count(id) == 1) {
-    return static_entities_[id];
-  } else if (dynamic_entities_.count(id) == 1) {
-    return dynamic_entities_[id];
+  Entity** entity = static_entities_.Find(id);
+  if (entity == NULL) {
+    entity = dynamic_entities_.Find(id);
+  }
+  return (entity != NULL) ? *entity : NULL;
+}
+
+Entity* World::GetEntityByIndex(uint32_t id) {
+  EntityMap::Item* item = static_entities_.FindByIndex(id);
+  if (item == NULL) {
+    item = dynamic_entities_.FindByIndex(id);
   }
-  return NULL;
+  return (item != NULL) ? item->second : NULL;
+}
+
+BodyPool* World::GetBodyPool() {
+  return &body_pool_;
 }
 
-std::map<uint32_t, Entity*>* World::GetStaticEntities() {
+EntityMap* World::GetStaticEntities() {
   return &static_entities_;
 }
 
-std::map<uint32_t, Entity*>* World::GetDynamicEntities() {
+EntityMap* World::GetDynamicEntities() {
   return &dynamic_entities_;
 }
 
 void World::AddEntity(uint32_t id, Entity* entity) {
-  CHECK(static_entities_.count(id) == 0 && dynamic_entities_.count(id) == 0);
+  CHECK(!static_entities_.Contains(id) && !dynamic_entities_.Contains(id));
   if (entity->IsStatic()) {
-    static_entities_[id] = entity;
+    static_entities_.Insert(id, entity);
   } else {
-    dynamic_entities_[id] = entity;
+    dynamic_entities_.Insert(id, entity);
   }
 }
 
 void World::RemoveEntity(uint32_t id) {
-  CHECK(static_entities_.count(id) + dynamic_entities_.count(id) == 1);
-  Entity* entity = NULL;
-  if (static_entities_.count(id) == 1) {
-    entity = static_entities_[id];
-    static_entities_.erase(id);
-  } else if (dynamic_entities_.count(id) == 1) {
-    entity = dynamic_entities_[id];
-    dynamic_entities_.erase(id);
+  if (static_entities_.Contains(id)) {
+    static_entities_.Erase(id);
+  } else {
+    dynamic_entities_.Erase(id);
   }
-  CHECK(entity != NULL);
 }
 
 }  // namespace bm
@@ -3,38 +3,51 @@
 #ifndef ENGINE_WORLD_H_
 #define ENGINE_WORLD_H_
 
-#include <map>
-
 #include <Box2D/Box2D.h>
 
 #include "base/id_manager.h"
 #include "base/pstdint.h"
+#include "base/slot_map.h"
 
+#include "engine/body.h"
 #include "engine/dll.h"
 #include "engine/entity.h"
 
 namespace bm {
 
+// Entities by id, see 'SlotMap' for the iteration order.
+typedef SlotMap<Entity*> EntityMap;
+
 class World {
  public:
   BM_ENGINE_DECL explicit World();
   BM_ENGINE_DECL virtual ~World();
 
   BM_ENGINE_DECL b2World* GetBox2DWorld();
+  // Entities may park their bodies here to be reused by the next ones.
+  BM_ENGINE_DECL BodyPool* GetBodyPool();
 
   BM_ENGINE_DECL Entity* GetEntity(uint32_t id);
-  BM_ENGINE_DECL std::map<uint32_t, Entity*>* GetStaticEntities();
-  BM_ENGINE_DECL std::map<uint32_t, Entity*>* GetDynamicEntities();
+  // Returns the entity with the id index of 'id' of any generation.
+  BM_ENGINE_DECL Entity* GetEntityByIndex(uint32_t id);
+  BM_ENGINE_DECL EntityMap* GetStaticEntities();
+  BM_ENGINE_DECL EntityMap* GetDynamicEntities();
 
-  // 'RemoveEntity()' doesn't delete the entity object.
-  BM_ENGINE_DECL void AddEntity(uint32_t id, Entity* entity);
-  BM_ENGINE_DECL void RemoveEntity(uint32_t id);
+  // 'RemoveEntity()' doesn't delete the entity object. Overridden to keep
+  // other indices of the entities in sync.
+  BM_ENGINE_DECL virtual void AddEntity(uint32_t id, Entity* entity);
+  BM_ENGINE_DECL virtual void RemoveEntity(uint32_t id);
 
  private:
+  // Parked bodies are still walked by every step of 'world_'.
+  static const size_t MAX_PARKED_BODIES = 256;
+
   b2World world_;
+  // Declared after 'world_', so it's destroyed while the world exists.
+  BodyPool body_pool_;
 
-  std::map<uint32_t, Entity*> static_entities_;
-  std::map<uint32_t, Entity*> dynamic_entities_;
+  EntityMap static_entities_;
+  EntityMap dynamic_entities_;
 };
 
 }  // namespace bm
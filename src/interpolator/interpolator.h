@@ -3,10 +3,11 @@
 #ifndef INTERPOLATOR_INTERPOLATOR_H_
 #define INTERPOLATOR_INTERPOLATOR_H_
 
+#include <cmath>
 #include <cstddef>
 
-#include <list>
-#include <utility>
+#include <algorithm>
+#include <vector>
 
 namespace interpolator {
 
@@ -14,21 +15,48 @@ template<class V> V lerp(const V& a, const V& b, double bRatio) {
   return V(a * (1 - bRatio) + b * bRatio);
 }
 
-template<class FrameT, class TimeT>
+// Interpolates angles in radians along the shorter arc, so going from
+// just below pi to just above -pi doesn't make a full turn.
+inline double lerpAngle(double a, double b, double bRatio) {
+  const double pi = 3.14159265358979323846;
+  double delta = std::fmod(b - a, 2 * pi);
+  if (delta > pi) {
+    delta -= 2 * pi;
+  } else if (delta < -pi) {
+    delta += 2 * pi;
+  }
+  return a + delta * bRatio;
+}
+
+// Frames are combined with 'Traits::lerp()'. The ratio is outside of
+// [0, 1] when extrapolating.
+template<class FrameT>
+struct LinearTraits {
+  static FrameT lerp(const FrameT& a, const FrameT& b, double bRatio) {
+    return interpolator::lerp(a, b, bRatio);
+  }
+};
+
+// Keeps the last 'frameCount' frames, up to 'Capacity', in an inline ring
+// buffer, so pushing frames never allocates.
+template<class FrameT, class TimeT, size_t Capacity = 8,
+         class Traits = LinearTraits<FrameT> >
 class LinearInterpolator {
  public:
-  typedef std::pair<FrameT, TimeT> TimedFrame;
-
-  LinearInterpolator(TimeT timeOffset, size_t frameCount = 2)
-    : timeOffset(timeOffset), frameCount(frameCount) { }
+  LinearInterpolator(TimeT timeOffset = TimeT(),
+                     size_t frameCount = Capacity,
+                     TimeT maxExtrapolation = TimeT())
+    : first(0), size(0), frameCount(std::min(frameCount, Capacity)),
+      timeOffset(timeOffset), maxExtrapolation(maxExtrapolation) { }
 
   size_t GetFrameCount() const {
     return frameCount;
   }
   void SetFrameCount(size_t count) {
-    frameCount = count;
-    while (frames.size() > frameCount) {
-      frames.pop_front();
+    frameCount = std::min(count, Capacity);
+    while (size > frameCount) {
+      first = (first + 1) % Capacity;
+      size--;
     }
   }
 
@@ -39,54 +67,156 @@ class LinearInterpolator {
     timeOffset = value;
   }
 
+  // How far past the last frame the motion between the last two frames
+  // is continued when the next frame is late. The frame is held after.
+  TimeT GetMaxExtrapolation() const {
+    return maxExtrapolation;
+  }
+  void SetMaxExtrapolation(TimeT value) {
+    maxExtrapolation = value;
+  }
+
   void Push(const FrameT& frame, TimeT time) {
     // drop frame if it is too late / time is the same
-    if (frames.size() > 0) {
-      if (time <= frames.back().second) {
-        return;
-      }
+    if (size > 0 && time <= at(size - 1).time) {
+      return;
     }
 
-    // add frame to the frame list, dropping previous if neccessary
-    if (frames.size() == frameCount) {
-      frames.pop_front();
+    // add frame to the ring, dropping the oldest if neccessary
+    if (frameCount == 0) {
+      return;
+    }
+    if (size == frameCount) {
+      first = (first + 1) % Capacity;
+      size--;
     }
-    frames.push_back(TimedFrame(frame, time));
+    TimedFrame& slot = frames[(first + size) % Capacity];
+    slot.frame = frame;
+    slot.time = time;
+    size++;
   }
 
   void Clear() {
-    frames.clear();
+    first = 0;
+    size = 0;
   }
 
-  FrameT Interpolate(TimeT time) {
+  FrameT Interpolate(TimeT time) const {
     // if we don't have enough frames to interpolate - return default value
-    if (frames.size() == 0) {
+    if (size == 0) {
       return FrameT();
-    } else if (frames.size() == 1) {
-      return frames.back().first;
+    } else if (size == 1) {
+      return at(0).frame;
     }
 
     // subtract lag time (i.e. the difference in times on server and client)
     time = time - timeOffset;
 
-    // get the last two frames
-    typename std::list<TimedFrame>::reverse_iterator it = frames.rbegin();
-    TimedFrame frame2 = *it;
-    TimedFrame frame1 = *(++it);
+    if (time <= at(0).time) {
+      return at(0).frame;
+    }
+
+    // find the pair of frames around the time, the last two frames are
+    // extrapolated over if it's past the last one
+    size_t second = size - 1;
+    if (time < at(second).time) {
+      while (at(second - 1).time > time) {
+        second--;
+      }
+    } else {
+      time = std::min(time, at(second).time + maxExtrapolation);
+    }
+    const TimedFrame& frame1 = at(second - 1);
+    const TimedFrame& frame2 = at(second);
 
     double t = static_cast<double>(time);
-    double f1t = static_cast<double>(frame1.second);
-    double f2t = static_cast<double>(frame2.second);
+    double f1t = static_cast<double>(frame1.time);
+    double f2t = static_cast<double>(frame2.time);
     double ratio = (t - f1t) / (f2t - f1t);
 
-    // interpolate over them
-    return lerp(frame1.first, frame2.first, ratio);
+    return Traits::lerp(frame1.frame, frame2.frame, ratio);
   }
 
  private:
+  struct TimedFrame {
+    FrameT frame;
+    TimeT time;
+  };
+
+  // 'i'-th frame from the oldest one.
+  const TimedFrame& at(size_t i) const {
+    return frames[(first + i) % Capacity];
+  }
+
+  TimedFrame frames[Capacity];
+  size_t first;
+  size_t size;
   size_t frameCount;
-  std::list<TimedFrame> frames;
   TimeT timeOffset;
+  TimeT maxExtrapolation;
+};
+
+// Keeps the interpolators of many objects side by side and evaluates all
+// of them in one pass. The indices returned by 'Add()' stay valid until
+// 'Remove()' and are reused after it.
+template<class FrameT, class TimeT, size_t Capacity = 8,
+         class Traits = LinearTraits<FrameT> >
+class InterpolatorArray {
+ public:
+  typedef LinearInterpolator<FrameT, TimeT, Capacity, Traits> Interpolator;
+
+  size_t Add(const Interpolator& value) {
+    size_t index;
+    if (!freeIndices.empty()) {
+      index = freeIndices.back();
+      freeIndices.pop_back();
+      interpolators[index] = value;
+    } else {
+      index = interpolators.size();
+      interpolators.push_back(value);
+      results.push_back(FrameT());
+      used.push_back(false);
+    }
+    used[index] = true;
+    results[index] = value.Interpolate(TimeT());
+    return index;
+  }
+
+  void Remove(size_t index) {
+    used[index] = false;
+    interpolators[index].Clear();
+    freeIndices.push_back(index);
+  }
+
+  void Clear() {
+    interpolators.clear();
+    results.clear();
+    used.clear();
+    freeIndices.clear();
+  }
+
+  Interpolator& Get(size_t index) {
+    return interpolators[index];
+  }
+
+  // Returns the frame computed by the last 'InterpolateAll()'.
+  const FrameT& GetFrame(size_t index) const {
+    return results[index];
+  }
+
+  void InterpolateAll(TimeT time) {
+    for (size_t i = 0; i < interpolators.size(); i++) {
+      if (used[i]) {
+        results[i] = interpolators[i].Interpolate(time);
+      }
+    }
+  }
+
+ private:
+  std::vector<Interpolator> interpolators;
+  std::vector<FrameT> results;
+  std::vector<char> used;
+  std::vector<size_t> freeIndices;
 };
 
 }  // namespace interpolator
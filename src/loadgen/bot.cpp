@@ -0,0 +1,394 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "loadgen/bot.h"
+
+#include <cstdio>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/bit_stream.h"
+#include "base/error.h"
+#include "base/macros.h"
+#include "base/pstdint.h"
+#include "base/utils.h"
+
+#include "net/enet.h"
+#include "net/utils.h"
+
+#include "engine/protocol.h"
+#include "engine/wire_format.h"
+
+namespace bm {
+
+// Bots that haven't completed the handshake in time are disconnected.
+static const int64_t HANDSHAKE_TIMEOUT = 5000;
+static const int64_t RECONNECT_DELAY = 1000;
+
+// Input commands are sent with the rate of the real client, whose aim
+// changes every tick while its player moves.
+static const int64_t INPUT_PERIOD = 33;
+static const int64_t MIN_TURN_PERIOD = 500;
+static const int64_t MAX_TURN_PERIOD = 3000;
+static const int64_t FIRE_PERIOD = 1000;
+static const float32_t TARGET_SPREAD = 300.0f;
+
+Bot::Stats::Stats() : bytes_received(0), packets_received(0),
+  snapshots_received(0), latency_total(0), latency_max(0), disconnects(0) { }
+
+Bot::Bot(const std::string& name, Script script)
+  : name_(name), script_(script), server_port_(0), host_(NULL),
+    event_(NULL), peer_(NULL), state_(STATE_DISCONNECTED), state_time_(0),
+    time_correction_(0), pending_sequence_(0), pending_fragments_(0),
+    acked_sequence_(0), key_pressed_(false),
+    pressed_key_(KeyboardEvent::KEY_UP), next_turn_(0), next_fire_(0),
+    next_input_(0), input_sequence_(0), target_x_(0.0f), target_y_(0.0f),
+    button_event_count_(0) {
+  CHECK(name.size() <= LoginData::MAX_LOGIN_LENGTH);
+}
+
+Bot::~Bot() {
+  Finalize();
+}
+
+bool Bot::Initialize(Enet* enet, const std::string& host, uint16_t port) {
+  CHECK(enet != NULL);
+  CHECK(host_ == NULL);
+
+  std::auto_ptr<ClientHost> client(enet->CreateClientHost(CHANNEL_COUNT));
+  if (client.get() == NULL) {
+    return false;
+  }
+
+  std::auto_ptr<Event> event(enet->CreateEvent());
+  if (event.get() == NULL) {
+    return false;
+  }
+
+  host_ = client.release();
+  event_ = event.release();
+  server_host_ = host;
+  server_port_ = port;
+  return true;
+}
+
+void Bot::Finalize() {
+  if (event_ != NULL) {
+    delete event_;
+    event_ = NULL;
+  }
+  if (host_ != NULL) {
+    delete host_;
+    host_ = NULL;
+  }
+  peer_ = NULL;
+  state_ = STATE_DISCONNECTED;
+}
+
+bool Bot::Tick(int64_t time) {
+  CHECK(host_ != NULL);
+
+  if (state_ == STATE_DISCONNECTED) {
+    if (time - state_time_ < RECONNECT_DELAY) {
+      return true;
+    }
+    if (!Connect(time)) {
+      return false;
+    }
+  }
+
+  do {
+    if (!host_->Service(event_, 0)) {
+      return false;
+    }
+
+    switch (event_->GetType()) {
+      case Event::TYPE_CONNECT: {
+        LoginData login_data;
+        std::copy(name_.begin(), name_.end(), &login_data.login[0]);
+        login_data.login[name_.size()] = '\0';
+        // The server spreads the bots over the rooms.
+        login_data.room[0] = '\0';
+        if (!SendPacket(peer_, Packet::TYPE_LOGIN, login_data)) {
+          return false;
+        }
+        state_ = STATE_LOGGING_IN;
+        state_time_ = time;
+      } break;
+
+      case Event::TYPE_RECEIVE: {
+        PacketView packet = event_->GetDataView();
+        stats_.bytes_received += packet.size;
+        stats_.packets_received++;
+        if (!OnPacket(time, packet)) {
+          return false;
+        }
+      } break;
+
+      case Event::TYPE_DISCONNECT: {
+        OnDisconnect(time);
+        return true;
+      } break;
+
+      case Event::TYPE_NONE:
+        break;
+    }
+  } while (event_->GetType() != Event::TYPE_NONE);
+
+  if (state_ != STATE_PLAYING && state_ != STATE_DISCONNECTED &&
+      time - state_time_ > HANDSHAKE_TIMEOUT) {
+    printf("%s: handshake timed out.\n", name_.c_str());
+    peer_->DisconnectNow();
+    OnDisconnect(time);
+    return true;
+  }
+
+  if (state_ == STATE_PLAYING) {
+    if (!RunScript(time)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool Bot::IsPlaying() const {
+  return state_ == STATE_PLAYING;
+}
+
+const std::string& Bot::GetName() const {
+  return name_;
+}
+
+const Bot::Stats& Bot::GetStats() const {
+  return stats_;
+}
+
+bool Bot::Connect(int64_t time) {
+  CHECK(state_ == STATE_DISCONNECTED);
+  peer_ = host_->Connect(server_host_, server_port_, CHANNEL_COUNT);
+  if (peer_ == NULL) {
+    return false;
+  }
+  state_ = STATE_CONNECTING;
+  state_time_ = time;
+  pending_sequence_ = 0;
+  pending_fragments_ = 0;
+  acked_sequence_ = 0;
+  key_pressed_ = false;
+  input_sequence_ = 0;
+  button_event_count_ = 0;
+  return true;
+}
+
+void Bot::OnDisconnect(int64_t time) {
+  // A bot that failed to connect wasn't disconnected by the server.
+  if (state_ != STATE_CONNECTING) {
+    stats_.disconnects++;
+  }
+  peer_ = NULL;
+  state_ = STATE_DISCONNECTED;
+  state_time_ = time;
+}
+
+bool Bot::OnPacket(int64_t time, const PacketView& packet) {
+  Packet::Type type;
+  if (!ExtractPacketType(packet, &type)) {
+    REPORT_ERROR("%s: incorrect packet format.", name_.c_str());
+    return false;
+  }
+
+  switch (type) {
+    case Packet::TYPE_CLIENT_OPTIONS:
+      return OnClientOptions(time, packet);
+
+    case Packet::TYPE_SYNC_TIME_RESPONSE:
+      return OnSyncTimeResponse(time, packet);
+
+    case Packet::TYPE_WORLD_SNAPSHOT:
+      return OnWorldSnapshot(time, packet);
+
+    default:
+      return true;
+  }
+}
+
+bool Bot::OnClientOptions(int64_t time, const PacketView& packet) {
+  if (state_ != STATE_LOGGING_IN) {
+    return true;
+  }
+
+  bool rv = ExtractPacketData<Packet::Type, ClientOptions>(
+      packet, &client_options_);
+  if (rv == false) {
+    REPORT_ERROR("%s: incorrect client options packet format.",
+        name_.c_str());
+    return false;
+  }
+
+  wire_format_.packed_types = client_options_.packed_types;
+  wire_format_.bound = client_options_.bound;
+  wire_format_.position_precision = client_options_.position_precision;
+
+  TimeSyncData request_data;
+  request_data.client_time = time;
+  if (!SendPacket(peer_, Packet::TYPE_SYNC_TIME_REQUEST, request_data)) {
+    return false;
+  }
+
+  state_ = STATE_SYNCHRONIZING;
+  state_time_ = time;
+  return true;
+}
+
+bool Bot::OnSyncTimeResponse(int64_t time, const PacketView& packet) {
+  if (state_ != STATE_SYNCHRONIZING) {
+    return true;
+  }
+
+  TimeSyncData response_data;
+  bool rv = ExtractPacketData<Packet::Type, TimeSyncData>(
+      packet, &response_data);
+  if (rv == false) {
+    REPORT_ERROR("%s: incorrect time sync packet format.", name_.c_str());
+    return false;
+  }
+
+  int64_t latency = (time - response_data.client_time) / 2;
+  time_correction_ = response_data.server_time + latency - time;
+
+  ClientStatus client_status;
+  client_status.status = ClientStatus::STATUS_SYNCHRONIZED;
+  if (!SendPacket(peer_, Packet::TYPE_CLIENT_STATUS, client_status)) {
+    return false;
+  }
+
+  state_ = STATE_PLAYING;
+  state_time_ = time;
+  next_turn_ = time;
+  next_fire_ = time + static_cast<int64_t>(Random(FIRE_PERIOD));
+  next_input_ = time;
+  PickTarget();
+  return true;
+}
+
+bool Bot::OnWorldSnapshot(int64_t time, const PacketView& packet) {
+  if (state_ != STATE_PLAYING) {
+    return true;
+  }
+
+  int64_t server_time = time + time_correction_;
+  BitReader reader(packet.data, packet.size, sizeof(Packet::Type));
+  WorldSnapshot world_snapshot;
+  bool rv = ReadWorldSnapshot(wire_format_, Packet::TYPE_WORLD_SNAPSHOT,
+      server_time, &reader, &world_snapshot);
+  if (rv == false || world_snapshot.fragment_index >=
+      world_snapshot.fragment_count) {
+    REPORT_ERROR("%s: incorrect world snapshot packet format.",
+        name_.c_str());
+    return false;
+  }
+
+  if (world_snapshot.fragment_index == 0) {
+    int64_t latency = server_time - world_snapshot.time;
+    stats_.snapshots_received++;
+    stats_.latency_total += latency;
+    stats_.latency_max = std::max(stats_.latency_max, latency);
+
+    pending_sequence_ = world_snapshot.sequence;
+    pending_fragments_ = 0;
+  }
+  if (world_snapshot.sequence != pending_sequence_ ||
+      world_snapshot.fragment_index != pending_fragments_) {
+    return true;
+  }
+  pending_fragments_++;
+  if (pending_fragments_ < world_snapshot.fragment_count) {
+    return true;
+  }
+
+  // The content isn't applied, but acknowledging complete snapshots
+  // makes the server encode deltas as it does for the real clients.
+  if (acked_sequence_ != 0 && static_cast<int32_t>(
+      world_snapshot.sequence - acked_sequence_) <= 0) {
+    return true;
+  }
+  acked_sequence_ = world_snapshot.sequence;
+  SnapshotAck ack;
+  ack.sequence = world_snapshot.sequence;
+  return SendPacket(peer_, Packet::TYPE_SNAPSHOT_ACK, ack);
+}
+
+bool Bot::RunScript(int64_t time) {
+  if (time >= next_turn_) {
+    pressed_key_ = static_cast<KeyboardEvent::KeyType>(
+        Random(KeyboardEvent::KEY_LEFT + 1));
+    key_pressed_ = true;
+    next_turn_ = time + MIN_TURN_PERIOD +
+        static_cast<int64_t>(Random(MAX_TURN_PERIOD - MIN_TURN_PERIOD));
+  }
+
+  if (script_ != SCRIPT_WALK && time >= next_fire_) {
+    MouseEvent::ButtonType button = (script_ == SCRIPT_ROCKETS) ?
+        MouseEvent::BUTTON_LEFT : MouseEvent::BUTTON_RIGHT;
+    PickTarget();
+    AddButtonEvent(button, MouseEvent::EVENT_KEYDOWN);
+    AddButtonEvent(button, MouseEvent::EVENT_KEYUP);
+    next_fire_ = time + FIRE_PERIOD;
+  }
+
+  if (time >= next_input_) {
+    if (!SendInputCommand(time)) {
+      return false;
+    }
+    next_input_ = time + INPUT_PERIOD;
+  }
+
+  return true;
+}
+
+void Bot::AddButtonEvent(MouseEvent::ButtonType button_type,
+    MouseEvent::EventType event_type) {
+  // Fires much less often than the commands are sent.
+  CHECK(button_event_count_ < InputCommand::MAX_BUTTON_EVENTS);
+  InputCommand::ButtonEvent* event = &button_events_[button_event_count_];
+  event->button_type = button_type;
+  event->event_type = event_type;
+  event->x = target_x_;
+  event->y = target_y_;
+  button_event_count_++;
+}
+
+bool Bot::SendInputCommand(int64_t time) {
+  InputCommand command;
+  command.time = time + time_correction_;
+  command.sequence = ++input_sequence_;
+  command.keys = key_pressed_ ? (1u << pressed_key_) : 0;
+  command.x = target_x_;
+  command.y = target_y_;
+  // Snapshots aren't shown, the entities are seen where they are.
+  command.interpolation_delay = 0;
+  command.button_event_count = static_cast<uint32_t>(button_event_count_);
+  for (size_t i = 0; i < button_event_count_; i++) {
+    command.button_events[i] = button_events_[i];
+  }
+  button_event_count_ = 0;
+
+  BitWriter writer;
+  WriteInputCommand(wire_format_, command, &writer);
+  std::vector<char> buffer;
+  AppendPacketToBuffer(buffer, Packet::TYPE_INPUT_COMMAND, writer);
+  return SendBuffer(peer_, Packet::TYPE_INPUT_COMMAND, buffer);
+}
+
+void Bot::PickTarget() {
+  // Snapshots aren't applied, so the current position is unknown.
+  float32_t dx = static_cast<float32_t>(Random(1000)) / 1000.0f;
+  float32_t dy = static_cast<float32_t>(Random(1000)) / 1000.0f;
+  target_x_ = client_options_.x + (2 * dx - 1) * TARGET_SPREAD;
+  target_y_ = client_options_.y + (2 * dy - 1) * TARGET_SPREAD;
+}
+
+}  // namespace bm
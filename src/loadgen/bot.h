@@ -0,0 +1,128 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef LOADGEN_BOT_H_
+#define LOADGEN_BOT_H_
+
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+#include "net/enet.h"
+#include "net/event.h"
+
+#include "engine/protocol.h"
+#include "engine/wire_format.h"
+
+namespace bm {
+
+// A headless client that performs the same handshake as the real one,
+// acknowledges world snapshots without applying them and sends scripted
+// input. Reconnects after being disconnected.
+class Bot {
+ public:
+  enum Script {
+    // Walks in a random direction changed every few seconds.
+    SCRIPT_WALK,
+    // Walks and fires rockets.
+    SCRIPT_ROCKETS,
+    // Walks and fires slime.
+    SCRIPT_SLIME
+  };
+
+  struct Stats {
+    Stats();
+
+    int64_t bytes_received;
+    int64_t packets_received;
+
+    // Snapshot latency is the server time at which the first packet of
+    // a snapshot was received minus the time the snapshot was taken.
+    int64_t snapshots_received;
+    int64_t latency_total;
+    int64_t latency_max;
+
+    int64_t disconnects;
+  };
+
+  Bot(const std::string& name, Script script);
+  ~Bot();
+
+  bool Initialize(Enet* enet, const std::string& host, uint16_t port);
+  void Finalize();
+
+  // Handles all the pending network events and sends the scripted input.
+  // Never blocks. 'time' is the current 'Timestamp()'.
+  bool Tick(int64_t time);
+
+  bool IsPlaying() const;
+  const std::string& GetName() const;
+  const Stats& GetStats() const;
+
+ private:
+  bool Connect(int64_t time);
+  void OnDisconnect(int64_t time);
+
+  bool OnPacket(int64_t time, const PacketView& packet);
+  bool OnClientOptions(int64_t time, const PacketView& packet);
+  bool OnSyncTimeResponse(int64_t time, const PacketView& packet);
+  bool OnWorldSnapshot(int64_t time, const PacketView& packet);
+
+  bool RunScript(int64_t time);
+  // Queues a button event for the next input command.
+  void AddButtonEvent(MouseEvent::ButtonType button_type,
+      MouseEvent::EventType event_type);
+  bool SendInputCommand(int64_t time);
+
+  // Aims at a random point around the spawn position of the bot.
+  void PickTarget();
+
+  std::string name_;
+  Script script_;
+
+  std::string server_host_;
+  uint16_t server_port_;
+
+  ClientHost* host_;
+  Event* event_;
+  Peer* peer_;
+
+  enum {
+    STATE_DISCONNECTED,
+    STATE_CONNECTING,
+    STATE_LOGGING_IN,
+    STATE_SYNCHRONIZING,
+    STATE_PLAYING
+  } state_;
+  // When the current state was entered.
+  int64_t state_time_;
+
+  ClientOptions client_options_;
+  WireFormat wire_format_;
+  int64_t time_correction_;
+
+  // The snapshot being received and its fragments received so far.
+  uint32_t pending_sequence_;
+  uint16_t pending_fragments_;
+  uint32_t acked_sequence_;
+
+  bool key_pressed_;
+  KeyboardEvent::KeyType pressed_key_;
+  int64_t next_turn_;
+  int64_t next_fire_;
+  int64_t next_input_;
+  uint32_t input_sequence_;
+  float32_t target_x_;
+  float32_t target_y_;
+  InputCommand::ButtonEvent button_events_[InputCommand::MAX_BUTTON_EVENTS];
+  size_t button_event_count_;
+
+  Stats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(Bot);
+};
+
+}  // namespace bm
+
+#endif  // LOADGEN_BOT_H_
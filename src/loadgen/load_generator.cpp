@@ -0,0 +1,145 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "loadgen/load_generator.h"
+
+#include <cstdio>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/error.h"
+#include "base/macros.h"
+#include "base/pstdint.h"
+#include "base/time.h"
+#include "base/utils.h"
+
+#include "net/enet.h"
+
+#include "loadgen/bot.h"
+
+namespace bm {
+
+// Bots are serviced without blocking, so the loop sleeps between passes.
+static const int64_t TICK_SLEEP = 1;
+
+static void AddStats(const Bot::Stats& stats, Bot::Stats* total) {
+  total->bytes_received += stats.bytes_received;
+  total->packets_received += stats.packets_received;
+  total->snapshots_received += stats.snapshots_received;
+  total->latency_total += stats.latency_total;
+  total->latency_max = std::max(total->latency_max, stats.latency_max);
+  total->disconnects += stats.disconnects;
+}
+
+LoadGenerator::LoadGenerator() : start_time_(0), last_report_(0),
+  state_(STATE_FINALIZED) { }
+
+LoadGenerator::~LoadGenerator() {
+  if (state_ == STATE_INITIALIZED) {
+    Finalize();
+  }
+  for (size_t i = 0; i < bots_.size(); i++) {
+    delete bots_[i];
+  }
+}
+
+bool LoadGenerator::Initialize(const std::string& host, uint16_t port,
+    size_t bot_count, const std::vector<Bot::Script>& scripts) {
+  CHECK(state_ == STATE_FINALIZED);
+  CHECK(!scripts.empty());
+
+  if (!enet_.Initialize()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < bot_count; i++) {
+    Bot* bot = new Bot("bot" + IntToStr(static_cast<int>(i)),
+        scripts[i % scripts.size()]);
+    CHECK(bot != NULL);
+    bots_.push_back(bot);
+    if (!bot->Initialize(&enet_, host, port)) {
+      return false;
+    }
+  }
+
+  start_time_ = Timestamp();
+  last_report_ = start_time_;
+  last_totals_ = Bot::Stats();
+
+  state_ = STATE_INITIALIZED;
+  return true;
+}
+
+void LoadGenerator::Finalize() {
+  for (size_t i = 0; i < bots_.size(); i++) {
+    delete bots_[i];
+  }
+  bots_.clear();
+  enet_.Finalize();
+  state_ = STATE_FINALIZED;
+}
+
+bool LoadGenerator::Tick() {
+  CHECK(state_ == STATE_INITIALIZED);
+
+  int64_t time = Timestamp();
+  for (size_t i = 0; i < bots_.size(); i++) {
+    if (!bots_[i]->Tick(time)) {
+      return false;
+    }
+  }
+
+  if (time - last_report_ >= REPORT_PERIOD) {
+    PrintReport(time);
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(TICK_SLEEP));
+  return true;
+}
+
+void LoadGenerator::PrintBotStats() const {
+  int64_t seconds = std::max((Timestamp() - start_time_) / 1000,
+      static_cast<int64_t>(1));
+  printf("%-8s %12s %10s %14s %14s %12s\n", "bot", "bytes/s", "snapshots",
+      "avg latency", "max latency", "disconnects");
+  for (size_t i = 0; i < bots_.size(); i++) {
+    const Bot::Stats& stats = bots_[i]->GetStats();
+    int64_t average_latency = (stats.snapshots_received > 0) ?
+        stats.latency_total / stats.snapshots_received : 0;
+    printf("%-8s %12ld %10ld %11ld ms %11ld ms %12ld\n",
+        bots_[i]->GetName().c_str(), stats.bytes_received / seconds,
+        stats.snapshots_received, average_latency, stats.latency_max,
+        stats.disconnects);
+  }
+}
+
+void LoadGenerator::PrintReport(int64_t time) {
+  Bot::Stats totals;
+  size_t playing = 0;
+  for (size_t i = 0; i < bots_.size(); i++) {
+    AddStats(bots_[i]->GetStats(), &totals);
+    if (bots_[i]->IsPlaying()) {
+      playing++;
+    }
+  }
+
+  int64_t period = time - last_report_;
+  int64_t bytes = totals.bytes_received - last_totals_.bytes_received;
+  int64_t snapshots =
+      totals.snapshots_received - last_totals_.snapshots_received;
+  int64_t latency = totals.latency_total - last_totals_.latency_total;
+  printf("%lu/%lu bots playing, %ld bytes/s per bot, "
+      "snapshot latency %ld ms on average, %ld disconnects.\n",
+      playing, bots_.size(),
+      (playing > 0) ? bytes * 1000 / period / playing : 0,
+      (snapshots > 0) ? latency / snapshots : 0,
+      totals.disconnects - last_totals_.disconnects);
+
+  last_totals_ = totals;
+  last_report_ = time;
+}
+
+}  // namespace bm
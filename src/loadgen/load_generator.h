@@ -0,0 +1,59 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef LOADGEN_LOAD_GENERATOR_H_
+#define LOADGEN_LOAD_GENERATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+#include "net/enet.h"
+
+#include "loadgen/bot.h"
+
+namespace bm {
+
+// Runs a number of bots connected to a single server in one process and
+// periodically reports the totals over all of them.
+class LoadGenerator {
+ public:
+  LoadGenerator();
+  ~LoadGenerator();
+
+  // 'scripts' are assigned to the bots in turn.
+  bool Initialize(const std::string& host, uint16_t port, size_t bot_count,
+      const std::vector<Bot::Script>& scripts);
+  void Finalize();
+
+  bool Tick();
+
+  // Prints the stats of every bot since the start.
+  void PrintBotStats() const;
+
+ private:
+  void PrintReport(int64_t time);
+
+  // How often the totals are printed, in milliseconds.
+  static const int64_t REPORT_PERIOD = 5000;
+
+  Enet enet_;
+  std::vector<Bot*> bots_;
+
+  int64_t start_time_;
+  int64_t last_report_;
+  // Totals over all the bots at the time of the last report.
+  Bot::Stats last_totals_;
+
+  enum {
+    STATE_FINALIZED,
+    STATE_INITIALIZED
+  } state_;
+
+  DISALLOW_COPY_AND_ASSIGN(LoadGenerator);
+};
+
+}  // namespace bm
+
+#endif  // LOADGEN_LOAD_GENERATOR_H_
@@ -0,0 +1,83 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "base/ctrlc.h"
+#include "base/error.h"
+#include "base/pstdint.h"
+
+#include "loadgen/bot.h"
+#include "loadgen/load_generator.h"
+
+// Set by the Ctrl+C handler, which may run on another thread.
+static std::atomic<bool> stop_flag(false);
+
+static void CtrlCHandler() {
+  stop_flag.store(true);
+}
+
+static void PrintUsage(const char* program) {
+  printf("Usage: %s [bot_count] [host] [port] [script]\n", program);
+  printf("Scripts: walk, rockets, slime, mixed (default).\n");
+}
+
+static bool ParseScript(const std::string& name,
+    std::vector<bm::Bot::Script>* scripts) {
+  if (name == "walk") {
+    scripts->push_back(bm::Bot::SCRIPT_WALK);
+  } else if (name == "rockets") {
+    scripts->push_back(bm::Bot::SCRIPT_ROCKETS);
+  } else if (name == "slime") {
+    scripts->push_back(bm::Bot::SCRIPT_SLIME);
+  } else if (name == "mixed") {
+    scripts->push_back(bm::Bot::SCRIPT_WALK);
+    scripts->push_back(bm::Bot::SCRIPT_ROCKETS);
+    scripts->push_back(bm::Bot::SCRIPT_SLIME);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int bot_count = (argc > 1) ? atoi(argv[1]) : 100;
+  std::string host = (argc > 2) ? argv[2] : "127.0.0.1";
+  int port = (argc > 3) ? atoi(argv[3]) : 4242;
+  std::vector<bm::Bot::Script> scripts;
+  if (argc > 5 || bot_count <= 0 || port <= 0 || port > 65535 ||
+      !ParseScript((argc > 4) ? argv[4] : "mixed", &scripts)) {
+    PrintUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  SetCtrlCHandler(&CtrlCHandler);
+
+  bm::LoadGenerator generator;
+  if (!generator.Initialize(host, static_cast<uint16_t>(port),
+      static_cast<size_t>(bot_count), scripts)) {
+    bm::Error::Print();
+    return EXIT_FAILURE;
+  }
+
+  printf("Started %d bots against %s:%d.\n", bot_count, host.c_str(), port);
+
+  while (!stop_flag.load()) {
+    if (!generator.Tick()) {
+      if (errno == EINTR) {
+        break;
+      }
+      bm::Error::Print();
+      return EXIT_FAILURE;
+    }
+  }
+
+  generator.PrintBotStats();
+
+  return EXIT_SUCCESS;
+}
@@ -44,6 +44,13 @@ void Event::GetData(std::vector<char>* output) const {
     _event->packet->dataLength);
 }
 
+PacketView Event::GetDataView() const {
+  CHECK(_event->type == ENET_EVENT_TYPE_RECEIVE);
+  CHECK(_is_packet_destroyed == false);
+  return PacketView(reinterpret_cast<const char*>(_event->packet->data),
+      _event->packet->dataLength);
+}
+
 Peer* Event::GetPeer() {
   CHECK(_event->type != ENET_EVENT_TYPE_NONE);
   CHECK(_host != NULL);
@@ -19,6 +19,17 @@ class Enet;
 class Host;
 class Peer;
 
+// Non-owning view of the data of a received packet or of a buffer.
+struct PacketView {
+  PacketView() : data(NULL), size(0) { }
+  PacketView(const char* data, size_t size) : data(data), size(size) { }
+  explicit PacketView(const std::vector<char>& buffer)
+      : data(buffer.empty() ? NULL : &buffer[0]), size(buffer.size()) { }
+
+  const char* data;
+  size_t size;
+};
+
 // 'Event' class represents an event that can be delivered by
 // 'ClientHost::Service()' and 'ServerHost::Service()' methods.
 // You can create an empty 'Event' by using 'Enet::CreateEvent()'.
@@ -62,6 +73,12 @@ class Event {
   // Event type should be 'TYPE_RECEIVE' to use this method.
   BM_NET_DECL void GetData(std::vector<char>* output) const;
 
+  // Returns the data associated with the event without copying it. The
+  // data is borrowed from the packet and stays valid until another event
+  // is delivered using this instance of 'Event' class.
+  // Event type should be 'TYPE_RECEIVE' to use this method.
+  BM_NET_DECL PacketView GetDataView() const;
+
   // Returns 'Peer', which caused the event. Returned 'Peer' will be
   // deallocated automatically.
   // Event type should not be 'TYPE_NONE' to use this method.
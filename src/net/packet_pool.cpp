@@ -0,0 +1,60 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "net/packet_pool.h"
+
+#include <vector>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+#include "base/spsc_queue.h"
+
+namespace bm {
+
+PacketPool::PacketPool(size_t capacity)
+    : released_(capacity), acquisition_count_(0), allocation_count_(0) { }
+
+PacketPool::~PacketPool() {
+  PacketBuffer** buffer;
+  while ((buffer = released_.Front()) != NULL) {
+    delete *buffer;
+    released_.Pop();
+  }
+}
+
+PacketBuffer* PacketPool::Acquire() {
+  acquisition_count_++;
+  PacketBuffer** released = released_.Front();
+  if (released != NULL) {
+    PacketBuffer* buffer = *released;
+    released_.Pop();
+    buffer->data.clear();
+    return buffer;
+  }
+  allocation_count_++;
+  PacketBuffer* buffer = new PacketBuffer();
+  CHECK(buffer != NULL);
+  buffer->pool = this;
+  return buffer;
+}
+
+void PacketPool::Release(PacketBuffer* buffer) {
+  CHECK(buffer != NULL);
+  CHECK(buffer->pool == this);
+  PacketBuffer** slot = released_.Reserve();
+  if (slot == NULL) {
+    delete buffer;
+    return;
+  }
+  *slot = buffer;
+  released_.Push();
+}
+
+uint64_t PacketPool::GetAcquisitionCount() const {
+  return acquisition_count_;
+}
+
+uint64_t PacketPool::GetAllocationCount() const {
+  return allocation_count_;
+}
+
+}  // namespace bm
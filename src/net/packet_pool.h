@@ -0,0 +1,58 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef NET_PACKET_POOL_H_
+#define NET_PACKET_POOL_H_
+
+#include <vector>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+#include "base/spsc_queue.h"
+
+#include "net/dll.h"
+
+namespace bm {
+
+class PacketPool;
+
+// Outbound packet data that is handed to ENet without copying.
+struct PacketBuffer {
+  std::vector<char> data;
+  PacketPool* pool;
+};
+
+// Recycles the buffers of sent packets. A buffer given to 'Peer::Send()'
+// becomes the data of an ENet packet and returns to its pool from the
+// packet's free callback once ENet has sent it, so in the steady state
+// packets are serialized into buffers that already have the capacity.
+// Buffers are acquired by one thread and released by one thread, which
+// may be the same, and the pool should outlive the host that sends them.
+class PacketPool {
+ public:
+  // At most 'capacity' released buffers are kept, the rest are freed.
+  BM_NET_DECL explicit PacketPool(size_t capacity);
+  BM_NET_DECL ~PacketPool();
+
+  // Returns an empty buffer.
+  BM_NET_DECL PacketBuffer* Acquire();
+  // Buffers are released by ENet and should only be released directly
+  // if they haven't been sent.
+  BM_NET_DECL void Release(PacketBuffer* buffer);
+
+  // Both counters are only updated by 'Acquire()' and should be read on
+  // the same thread. Every acquisition that couldn't reuse a released
+  // buffer is an allocation.
+  BM_NET_DECL uint64_t GetAcquisitionCount() const;
+  BM_NET_DECL uint64_t GetAllocationCount() const;
+
+ private:
+  SpscQueue<PacketBuffer*> released_;
+  uint64_t acquisition_count_;
+  uint64_t allocation_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(PacketPool);
+};
+
+}  // namespace bm
+
+#endif  // NET_PACKET_POOL_H_
@@ -9,6 +9,8 @@
 #include "base/macros.h"
 #include "base/pstdint.h"
 
+#include "net/packet_pool.h"
+
 namespace bm {
 
 bool Peer::Send(
@@ -34,6 +36,37 @@ bool Peer::Send(
   return true;
 }
 
+static void ENET_CALLBACK ReleasePacketBuffer(ENetPacket* packet) {
+  PacketBuffer* buffer = static_cast<PacketBuffer*>(packet->userData);
+  buffer->pool->Release(buffer);
+}
+
+bool Peer::Send(
+  PacketBuffer* buffer,
+  bool reliable,
+  uint8_t channel_id
+) {
+  CHECK(buffer != NULL);
+  CHECK(!buffer->data.empty());
+  enet_uint32 flags = ENET_PACKET_FLAG_NO_ALLOCATE;
+  if (reliable) {
+    flags = flags | ENET_PACKET_FLAG_RELIABLE;
+  }
+  ENetPacket* packet = enet_packet_create(&buffer->data[0],
+      buffer->data.size(), flags);
+  if (packet == NULL) {
+    buffer->pool->Release(buffer);
+    return false;
+  }
+  packet->userData = buffer;
+  packet->freeCallback = ReleasePacketBuffer;
+  if (enet_peer_send(_peer, channel_id, packet) != 0) {
+    enet_packet_destroy(packet);
+    return false;
+  }
+  return true;
+}
+
 std::string Peer::GetIp() const {
   const size_t BUFFER_SIZE = 32;
   char buffer[BUFFER_SIZE];
@@ -48,6 +81,10 @@ uint16_t Peer::GetPort() const {
   return _peer->address.port;  // XXX: type cast.
 }
 
+uint32_t Peer::GetRoundTripTime() const {
+  return _peer->roundTripTime;
+}
+
 void Peer::Disconnect() {
   enet_peer_disconnect(_peer, 0);
 }
@@ -16,6 +16,7 @@ namespace bm {
 
 class Enet;
 class ClientHost;
+struct PacketBuffer;
 
 // 'Peer' represents a remote transmission point which data packets
 // may be sent or received from.
@@ -36,6 +37,15 @@ class Peer {
     bool reliable = true,
     uint8_t channel_id = 0);
 
+  // Queues a packet that is sent straight from 'buffer' without copying.
+  // The packet takes ownership of 'buffer' and releases it to its pool
+  // once ENet is done with it, which also happens on error.
+  // Returns 'true' on success, returns 'false' on error.
+  BM_NET_DECL bool Send(
+    PacketBuffer* buffer,
+    bool reliable = true,
+    uint8_t channel_id = 0);
+
   // Returns the ip of the remote peer.
   // An empty string will be returned in case of an error.
   BM_NET_DECL std::string GetIp() const;
@@ -43,6 +53,10 @@ class Peer {
   // Returns the port of the remote peer.
   BM_NET_DECL uint16_t GetPort() const;
 
+  // Returns the mean round trip time to the remote peer in ms,
+  // measured by ENet from the acknowledgements of reliable packets.
+  BM_NET_DECL uint32_t GetRoundTripTime() const;
+
   // Request a disconnection from a peer.
   // An 'Event::TYPE_DISCONNECT' event will be generated by
   // 'ServerHost::Service()' or 'ClientHost::Service()' once
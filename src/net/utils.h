@@ -7,37 +7,84 @@
 
 #include <cstring>
 
+#include "base/bit_stream.h"
 #include "base/error.h"
 #include "base/macros.h"
 #include "base/pstdint.h"
 
 #include "net/dll.h"
 #include "net/enet.h"
+#include "net/event.h"
+#include "net/packet_pool.h"
 
 namespace bm {
 
 // Returns 'false' when packet format is incorrect.
 template<class PacketType>
-bool ExtractPacketType(const std::vector<char>& buffer, PacketType* type) {
+bool ExtractPacketType(const PacketView& packet, PacketType* type) {
   CHECK(type != NULL);
-  if (buffer.size() < sizeof(*type)) {
+  if (packet.size < sizeof(*type)) {
     return false;
   }
-  memcpy(type, &buffer[0], sizeof(*type));
+  memcpy(type, packet.data, sizeof(*type));
   return true;
 }
 
+template<class PacketType>
+bool ExtractPacketType(const std::vector<char>& buffer, PacketType* type) {
+  return ExtractPacketType(PacketView(buffer), type);
+}
+
 // Returns 'false' when message format is incorrect.
+template<class PacketType, class DataType>
+bool ExtractPacketData(const PacketView& packet, DataType* data) {
+  CHECK(data != NULL);
+  if (packet.size != sizeof(PacketType) + sizeof(DataType)) {
+    return false;
+  }
+  memcpy(data, packet.data + sizeof(PacketType), sizeof(DataType));
+  return true;
+}
+
 template<class PacketType, class DataType>
 bool ExtractPacketData(const std::vector<char>& buffer, DataType* data) {
+  return ExtractPacketData<PacketType, DataType>(PacketView(buffer), data);
+}
+
+// Returns 'false' when message format is incorrect.
+// Extracts 'data' and the array of 'items' that follows it.
+template<class PacketType, class DataType, class ItemType>
+bool ExtractPacketData(
+  const PacketView& packet,
+  DataType* data,
+  std::vector<ItemType>* items
+) {
   CHECK(data != NULL);
-  if (buffer.size() != sizeof(PacketType) + sizeof(DataType)) {
+  CHECK(items != NULL);
+  size_t header_size = sizeof(PacketType) + sizeof(DataType);
+  if (packet.size < header_size ||
+      (packet.size - header_size) % sizeof(ItemType) != 0) {
     return false;
   }
-  memcpy(data, &buffer[0] + sizeof(PacketType), sizeof(DataType));
+  memcpy(data, packet.data + sizeof(PacketType), sizeof(DataType));
+  size_t count = (packet.size - header_size) / sizeof(ItemType);
+  items->resize(count);
+  if (count > 0) {
+    memcpy(&(*items)[0], packet.data + header_size, count * sizeof(ItemType));
+  }
   return true;
 }
 
+template<class PacketType, class DataType, class ItemType>
+bool ExtractPacketData(
+  const std::vector<char>& buffer,
+  DataType* data,
+  std::vector<ItemType>* items
+) {
+  return ExtractPacketData<PacketType, DataType, ItemType>(
+      PacketView(buffer), data, items);
+}
+
 // Appends packet type and data to the end of the buffer.
 template<class PacketType, class DataType>
 void AppendPacketToBuffer(
@@ -54,17 +101,69 @@ void AppendPacketToBuffer(
     reinterpret_cast<const char*>(&data) + sizeof(data));
 }
 
-template<class PacketType, class DataType>
-bool SendPacket(
+// Appends packet type, data and an array of 'count' items
+// to the end of the buffer.
+template<class PacketType, class DataType, class ItemType>
+void AppendPacketToBuffer(
+  std::vector<char>& buffer,
+  PacketType packet_type,
+  const DataType& data,
+  const ItemType* items,
+  size_t count
+) {
+  AppendPacketToBuffer(buffer, packet_type, data);
+
+  buffer.insert(buffer.end(),
+    reinterpret_cast<const char*>(items),
+    reinterpret_cast<const char*>(items) + count * sizeof(*items));
+}
+
+// Appends packet type and the bits written to 'writer'
+// to the end of the buffer.
+template<class PacketType>
+void AppendPacketToBuffer(
+  std::vector<char>& buffer,
+  PacketType packet_type,
+  const BitWriter& writer
+) {
+  buffer.insert(buffer.end(),
+    reinterpret_cast<const char*>(&packet_type),
+    reinterpret_cast<const char*>(&packet_type) + sizeof(packet_type));
+
+  buffer.insert(buffer.end(), writer.GetData().begin(), writer.GetData().end());
+}
+
+// The packets are routed to a channel according to their type.
+// 'GetPacketChannel(packet_type)' should return the channel for
+// the 'packet_type' and 'IsChannelReliable(channel)' whether it's
+// reliable, both are looked up in the namespace of 'PacketType'.
+
+template<class PacketType>
+bool SendBuffer(
     Peer* peer,
     PacketType packet_type,
-    const DataType& data,
-    bool reliable = false
+    const std::vector<char>& buffer
 ) {
-  std::vector<char> buffer;
-  AppendPacketToBuffer(buffer, packet_type, data);
+  auto channel = GetPacketChannel(packet_type);
+  bool rv = peer->Send(&buffer[0], buffer.size(),
+      IsChannelReliable(channel), static_cast<uint8_t>(channel));
+  if (rv == false) {
+    REPORT_ERROR("Couldn't send packet.");
+    return false;
+  }
+  return true;
+}
 
-  bool rv = peer->Send(&buffer[0], buffer.size(), reliable);
+// Passes the ownership of 'buffer' to the sent packet.
+template<class PacketType>
+bool SendBuffer(
+    Peer* peer,
+    PacketType packet_type,
+    PacketBuffer* buffer
+) {
+  auto channel = GetPacketChannel(packet_type);
+  bool rv = peer->Send(buffer, IsChannelReliable(channel),
+      static_cast<uint8_t>(channel));
   if (rv == false) {
     REPORT_ERROR("Couldn't send packet.");
     return false;
@@ -72,17 +171,15 @@ bool SendPacket(
   return true;
 }
 
-template<class PacketType, class DataType>
-bool BroadcastPacket(
+template<class PacketType>
+bool BroadcastBuffer(
     ServerHost* host,
     PacketType packet_type,
-    const DataType& data,
-    bool reliable = false
+    const std::vector<char>& buffer
 ) {
-  std::vector<char> buffer;
-  AppendPacketToBuffer(buffer, packet_type, data);
-
-  bool rv = host->Broadcast(&buffer[0], buffer.size(), reliable);
+  auto channel = GetPacketChannel(packet_type);
+  bool rv = host->Broadcast(&buffer[0], buffer.size(),
+      IsChannelReliable(channel), static_cast<uint8_t>(channel));
   if (rv == false) {
     REPORT_ERROR("Couldn't broadcast packet.");
     return false;
@@ -90,6 +187,67 @@ bool BroadcastPacket(
   return true;
 }
 
+template<class PacketType, class DataType>
+bool SendPacket(
+    Peer* peer,
+    PacketType packet_type,
+    const DataType& data
+) {
+  std::vector<char> buffer;
+  AppendPacketToBuffer(buffer, packet_type, data);
+  return SendBuffer(peer, packet_type, buffer);
+}
+
+// Serializes the packet into a buffer from 'pool'.
+template<class PacketType, class DataType>
+bool SendPacket(
+    PacketPool* pool,
+    Peer* peer,
+    PacketType packet_type,
+    const DataType& data
+) {
+  PacketBuffer* buffer = pool->Acquire();
+  AppendPacketToBuffer(buffer->data, packet_type, data);
+  return SendBuffer(peer, packet_type, buffer);
+}
+
+template<class PacketType, class DataType>
+bool BroadcastPacket(
+    ServerHost* host,
+    PacketType packet_type,
+    const DataType& data
+) {
+  std::vector<char> buffer;
+  AppendPacketToBuffer(buffer, packet_type, data);
+  return BroadcastBuffer(host, packet_type, buffer);
+}
+
+template<class PacketType, class DataType, class ItemType>
+bool SendPacket(
+    Peer* peer,
+    PacketType packet_type,
+    const DataType& data,
+    const ItemType* items,
+    size_t count
+) {
+  std::vector<char> buffer;
+  AppendPacketToBuffer(buffer, packet_type, data, items, count);
+  return SendBuffer(peer, packet_type, buffer);
+}
+
+template<class PacketType, class DataType, class ItemType>
+bool BroadcastPacket(
+    ServerHost* host,
+    PacketType packet_type,
+    const DataType& data,
+    const ItemType* items,
+    size_t count
+) {
+  std::vector<char> buffer;
+  AppendPacketToBuffer(buffer, packet_type, data, items, count);
+  return BroadcastBuffer(host, packet_type, buffer);
+}
+
 // Attempts to synchronously disconnect the peer.
 BM_NET_DECL bool DisconnectPeer(
   Peer* peer,
@@ -25,12 +25,10 @@ Activator::Activator(
   Controller* controller,
   uint32_t id,
   const b2Vec2& position,
-  const std::string& entity_name
-) : ServerEntity(controller, id, Entity::TYPE_ACTIVATOR, entity_name, position,
-                 Entity::FILTER_ACTIVATOR, Entity::FILTER_ALL) {
-  auto config = Config::GetInstance()->GetActivatorsConfig();
-  CHECK(config.count(entity_name) == 1);
-  activation_distance_ = config.at(entity_name).activation_distance;
+  uint32_t prototype_id
+) : ServerEntity(controller, id, Entity::TYPE_ACTIVATOR, prototype_id,
+                 position, Entity::FILTER_ACTIVATOR, Entity::FILTER_ALL) {
+  activation_distance_ = prototype_->activation_distance;
 }
 
 Activator::~Activator() { }
@@ -0,0 +1,75 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "server/client_command.h"
+
+#include <vector>
+
+#include "base/bit_stream.h"
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+#include "net/event.h"
+#include "net/utils.h"
+
+#include "engine/protocol.h"
+#include "engine/wire_format.h"
+
+namespace bm {
+
+bool DecodeClientCommand(const WireFormat& format, int64_t time,
+    const PacketView& message, ClientCommand* command) {
+  CHECK(command != NULL);
+  if (!ExtractPacketType(message, &command->type)) {
+    return false;
+  }
+
+  switch (command->type) {
+    case Packet::TYPE_LOGIN: {
+      if (!ExtractPacketData<Packet::Type, LoginData>(message,
+          &command->login)) {
+        return false;
+      }
+      command->login.login[LoginData::MAX_LOGIN_LENGTH] = '\0';
+      command->login.room[LoginData::MAX_ROOM_LENGTH] = '\0';
+      return true;
+    }
+
+    case Packet::TYPE_SYNC_TIME_REQUEST:
+      return ExtractPacketData<Packet::Type, TimeSyncData>(message,
+          &command->sync);
+
+    case Packet::TYPE_CLIENT_STATUS:
+      return true;
+
+    case Packet::TYPE_KEYBOARD_EVENT: {
+      BitReader reader(message.data, message.size, sizeof(Packet::Type));
+      return ReadKeyboardEvent(format, time, &reader,
+          &command->keyboard_event) && reader.IsAtEnd();
+    }
+
+    case Packet::TYPE_MOUSE_EVENT: {
+      BitReader reader(message.data, message.size, sizeof(Packet::Type));
+      return ReadMouseEvent(format, time, &reader,
+          &command->mouse_event) && reader.IsAtEnd();
+    }
+
+    case Packet::TYPE_PLAYER_ACTION:
+      return ExtractPacketData<Packet::Type, PlayerAction>(message,
+          &command->player_action);
+
+    case Packet::TYPE_INPUT_COMMAND: {
+      BitReader reader(message.data, message.size, sizeof(Packet::Type));
+      return ReadInputCommand(format, time, &reader,
+          &command->input_command) && reader.IsAtEnd();
+    }
+
+    case Packet::TYPE_SNAPSHOT_ACK:
+      return ExtractPacketData<Packet::Type, SnapshotAck>(message,
+          &command->snapshot_ack);
+
+    default:
+      return false;
+  }
+}
+
+}  // namespace bm
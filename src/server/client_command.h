@@ -0,0 +1,36 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef SERVER_CLIENT_COMMAND_H_
+#define SERVER_CLIENT_COMMAND_H_
+
+#include "base/pstdint.h"
+
+#include "net/event.h"
+
+#include "engine/protocol.h"
+#include "engine/wire_format.h"
+
+namespace bm {
+
+// A decoded client message. Only the member matching 'type' is set.
+struct ClientCommand {
+  Packet::Type type;
+  union {
+    LoginData login;
+    TimeSyncData sync;
+    KeyboardEvent keyboard_event;
+    MouseEvent mouse_event;
+    PlayerAction player_action;
+    InputCommand input_command;
+    SnapshotAck snapshot_ack;
+  };
+};
+
+// Returns 'false' if 'message' isn't a correct client message.
+// Packed times are restored as the ones closest to 'time'.
+bool DecodeClientCommand(const WireFormat& format, int64_t time,
+    const PacketView& message, ClientCommand* command);
+
+}  // namespace bm
+
+#endif  // SERVER_CLIENT_COMMAND_H_
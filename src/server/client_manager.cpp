@@ -9,16 +9,13 @@
 #include "base/macros.h"
 #include "base/pstdint.h"
 
-#include "net/enet.h"
-
 #include "server/entity.h"
 
 namespace bm {
 
-Client::Client(Peer* peer, Player* entity, const std::string& login)
-    : peer(peer), entity(entity), login(login) {
-  CHECK(peer != NULL);
-}
+Client::Client(uint32_t id, Player* entity, const std::string& login)
+    : id(id), entity(entity), login(login), acked_snapshot(0),
+      first_snapshot(0), synchronized(false) { }
 Client::~Client() { }
 
 ClientManager::ClientManager() { }
@@ -47,9 +44,8 @@ void ClientManager::DeleteClient(uint32_t id, bool deallocate) {
   _clients.erase(id);
 }
 
-void ClientManager::DisconnectClient(uint32_t id) {
-  CHECK(_clients.count(id) == 1);
-  _clients[id]->peer->Disconnect();
+bool ClientManager::HasClient(uint32_t id) const {
+  return _clients.count(id) == 1;
 }
 
 std::map<uint32_t, Client*>* ClientManager::GetClients() {
@@ -64,11 +60,4 @@ void ClientManager::DeleteClients(const std::vector<uint32_t>& input,
   }
 }
 
-void ClientManager::DisconnectClients(const std::vector<uint32_t>& input) {
-  size_t size = input.size();
-  for (size_t i = 0; i < size; i++) {
-    DisconnectClient(input[i]);
-  }
-}
-
 }  // namespace bm
@@ -9,19 +9,33 @@
 
 #include "base/pstdint.h"
 
-#include "net/enet.h"
+#include "engine/snapshot_delta.h"
 
 #include "server/entity.h"
 
 namespace bm {
 
 struct Client {
-  Client(Peer* peer, Player* entity, const std::string& login);
+  Client(uint32_t id, Player* entity, const std::string& login);
   ~Client();
 
-  Peer* peer;
+  uint32_t id;
   Player* entity;
   std::string login;
+
+  // World snapshots sent to the client, used as delta baselines.
+  SnapshotHistory snapshot_history;
+  // Sequence number of the last snapshot acknowledged by the client and
+  // of the first one sent to it, 0 until then.
+  uint32_t acked_snapshot;
+  uint32_t first_snapshot;
+
+  // Set once the client has synchronized its clock and is ready to
+  // receive the world state.
+  bool synchronized;
+  // Sorted ids of the entities that the client currently knows about.
+  std::vector<uint32_t> visible_static;
+  std::vector<uint32_t> visible_dynamic;
 };
 
 class ClientManager {
@@ -33,11 +47,10 @@ class ClientManager {
 
   Client* GetClient(uint32_t id);
   void DeleteClient(uint32_t id, bool deallocate);
-  void DisconnectClient(uint32_t id);
+  bool HasClient(uint32_t id) const;
 
   std::map<uint32_t, Client*>* GetClients();
   void DeleteClients(const std::vector<uint32_t>& input, bool deallocate);
-  void DisconnectClients(const std::vector<uint32_t>& input);
 
  private:
   std::map<uint32_t, Client*> _clients;
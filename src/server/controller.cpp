@@ -3,9 +3,10 @@
 #include "server/controller.h"
 
 #include <cmath>
-#include <cstdlib>
 
+#include <algorithm>
 #include <map>
+#include <random>
 #include <string>
 #include <vector>
 #include <utility>
@@ -15,12 +16,14 @@
 #include "base/error.h"
 #include "base/macros.h"
 #include "base/pstdint.h"
-#include "base/utils.h"
 
 #include "engine/config.h"
 #include "engine/utils.h"
 
 #include "server/entity.h"
+#include "server/position_history.h"
+#include "server/profiler.h"
+#include "server/spatial_query.h"
 
 #include "server/activator.h"
 #include "server/critter.h"
@@ -32,29 +35,95 @@
 
 namespace bm {
 
-Controller::Controller() : world_(this) {
+Controller::Controller(Profiler* profiler)
+    : world_(this), profiler_(profiler), current_time_(0),
+      retarget_critters_(false), zombie_spawn_counter_(0) {
+  CHECK(profiler != NULL);
   world_.GetBox2DWorld()->SetContactListener(&contact_listener_);
+
+  const Config::ServerConfig& config =
+      Config::GetInstance()->GetServerConfig();
+  interpolation_offset_ = config.interpolation_offset;
+  max_lag_compensation_ = config.max_lag_compensation;
+  // One more step to interpolate from.
+  size_t steps = static_cast<size_t>(
+      max_lag_compensation_ * config.tick_rate / 1000) + 2;
+  position_history_.Reset(steps);
+
+  player_prototype_ = FindPrototypeId(Config::Prototype::KIND_PLAYER,
+      "player");
+  zombie_prototype_ = FindPrototypeId(Config::Prototype::KIND_CRITTER,
+      "zombie");
+  morphed_wall_prototype_ = FindPrototypeId(Config::Prototype::KIND_WALL,
+      "morphed_wall");
+  const std::map<std::string, Config::GunConfig>& guns =
+      Config::GetInstance()->GetGunsConfig();
+  CHECK(guns.count("bazooka") == 1 && guns.count("morpher") == 1);
+  left_gun_ = &guns.at("bazooka");
+  right_gun_ = &guns.at("morpher");
 }
 
 Controller::~Controller() { }
 
+uint32_t Controller::FindPrototypeId(Config::Prototype::Kind kind,
+    const std::string& name) {
+  uint32_t id = Config::GetInstance()->FindPrototypeId(kind, name);
+  CHECK(id != Config::BAD_PROTOTYPE_ID);
+  return id;
+}
+
 ServerWorld* Controller::GetWorld() {
   return &world_;
 }
 
+void Controller::SetRandomSeed(uint32_t seed) {
+  random_.seed(seed);
+}
+
 std::vector<GameEvent>* Controller::GetGameEvents() {
   return &game_events_;
 }
 
 void Controller::Update(int64_t time, int64_t time_delta) {
-  SpawnZombies();
-  UpdateEntities(time_delta);
-  StepPhysics(time_delta);
-  DestroyOutlyingEntities();
-  RespawnDeadPlayers();
-  DeleteDestroyedEntities(time, time_delta);
+  ScopedPhaseTimer update_timer(profiler_, Profiler::PHASE_UPDATE);
+  current_time_ = time + time_delta;
+
+  {
+    ScopedPhaseTimer timer(profiler_, Profiler::PHASE_SPAWN_ZOMBIES);
+    SpawnZombies();
+  }
+  {
+    ScopedPhaseTimer timer(profiler_, Profiler::PHASE_UPDATE_ENTITIES);
+    UpdateEntities(time_delta);
+  }
+  {
+    ScopedPhaseTimer timer(profiler_, Profiler::PHASE_STEP_PHYSICS);
+    StepPhysics(time_delta);
+    position_history_.Record(current_time_, *world_.GetDynamicEntities(),
+        Entity::TYPE_PLAYER);
+  }
+  profiler_->RecordBox2DProfile(world_.GetBox2DWorld()->GetProfile());
+  {
+    ScopedPhaseTimer timer(profiler_,
+        Profiler::PHASE_DESTROY_OUTLYING_ENTITIES);
+    DestroyOutlyingEntities();
+  }
+  {
+    ScopedPhaseTimer timer(profiler_, Profiler::PHASE_RESPAWN_DEAD_PLAYERS);
+    RespawnDeadPlayers();
+  }
+  {
+    ScopedPhaseTimer timer(profiler_,
+        Profiler::PHASE_DELETE_DESTROYED_ENTITIES);
+    DeleteDestroyedEntities(time, time_delta);
+  }
+  {
+    ScopedPhaseTimer timer(profiler_, Profiler::PHASE_UPDATE_INTEREST_GRID);
+    world_.UpdateInterestGrid();
+  }
 
   // TODO(xairy): refactor.
+  ScopedPhaseTimer timer(profiler_, Profiler::PHASE_SLIME_EXPLOSIONS);
   std::vector<std::pair<b2Vec2, int> >::iterator it;
   for (it = morph_list_.begin(); it != morph_list_.end(); ++it) {
     MakeSlimeExplosion(it->first, it->second);
@@ -63,7 +132,7 @@ void Controller::Update(int64_t time, int64_t time_delta) {
 }
 
 Player* Controller::OnPlayerConnected() {
-  Player* player = world_.CreatePlayer(b2Vec2(0.0f, 0.0f), "player");
+  Player* player = world_.CreatePlayer(b2Vec2(0.0f, 0.0f), player_prototype_);
   RespawnPlayer(player);
   OnEntityAppearance(player);
   return player;
@@ -74,58 +143,16 @@ void Controller::OnPlayerDisconnected(Player* player) {
 }
 
 void Controller::OnEntityAppearance(Entity* entity) {
-  std::map<uint32_t, Entity*>::iterator itr, end;
-  end = world_.GetDynamicEntities()->end();
-  for (itr = world_.GetDynamicEntities()->begin(); itr != end; ++itr) {
-    Entity::Type itr_type = itr->second->GetType();
-    Entity::Type ent_type = entity->GetType();
-    if ((itr_type == Entity::TYPE_CRITTER && ent_type == Entity::TYPE_PLAYER) ||
-        (itr_type == Entity::TYPE_PLAYER && ent_type == Entity::TYPE_CRITTER)) {
-      Critter* critter = NULL;
-      Player* player = NULL;
-      if (itr_type == Entity::TYPE_CRITTER) {
-        critter = static_cast<Critter*>(itr->second);
-        player = static_cast<Player*>(entity);
-      } else {
-        critter = static_cast<Critter*>(entity);
-        player = static_cast<Player*>(itr->second);
-      }
-      if (critter->GetTarget() == NULL) {
-         critter->SetTarget(player);
-      } else {
-        float current_distance = (critter->GetTarget()->GetPosition() -
-            critter->GetPosition()).Length();
-        float new_distance = (player->GetPosition() -
-            critter->GetPosition()).Length();
-        if (new_distance < current_distance) {
-          critter->SetTarget(player);
-        }
-      }
-    }
+  if (entity->GetType() == Entity::TYPE_CRITTER) {
+    RetargetCritter(static_cast<Critter*>(entity));
+  } else if (entity->GetType() == Entity::TYPE_PLAYER) {
+    retarget_critters_ = true;
   }
 }
 
 void Controller::OnEntityDisappearance(Entity* entity) {
-  std::map<uint32_t, Entity*>::iterator itr, end;
-  end = world_.GetDynamicEntities()->end();
-  for (itr = world_.GetDynamicEntities()->begin(); itr != end; ++itr) {
-    Entity::Type itr_type = itr->second->GetType();
-    Entity::Type ent_type = entity->GetType();
-    if ((itr_type == Entity::TYPE_CRITTER && ent_type == Entity::TYPE_PLAYER) ||
-        (itr_type == Entity::TYPE_PLAYER && ent_type == Entity::TYPE_CRITTER)) {
-      Critter* critter = NULL;
-      Player* player = NULL;
-      if (itr_type == Entity::TYPE_CRITTER) {
-        critter = static_cast<Critter*>(itr->second);
-        player = static_cast<Player*>(entity);
-      } else {
-        critter = static_cast<Critter*>(entity);
-        player = static_cast<Player*>(itr->second);
-      }
-      if (critter->GetTarget() == player) {
-         critter->SetTarget(NULL);
-      }
-    }
+  if (entity->GetType() == Entity::TYPE_PLAYER) {
+    retarget_critters_ = true;
   }
 }
 
@@ -135,35 +162,56 @@ void Controller::OnKeyboardEvent(Player* player, const KeyboardEvent& event) {
 
 void Controller::OnMouseEvent(Player* player, const MouseEvent& event) {
   if (event.event_type == MouseEvent::EVENT_KEYDOWN) {
-    std::string gun_name;
-    if (event.button_type == MouseEvent::BUTTON_LEFT) {
-      gun_name = "bazooka";
-    } else if (event.button_type == MouseEvent::BUTTON_RIGHT) {
-      gun_name = "morpher";
-    }
+    Fire(player, event.button_type, b2Vec2(event.x, event.y));
+  }
 
-    auto config = Config::GetInstance()->GetGunsConfig().at(gun_name);
-    int energy_consumption = config.energy_consumption;
-    std::string projectile_config = config.projectile_name;
-
-    if (player->GetEnergy() >= energy_consumption) {
-      player->AddEnergy(-energy_consumption);
-      b2Vec2 start = player->GetPosition();
-      b2Vec2 end(static_cast<float>(event.x), static_cast<float>(event.y));
-      Projectile* projectile = world_.CreateProjectile(player->GetId(),
-          start, end, projectile_config);
-      OnEntityAppearance(projectile);
+  if (event.event_type == MouseEvent::EVENT_MOVE) {
+    Aim(player, b2Vec2(event.x, event.y));
+  }
+}
+
+void Controller::OnInputCommand(Player* player,
+    const InputCommand& command) {
+  if (!player->OnInputCommand(command)) {
+    return;
+  }
+  for (size_t i = 0; i < command.button_event_count; i++) {
+    const InputCommand::ButtonEvent& event = command.button_events[i];
+    if (event.event_type == MouseEvent::EVENT_KEYDOWN) {
+      Fire(player, event.button_type, b2Vec2(event.x, event.y));
     }
   }
+  Aim(player, b2Vec2(command.x, command.y));
+}
 
-  if (event.event_type == MouseEvent::EVENT_MOVE) {
-    b2Vec2 mouse_position = b2Vec2(event.x, event.y);
-    b2Vec2 direction = mouse_position - player->GetPosition();
-    float angle = atan2f(-direction.x, direction.y);
-    player->SetRotation(angle);
+void Controller::Fire(Player* player, MouseEvent::ButtonType button,
+    const b2Vec2& target) {
+  const Config::GunConfig* gun;
+  if (button == MouseEvent::BUTTON_LEFT) {
+    gun = left_gun_;
+  } else if (button == MouseEvent::BUTTON_RIGHT) {
+    gun = right_gun_;
+  } else {
+    return;
+  }
+
+  int energy_consumption = gun->energy_consumption;
+
+  if (player->GetEnergy() >= energy_consumption) {
+    player->AddEnergy(-energy_consumption);
+    b2Vec2 start = player->GetPosition();
+    Projectile* projectile = world_.CreateProjectile(player->GetId(),
+        start, target, gun->projectile_prototype);
+    OnEntityAppearance(projectile);
   }
 }
 
+void Controller::Aim(Player* player, const b2Vec2& target) {
+  b2Vec2 direction = target - player->GetPosition();
+  float angle = atan2f(-direction.x, direction.y);
+  player->SetRotation(angle);
+}
+
 void Controller::OnPlayerAction(Player* player, const PlayerAction& event) {
   if (event.type == PlayerAction::TYPE_ACTIVATE) {
     Entity* entity = world_.GetEntity(event.target_id);
@@ -184,9 +232,9 @@ void Controller::OnPlayerAction(Player* player, const PlayerAction& event) {
     if (entity->GetType() == Entity::TYPE_ACTIVATOR) {
       Activator* activator = static_cast<Activator*>(entity);
 
-      // Check distance.
-      if (Length(entity->GetPosition() - player->GetPosition()) >
-          activator->GetActivationDistance()) {
+      // Check distance to the edge of the activator.
+      if (!SpatialQuery::IsInRadius(entity, player->GetPosition(),
+          activator->GetActivationDistance())) {
         return;
       }
 
@@ -194,9 +242,9 @@ void Controller::OnPlayerAction(Player* player, const PlayerAction& event) {
     } else if (entity->GetType() == Entity::TYPE_DOOR) {
       Door* door = static_cast<Door*>(entity);
 
-      // Check distance.
-      if (Length(entity->GetPosition() - player->GetPosition()) >
-          door->GetActivationDistance()) {
+      // Check distance to the edge of the door.
+      if (!SpatialQuery::IsInRadius(entity, player->GetPosition(),
+          door->GetActivationDistance())) {
         return;
       }
 
@@ -215,7 +263,7 @@ void Controller::OnCollision(Door* first, Player* second) { }
 void Controller::OnCollision(Door* first, Critter* second) { }
 
 void Controller::OnCollision(Door* first, Projectile* second) {
-  DestroyProjectile(second);
+  DestroyProjectile(second, first);
 }
 
 void Controller::OnCollision(Activator* first, Activator* second) { }
@@ -225,7 +273,7 @@ void Controller::OnCollision(Activator* first, Player* second) { }
 void Controller::OnCollision(Activator* first, Critter* second) { }
 
 void Controller::OnCollision(Activator* first, Projectile* second) {
-  DestroyProjectile(second);
+  DestroyProjectile(second, first);
 }
 
 void Controller::OnCollision(Kit* first, Kit* second) { }
@@ -248,7 +296,7 @@ void Controller::OnCollision(Wall* first, Critter* second) {
 }
 
 void Controller::OnCollision(Wall* first, Projectile* second) {
-  DestroyProjectile(second);
+  DestroyProjectile(second, first);
 }
 
 void Controller::OnCollision(Player* first, Player* second) { }
@@ -263,43 +311,46 @@ void Controller::OnCollision(Player* first, Projectile* second) {
   if (second->GetOwnerId() == first->GetId()) {
     return;
   }
-  DestroyProjectile(second);
+  DestroyProjectile(second, first);
 }
 
 void Controller::OnCollision(Critter* first, Critter* second) { }
 
 void Controller::OnCollision(Critter* first, Projectile* second) {
-  DestroyProjectile(second);
+  DestroyProjectile(second, first);
   first->Destroy();
 }
 
 void Controller::OnCollision(Projectile* first, Projectile* second) {
-  DestroyProjectile(first);
-  DestroyProjectile(second);
+  DestroyProjectile(first, second);
+  DestroyProjectile(second, first);
 }
 
 // Updating.
 
 void Controller::SpawnZombies() {
-  static int counter = 0;
-  if (counter == 300) {
-    float x = -250.0f + static_cast<float>(rand()) / RAND_MAX * 500.0f;  // NOLINT
-    float y = -250.0f + static_cast<float>(rand()) / RAND_MAX * 500.0f;  // NOLINT
-    Critter* critter = world_.CreateCritter(b2Vec2(x, y), "zombie");
+  if (zombie_spawn_counter_ == 300) {
+    std::uniform_real_distribution<float> coordinate(-250.0f, 250.0f);
+    float x = coordinate(random_);
+    float y = coordinate(random_);
+    Critter* critter = world_.CreateCritter(b2Vec2(x, y), zombie_prototype_);
     OnEntityAppearance(critter);
-    counter = 0;
+    zombie_spawn_counter_ = 0;
   }
-  counter++;
+  zombie_spawn_counter_++;
 }
 
 void Controller::UpdateEntities(int64_t time_delta) {
-  std::map<uint32_t, Entity*>::iterator i, end;
+  EntityMap::iterator i, end;
   end = world_.GetDynamicEntities()->end();
   for (i = world_.GetDynamicEntities()->begin(); i != end; ++i) {
     Entity* entity = i->second;
     if (entity->GetType() == Entity::TYPE_CRITTER) {
       Critter* critter = static_cast<Critter*>(entity);
-      Entity* target = critter->GetTarget();
+      if (retarget_critters_) {
+        RetargetCritter(critter);
+      }
+      Entity* target = world_.GetEntity(critter->GetTargetId());
       if (target != NULL) {
         b2Vec2 velocity = target->GetPosition() - critter->GetPosition();
         velocity.Normalize();
@@ -321,6 +372,14 @@ void Controller::UpdateEntities(int64_t time_delta) {
       player->Regenerate(time_delta);
     }
   }
+  retarget_critters_ = false;
+}
+
+void Controller::RetargetCritter(Critter* critter) {
+  Entity* target = world_.GetSpatialQuery()->FindNearest(
+      critter->GetPosition(), Entity::TYPE_PLAYER);
+  critter->SetTargetId((target != NULL) ? target->GetId() :
+      ServerEntity::BAD_ID);
 }
 
 void Controller::StepPhysics(int64_t time_delta) {
@@ -366,7 +425,8 @@ void Controller::RespawnDeadPlayers() {
 void Controller::RespawnPlayer(Player* player) {
   CHECK(world_.GetSpawnPositions()->size() > 0);
   size_t spawn_count = world_.GetSpawnPositions()->size();
-  size_t spawn = Random(spawn_count);
+  size_t spawn = std::uniform_int_distribution<size_t>(0,
+      spawn_count - 1)(random_);
   player->SetPosition(world_.GetSpawnPositions()->at(spawn));
   player->RestoreHealth();
 }
@@ -385,27 +445,17 @@ void Controller::UpdateScore(Player* player) {
 }
 
 void Controller::DeleteDestroyedEntities(int64_t time, int64_t time_delta) {
-  std::map<uint32_t, Entity*>::iterator itr, end;
-  end = world_.GetStaticEntities()->end();
-  for (itr = world_.GetStaticEntities()->begin(); itr != end;) {
-    ServerEntity* entity = static_cast<ServerEntity*>(itr->second);
-    ++itr;
-    if (entity->IsDestroyed()) {
-      GameEvent event;
-      event.type = GameEvent::TYPE_ENTITY_DISAPPEARED;
-      event.x = entity->GetPosition().x;
-      event.y = entity->GetPosition().y;
-      entity->GetSnapshot(time + time_delta, &event.entity);
-      game_events_.push_back(event);
-      world_.RemoveEntity(entity->GetId());
-      OnEntityDisappearance(entity);
-      delete entity;
-    }
-  }
-  end = world_.GetDynamicEntities()->end();
-  for (itr = world_.GetDynamicEntities()->begin(); itr != end;) {
-    ServerEntity* entity = static_cast<ServerEntity*>(itr->second);
-    ++itr;
+  DeleteDestroyedEntities(world_.GetStaticEntities(), time, time_delta);
+  DeleteDestroyedEntities(world_.GetDynamicEntities(), time, time_delta);
+}
+
+void Controller::DeleteDestroyedEntities(EntityMap* entities, int64_t time,
+    int64_t time_delta) {
+  // Removing an entity moves the last one into its place, so the loop goes
+  // from the end.
+  for (size_t i = entities->GetSize(); i > 0; i--) {
+    ServerEntity* entity =
+        static_cast<ServerEntity*>(entities->GetItem(i - 1).second);
     if (entity->IsDestroyed()) {
       GameEvent event;
       event.type = GameEvent::TYPE_ENTITY_DISAPPEARED;
@@ -415,21 +465,22 @@ void Controller::DeleteDestroyedEntities(int64_t time, int64_t time_delta) {
       game_events_.push_back(event);
       world_.RemoveEntity(entity->GetId());
       OnEntityDisappearance(entity);
-      delete entity;
+      world_.DeleteEntity(entity);
     }
   }
 }
 
 // Explosions.
 
-void Controller::DestroyProjectile(Projectile* projectile) {
+void Controller::DestroyProjectile(Projectile* projectile,
+    ServerEntity* hit) {
   // We do not want 'projectile' to explode multiple times.
   if (!projectile->IsDestroyed()) {
     if (projectile->GetProjectileType() == Projectile::TYPE_ROCKET) {
       MakeRocketExplosion(projectile->GetPosition(),
         projectile->GetRocketExplosionRadius(),
         projectile->GetRocketExplosionDamage(),
-        projectile->GetOwnerId());
+        projectile->GetOwnerId(), hit);
     } else if (projectile->GetProjectileType() == Projectile::TYPE_SLIME) {
       morph_list_.push_back(
         std::pair<b2Vec2, int>(projectile->GetPosition(),
@@ -440,21 +491,51 @@ void Controller::DestroyProjectile(Projectile* projectile) {
 }
 
 void Controller::MakeRocketExplosion(const b2Vec2& location, float radius,
-                               int damage, uint32_t source_id) {
-  // FIXME(xairy): can miss huge entities.
-  radius += 13.0f;
+    int damage, uint32_t source_id, ServerEntity* hit) {
+  // The rocket hit the entity where it is now, whatever the client saw.
+  if (hit != NULL) {
+    hit->Damage(damage, source_id);
+  }
 
-  for (auto i : *world_.GetStaticEntities()) {
-    ServerEntity* entity = static_cast<ServerEntity*>(i.second);
-    float distance2 = (entity->GetPosition() - location).LengthSquared();
-    if (distance2 <= radius * radius) {
-      entity->Damage(damage, source_id);
+  // The client of the player showed the other players about half of its
+  // round trip time plus its interpolation delay in the past.
+  bool rewound = false;
+  Entity* source = world_.GetEntity(source_id);
+  if (source != NULL && source->GetType() == Entity::TYPE_PLAYER) {
+    Player* player = static_cast<Player*>(source);
+    int64_t interpolation_delay = player->GetInterpolationDelay();
+    if (interpolation_delay < 0) {
+      interpolation_delay = interpolation_offset_;
     }
+    int64_t delay = std::min(max_lag_compensation_,
+        player->GetRoundTripTime() / 2 + interpolation_delay);
+    rewound = position_history_.Rewind(current_time_ - delay);
   }
-  for (auto i : *world_.GetDynamicEntities()) {
-    ServerEntity* entity = static_cast<ServerEntity*>(i.second);
-    float distance2 = (entity->GetPosition() - location).LengthSquared();
-    if (distance2 <= radius * radius) {
+
+  // The rewound players are found around the explosion in the present
+  // within the distance they moved since then.
+  float query_radius = radius;
+  if (rewound) {
+    query_radius += position_history_.GetMaxDisplacement();
+  }
+  nearby_entities_.clear();
+  world_.GetSpatialQuery()->QueryRadius(location, query_radius,
+      &nearby_entities_);
+  for (size_t i = 0; i < nearby_entities_.size(); i++) {
+    ServerEntity* entity = static_cast<ServerEntity*>(nearby_entities_[i]);
+    if (entity == hit) {
+      continue;
+    }
+    // The query is exact for the present positions.
+    bool inside = true;
+    if (rewound && IsRewound(entity, source_id)) {
+      b2Vec2 position = entity->GetPosition();
+      position_history_.GetPosition(entity->GetId(), &position);
+      inside = SpatialQuery::IsInRadius(entity, position, location, radius);
+    } else if (query_radius > radius) {
+      inside = SpatialQuery::IsInRadius(entity, location, radius);
+    }
+    if (inside) {
       entity->Damage(damage, source_id);
     }
   }
@@ -466,6 +547,11 @@ void Controller::MakeRocketExplosion(const b2Vec2& location, float radius,
   game_events_.push_back(event);
 }
 
+bool Controller::IsRewound(Entity* entity, uint32_t source_id) {
+  return entity->GetType() == Entity::TYPE_PLAYER &&
+      entity->GetId() != source_id;
+}
+
 void Controller::MakeSlimeExplosion(const b2Vec2& location, int radius) {
   float block_size = 16.0f;
   int lx = static_cast<int>(round(location.x / block_size));
@@ -474,7 +560,7 @@ void Controller::MakeSlimeExplosion(const b2Vec2& location, int radius) {
     for (int y = -radius; y <= radius; y++) {
       if (x * x + y * y <= radius * radius) {
         Wall* wall = world_.CreateWall(b2Vec2((lx + x) * block_size,
-          (ly + y) * block_size), "morphed_wall");
+          (ly + y) * block_size), morphed_wall_prototype_);
         OnEntityAppearance(wall);
       }
     }
@@ -4,6 +4,7 @@
 #define SERVER_CONTROLLER_H_
 
 #include <map>
+#include <random>
 #include <string>
 #include <vector>
 #include <utility>
@@ -12,8 +13,12 @@
 
 #include "base/pstdint.h"
 
+#include "engine/config.h"
+
 #include "server/contact_listener.h"
 #include "server/entity.h"
+#include "server/position_history.h"
+#include "server/profiler.h"
 #include "server/world.h"
 
 namespace bm {
@@ -28,11 +33,16 @@ class Wall;
 
 class Controller {
  public:
-  explicit Controller();
+  // The phases of 'Update()' are recorded into 'profiler'.
+  explicit Controller(Profiler* profiler);
   ~Controller();
 
   ServerWorld* GetWorld();
 
+  // The simulation draws its random numbers from its own generator, so a
+  // replay with the same seed repeats it.
+  void SetRandomSeed(uint32_t seed);
+
   // The list of the events should be cleared by the caller.
   std::vector<GameEvent>* GetGameEvents();
 
@@ -43,6 +53,8 @@ class Controller {
   Player* OnPlayerConnected();
   void OnPlayerDisconnected(Player* player);
 
+  // Critters go after the closest player, they are retargeted on the next
+  // update whenever a player comes or goes.
   void OnEntityAppearance(Entity* entity);
   void OnEntityDisappearance(Entity* entity);
 
@@ -50,6 +62,7 @@ class Controller {
   void OnMouseEvent(Player* player, const MouseEvent& event);
 
   void OnPlayerAction(Player* player, const PlayerAction& event);
+  void OnInputCommand(Player* player, const InputCommand& command);
 
   // Collisions.
 
@@ -93,22 +106,72 @@ class Controller {
 
   void SpawnZombies();
   void UpdateEntities(int64_t time_delta);
+  // Targets the player closest to 'critter'.
+  void RetargetCritter(Critter* critter);
   void StepPhysics(int64_t time_delta);
   void DestroyOutlyingEntities();
   void RespawnDeadPlayers();
   void RespawnPlayer(Player* player);
   void UpdateScore(Player* player);
   void DeleteDestroyedEntities(int64_t time, int64_t time_delta);
+  void DeleteDestroyedEntities(EntityMap* entities, int64_t time,
+      int64_t time_delta);
 
   // Projectiles.
 
-  void DestroyProjectile(Projectile* projectile);
+  // 'hit' is the entity the projectile collided with or 'NULL'.
+  void DestroyProjectile(Projectile* projectile, ServerEntity* hit);
+  // 'hit' is always damaged, the other entities if they are within
+  // 'radius' of 'location'.
   void MakeRocketExplosion(const b2Vec2& location, float radius,
-                           int damage, uint32_t source_id);
+      int damage, uint32_t source_id, ServerEntity* hit);
+  // Whether the explosion caused by 'source_id' checks 'entity' at its
+  // rewound position. Only the other players are lag-compensated.
+  static bool IsRewound(Entity* entity, uint32_t source_id);
   void MakeSlimeExplosion(const b2Vec2& location, int radius);
 
+  // Input.
+
+  // Fires the gun bound to 'button' at 'target' if there is enough energy.
+  void Fire(Player* player, MouseEvent::ButtonType button,
+      const b2Vec2& target);
+  void Aim(Player* player, const b2Vec2& target);
+
+  // The prototypes the controller makes entities from are looked up once.
+  static uint32_t FindPrototypeId(Config::Prototype::Kind kind,
+      const std::string& name);
+
   ServerWorld world_;
   ContactListener contact_listener_;
+  Profiler* profiler_;
+
+  // The end of the step being simulated.
+  int64_t current_time_;
+
+  // Rocket explosions caused by a player hit the other players where its
+  // client showed them. The interpolation delay of the client is reported
+  // in its commands, 'interpolation_offset_' is used until the first one.
+  PositionHistory position_history_;
+  int64_t interpolation_offset_;
+  int64_t max_lag_compensation_;
+
+  // Reused by the explosions for the entities around them.
+  std::vector<Entity*> nearby_entities_;
+
+  // Set when a player comes or goes, so the next update retargets critters.
+  bool retarget_critters_;
+
+  uint32_t player_prototype_;
+  uint32_t zombie_prototype_;
+  uint32_t morphed_wall_prototype_;
+  // Fired with the left and the right mouse buttons.
+  const Config::GunConfig* left_gun_;
+  const Config::GunConfig* right_gun_;
+
+  std::mt19937 random_;
+
+  // Ticks since the last zombie was spawned.
+  int zombie_spawn_counter_;
 
   // TODO(xairy): refactor.
   std::vector<std::pair<b2Vec2, int> > morph_list_;
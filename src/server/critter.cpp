@@ -24,14 +24,12 @@ Critter::Critter(
   Controller* controller,
   uint32_t id,
   const b2Vec2& position,
-  const std::string& entity_name
-) : ServerEntity(controller, id, Entity::TYPE_CRITTER, entity_name, position,
+  uint32_t prototype_id
+) : ServerEntity(controller, id, Entity::TYPE_CRITTER, prototype_id, position,
            Entity::FILTER_CRITTER, Entity::FILTER_ALL & ~Entity::FILTER_KIT) {
-  auto config = Config::GetInstance()->GetCrittersConfig();
-  CHECK(config.count(entity_name) == 1);
-  _speed = config.at(entity_name).speed;
-  _target = NULL;
-  Config::CritterConfig::Type type = config.at(entity_name).type;
+  _speed = prototype_->speed;
+  _target_id = BAD_ID;
+  Config::CritterConfig::Type type = prototype_->critter_type;
   if (type == Config::CritterConfig::TYPE_ZOMBIE) {
     type_ = TYPE_ZOMBIE;
   } else {
@@ -54,12 +52,12 @@ float Critter::GetSpeed() const {
   return _speed;
 }
 
-Entity* Critter::GetTarget() const {
-  return _target;
+uint32_t Critter::GetTargetId() const {
+  return _target_id;
 }
 
-void Critter::SetTarget(Entity* target) {
-  _target = target;
+void Critter::SetTargetId(uint32_t id) {
+  _target_id = id;
 }
 
 void Critter::Collide(ServerEntity* entity) {
@@ -31,7 +31,7 @@ class Critter : public ServerEntity {
     Controller* controller,
     uint32_t id,
     const b2Vec2& position,
-    const std::string& entity_name);
+    uint32_t prototype_id);
   virtual ~Critter();
 
   virtual void GetSnapshot(int64_t time, EntitySnapshot* output);
@@ -39,8 +39,10 @@ class Critter : public ServerEntity {
 
   float GetSpeed() const;
 
-  Entity* GetTarget() const;
-  void SetTarget(Entity* target);
+  // The id of the entity the critter goes after or 'BAD_ID'. It's kept
+  // as an id, so a target removed meanwhile isn't found by it.
+  uint32_t GetTargetId() const;
+  void SetTargetId(uint32_t id);
 
   // Double dispatch. Collision detection.
   virtual void Collide(ServerEntity* entity);
@@ -54,7 +56,7 @@ class Critter : public ServerEntity {
 
  protected:
   float _speed;
-  Entity* _target;
+  uint32_t _target_id;
   Type type_;
 
  private:
@@ -25,12 +25,10 @@ Door::Door(
   Controller* controller,
   uint32_t id,
   const b2Vec2& position,
-  const std::string& entity_name
-) : ServerEntity(controller, id, Entity::TYPE_DOOR, entity_name, position,
+  uint32_t prototype_id
+) : ServerEntity(controller, id, Entity::TYPE_DOOR, prototype_id, position,
                  Entity::FILTER_DOOR, Entity::FILTER_ALL) {
-  auto config = Config::GetInstance()->GetDoorsConfig();
-  CHECK(config.count(entity_name) == 1);
-  activation_distance_ = config.at(entity_name).activation_distance;
+  activation_distance_ = prototype_->activation_distance;
   door_closed_ = true;
 }
 
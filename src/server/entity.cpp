@@ -35,12 +35,13 @@ ServerEntity::ServerEntity(
   Controller* controller,
   uint32_t id,
   Type type,
-  const std::string& entity_name,
+  uint32_t prototype_id,
   b2Vec2 position,
   uint16_t collision_category,
   uint16_t collision_mask
 ) : Entity(controller->GetWorld()->GetBox2DWorld(), id, type,
-           entity_name, position, collision_category, collision_mask),
+           prototype_id, position, collision_category, collision_mask,
+           controller->GetWorld()->GetBodyPool()),
     controller_(controller),
     is_destroyed_(false),
     is_updated_(true) { }
@@ -71,10 +72,7 @@ void ServerEntity::GetSnapshot(int64_t time, EntitySnapshot* output) {
   output->x = GetPosition().x;
   output->y = GetPosition().y;
   output->angle = GetRotation();
-
-  CHECK(name_.size() <= EntitySnapshot::MAX_NAME_LENGTH);
-  std::copy(name_.begin(), name_.end(), &output->name[0]);
-  output->name[name_.size()] = '\0';
+  output->kind = prototype_->id;
 }
 
 void ServerEntity::Damage(int damage, uint32_t source_id) { }
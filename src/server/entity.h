@@ -36,7 +36,7 @@ class ServerEntity : public Entity {
     Controller* controller,
     uint32_t id,
     Type type,
-    const std::string& entity_name,
+    uint32_t prototype_id,
     b2Vec2 position,
     uint16_t collision_category,
     uint16_t collision_mask);
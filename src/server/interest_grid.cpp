@@ -0,0 +1,87 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "server/interest_grid.h"
+
+#include <cmath>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include <Box2D/Box2D.h>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+namespace bm {
+
+InterestGrid::InterestGrid() : bound_(0.0f), cell_size_(0.0f), size_(0) { }
+InterestGrid::~InterestGrid() { }
+
+void InterestGrid::Initialize(float bound, float cell_size) {
+  CHECK(bound > 0.0f);
+  CHECK(cell_size > 0.0f);
+  bound_ = bound;
+  cell_size_ = cell_size;
+  size_ = static_cast<int>(std::ceil(2 * bound / cell_size));
+  cells_.clear();
+  cells_.resize(size_ * size_);
+  entity_cells_.clear();
+}
+
+void InterestGrid::Update(uint32_t id, const b2Vec2& position) {
+  CHECK(size_ > 0);
+  int x = GetCellCoordinate(position.x);
+  int y = GetCellCoordinate(position.y);
+  size_t cell = y * size_ + x;
+
+  std::map<uint32_t, size_t>::iterator itr = entity_cells_.find(id);
+  if (itr != entity_cells_.end()) {
+    if (itr->second == cell) {
+      return;
+    }
+    Remove(id);
+  }
+  cells_[cell].push_back(id);
+  entity_cells_[id] = cell;
+}
+
+void InterestGrid::Remove(uint32_t id) {
+  std::map<uint32_t, size_t>::iterator itr = entity_cells_.find(id);
+  if (itr == entity_cells_.end()) {
+    return;
+  }
+  std::vector<uint32_t>& ids = cells_[itr->second];
+  std::vector<uint32_t>::iterator position =
+      std::find(ids.begin(), ids.end(), id);
+  CHECK(position != ids.end());
+  *position = ids.back();
+  ids.pop_back();
+  entity_cells_.erase(itr);
+}
+
+void InterestGrid::Query(const b2Vec2& center, float radius,
+    std::vector<uint32_t>* output) const {
+  CHECK(output != NULL);
+  CHECK(radius >= 0.0f);
+  if (size_ == 0) {
+    return;
+  }
+  int min_x = GetCellCoordinate(center.x - radius);
+  int max_x = GetCellCoordinate(center.x + radius);
+  int min_y = GetCellCoordinate(center.y - radius);
+  int max_y = GetCellCoordinate(center.y + radius);
+  for (int y = min_y; y <= max_y; y++) {
+    for (int x = min_x; x <= max_x; x++) {
+      const std::vector<uint32_t>& ids = cells_[y * size_ + x];
+      output->insert(output->end(), ids.begin(), ids.end());
+    }
+  }
+}
+
+int InterestGrid::GetCellCoordinate(float value) const {
+  int coordinate = static_cast<int>(std::floor((value + bound_) / cell_size_));
+  return std::max(0, std::min(size_ - 1, coordinate));
+}
+
+}  // namespace bm
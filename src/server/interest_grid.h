@@ -0,0 +1,53 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef SERVER_INTEREST_GRID_H_
+#define SERVER_INTEREST_GRID_H_
+
+#include <map>
+#include <vector>
+
+#include <Box2D/Box2D.h>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+namespace bm {
+
+// Uniform grid of entity ids used to find the entities around a point
+// without iterating over the whole world. Covers the square
+// [-bound, bound] x [-bound, bound], positions outside of it are clamped
+// to the border cells.
+class InterestGrid {
+ public:
+  InterestGrid();
+  ~InterestGrid();
+
+  void Initialize(float bound, float cell_size);
+
+  // Adds the entity to the grid or moves it to the cell containing
+  // 'position' if it has changed.
+  void Update(uint32_t id, const b2Vec2& position);
+  void Remove(uint32_t id);
+
+  // Appends the ids of the entities from all the cells that intersect
+  // the square circumscribed around the circle, so some of them can be
+  // farther than 'radius' from 'center'.
+  void Query(const b2Vec2& center, float radius,
+      std::vector<uint32_t>* output) const;
+
+ private:
+  int GetCellCoordinate(float value) const;
+
+  float bound_;
+  float cell_size_;
+  int size_;
+
+  std::vector<std::vector<uint32_t> > cells_;
+  std::map<uint32_t, size_t> entity_cells_;
+
+  DISALLOW_COPY_AND_ASSIGN(InterestGrid);
+};
+
+}  // namespace bm
+
+#endif  // SERVER_INTEREST_GRID_H_
@@ -24,13 +24,11 @@ Kit::Kit(
   Controller* controller,
   uint32_t id,
   const b2Vec2& position,
-  const std::string& entity_name
-) : ServerEntity(controller, id, Entity::TYPE_KIT, entity_name, position,
+  uint32_t prototype_id
+) : ServerEntity(controller, id, Entity::TYPE_KIT, prototype_id, position,
         Entity::FILTER_KIT, Entity::FILTER_ALL & ~Entity::FILTER_PROJECTILE) {
-  auto config = Config::GetInstance()->GetKitsConfig();
-  CHECK(config.count(entity_name) == 1);
-  _health_regeneration = config.at(entity_name).health_regen;
-  _energy_regeneration = config.at(entity_name).energy_regen;
+  _health_regeneration = prototype_->health_regen;
+  _energy_regeneration = prototype_->energy_regen;
 }
 
 Kit::~Kit() { }
@@ -26,7 +26,7 @@ class Kit : public ServerEntity {
     Controller* controller,
     uint32_t id,
     const b2Vec2& position,
-    const std::string& entity_name);
+    uint32_t prototype_id);
   virtual ~Kit();
 
   virtual void GetSnapshot(int64_t time, EntitySnapshot* output);
@@ -0,0 +1,101 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "server/lobby.h"
+
+#include <cstdio>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+#include "engine/protocol.h"
+
+#include "server/client_command.h"
+#include "server/traffic_log.h"
+
+namespace bm {
+
+Lobby::Lobby() { }
+Lobby::~Lobby() { }
+
+size_t Lobby::AddRoom(const std::string& name) {
+  CHECK(FindRoom(name.c_str()) == NO_ROOM);
+  names_.push_back(name);
+  client_counts_.push_back(0);
+  return names_.size() - 1;
+}
+
+size_t Lobby::GetRoomCount() const {
+  return names_.size();
+}
+
+size_t Lobby::GetRoom(uint32_t client_id) const {
+  std::map<uint32_t, size_t>::const_iterator itr =
+      client_rooms_.find(client_id);
+  return (itr != client_rooms_.end()) ? itr->second : NO_ROOM;
+}
+
+size_t Lobby::Route(TrafficEvent::Type type, uint32_t client_id,
+    const ClientCommand& command, bool* drop_client) {
+  CHECK(drop_client != NULL);
+  *drop_client = false;
+
+  size_t room = GetRoom(client_id);
+
+  switch (type) {
+    case TrafficEvent::TYPE_CONNECT:
+      // The client picks a room when it logs in.
+      return NO_ROOM;
+
+    case TrafficEvent::TYPE_DISCONNECT:
+      if (room != NO_ROOM) {
+        client_counts_[room]--;
+        client_rooms_.erase(client_id);
+      }
+      return room;
+
+    case TrafficEvent::TYPE_RECEIVE:
+      if (room != NO_ROOM || command.type != Packet::TYPE_LOGIN) {
+        // The room ignores messages sent before logging in.
+        return room;
+      }
+      break;
+  }
+
+  CHECK(!names_.empty());
+  if (command.login.room[0] != '\0') {
+    room = FindRoom(command.login.room);
+    if (room == NO_ROOM) {
+      printf("#%u: Room '%s' not found, client dropped.\n", client_id,
+          command.login.room);
+      *drop_client = true;
+      return NO_ROOM;
+    }
+  } else {
+    room = 0;
+    for (size_t i = 1; i < client_counts_.size(); i++) {
+      if (client_counts_[i] < client_counts_[room]) {
+        room = i;
+      }
+    }
+  }
+
+  client_counts_[room]++;
+  client_rooms_[client_id] = room;
+  printf("#%u: Client joined room '%s'.\n", client_id, names_[room].c_str());
+  return room;
+}
+
+size_t Lobby::FindRoom(const char* name) const {
+  for (size_t i = 0; i < names_.size(); i++) {
+    if (names_[i] == name) {
+      return i;
+    }
+  }
+  return NO_ROOM;
+}
+
+}  // namespace bm
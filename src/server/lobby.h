@@ -0,0 +1,54 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef SERVER_LOBBY_H_
+#define SERVER_LOBBY_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+#include "server/client_command.h"
+#include "server/traffic_log.h"
+
+namespace bm {
+
+// Routes the client events to the rooms. A client joins a room when it
+// logs in, either the one it has asked for by name or the one with the
+// fewest clients, and leaves it when it disconnects. The same routing is
+// done when the traffic is replayed, so the rooms get the same events.
+class Lobby {
+ public:
+  static const size_t NO_ROOM = static_cast<size_t>(-1);
+
+  Lobby();
+  ~Lobby();
+
+  // Returns the index of the room.
+  size_t AddRoom(const std::string& name);
+  size_t GetRoomCount() const;
+
+  // Returns the room the client has joined or 'NO_ROOM'.
+  size_t GetRoom(uint32_t client_id) const;
+
+  // Returns the room the event should be passed to or 'NO_ROOM' if it
+  // should be dropped. 'command' is only used for 'TYPE_RECEIVE' events.
+  // Sets '*drop_client' if the client should be disconnected.
+  size_t Route(TrafficEvent::Type type, uint32_t client_id,
+      const ClientCommand& command, bool* drop_client);
+
+ private:
+  size_t FindRoom(const char* name) const;
+
+  std::vector<std::string> names_;
+  std::vector<size_t> client_counts_;
+  std::map<uint32_t, size_t> client_rooms_;
+
+  DISALLOW_COPY_AND_ASSIGN(Lobby);
+};
+
+}  // namespace bm
+
+#endif  // SERVER_LOBBY_H_
@@ -1,7 +1,9 @@
 // Copyright (c) 2013 Blowmorph Team
 
-#include <errno.h>
 #include <stdio.h>
+#include <string.h>
+
+#include <string>
 
 #include "base/ctrlc.h"
 
@@ -14,25 +16,58 @@ void CtrlCHandler() {
   global_stop_flag = true;
 }
 
+void PrintUsage(const char* program) {
+  printf("Usage: %s [--record <file> | --replay <file> [--realtime]]\n",
+      program);
+}
+
 int main(int argc, char** argv) {
+  std::string record_file;
+  std::string replay_file;
+  bool realtime = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      record_file = argv[++i];
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replay_file = argv[++i];
+    } else if (strcmp(argv[i], "--realtime") == 0) {
+      realtime = true;
+    } else {
+      PrintUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if ((!record_file.empty() && !replay_file.empty()) ||
+      (realtime && replay_file.empty())) {
+    PrintUsage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
   SetCtrlCHandler(&CtrlCHandler);
 
   bm::Server server;
 
-  if (!server.Initialize()) {
+  if (!server.Initialize(replay_file.empty(), record_file)) {
     bm::Error::Print();
     return EXIT_FAILURE;
   }
 
+  if (!replay_file.empty()) {
+    if (!server.Replay(replay_file, realtime)) {
+      bm::Error::Print();
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  if (!record_file.empty()) {
+    printf("Recording traffic to '%s'.\n", record_file.c_str());
+  }
+
   printf("Server started.\n");
 
   while (!global_stop_flag) {
     if (!server.Tick()) {
-      if (errno == EINTR) {
-        // 'recvmsg()' in 'enet_service_host()' failed on 'SIGINT'.
-        printf("\nCaught SIGINT while in enet_host_service().\n");
-        break;
-      }
       bm::Error::Print();
       return EXIT_FAILURE;
     }
@@ -0,0 +1,386 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "server/network_thread.h"
+
+#include <cerrno>
+#include <cstdio>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/error.h"
+#include "base/macros.h"
+#include "base/pstdint.h"
+#include "base/time.h"
+
+#include "net/enet.h"
+#include "net/packet_pool.h"
+#include "net/utils.h"
+
+#include "engine/protocol.h"
+#include "engine/wire_format.h"
+
+#include "server/client_command.h"
+#include "server/lobby.h"
+#include "server/traffic_log.h"
+
+namespace bm {
+
+NetworkThread::RoomQueues::RoomQueues()
+    : inbound(INBOUND_QUEUE_SIZE), outbound(OUTBOUND_QUEUE_SIZE),
+      packet_pool(PACKET_POOL_SIZE) { }
+
+NetworkThread::NetworkThread()
+    : host_(NULL), event_(NULL), sync_packet_pool_(SYNC_PACKET_POOL_SIZE),
+      stop_(false), failed_(false),
+      state_(STATE_FINALIZED) { }
+
+NetworkThread::~NetworkThread() {
+  if (state_ == STATE_INITIALIZED) {
+    Finalize();
+  }
+}
+
+bool NetworkThread::Initialize(uint16_t port, size_t max_clients,
+    const std::string& record_file, uint32_t random_seed) {
+  CHECK(state_ == STATE_FINALIZED);
+
+  if (!enet_.Initialize()) {
+    return false;
+  }
+
+  std::auto_ptr<ServerHost> host(enet_.CreateServerHost(port, max_clients,
+      CHANNEL_COUNT));
+  if (host.get() == NULL) {
+    return false;
+  }
+
+  std::auto_ptr<Event> event(enet_.CreateEvent());
+  if (event.get() == NULL) {
+    return false;
+  }
+
+  if (!record_file.empty() && !recorder_.Open(record_file, random_seed)) {
+    return false;
+  }
+
+  host_ = host.release();
+  event_ = event.release();
+
+  state_ = STATE_INITIALIZED;
+  return true;
+}
+
+void NetworkThread::Finalize() {
+  CHECK(state_ == STATE_INITIALIZED);
+  Stop();
+  delete event_;
+  event_ = NULL;
+  // Destroying the host releases the buffers of the packets in ENet,
+  // so it goes before the pools.
+  delete host_;
+  host_ = NULL;
+  recorder_.Close();
+  for (size_t i = 0; i < rooms_.size(); i++) {
+    DropRoomPackets(rooms_[i]);
+    delete rooms_[i];
+  }
+  rooms_.clear();
+  state_ = STATE_FINALIZED;
+}
+
+size_t NetworkThread::AddRoom(const std::string& name,
+    const WireFormat& format) {
+  CHECK(state_ == STATE_INITIALIZED);
+  CHECK(!thread_.joinable());
+  RoomQueues* room = new RoomQueues();
+  CHECK(room != NULL);
+  room->wire_format = format;
+  rooms_.push_back(room);
+  size_t index = lobby_.AddRoom(name);
+  CHECK(index == rooms_.size() - 1);
+  return index;
+}
+
+void NetworkThread::Start() {
+  CHECK(state_ == STATE_INITIALIZED);
+  CHECK(!rooms_.empty());
+  CHECK(!thread_.joinable());
+  stop_.store(false);
+  failed_.store(false);
+  thread_ = std::thread(&NetworkThread::Run, this);
+}
+
+void NetworkThread::Stop() {
+  if (thread_.joinable()) {
+    stop_.store(true);
+    thread_.join();
+  }
+}
+
+bool NetworkThread::HasFailed() const {
+  return failed_.load();
+}
+
+NetworkEvent* NetworkThread::FrontEvent(size_t room) {
+  return rooms_[room]->inbound.Front();
+}
+
+void NetworkThread::PopEvent(size_t room) {
+  rooms_[room]->inbound.Pop();
+}
+
+OutboundPacket* NetworkThread::ReservePacket(size_t room) {
+  SpscQueue<OutboundPacket>* queue = &rooms_[room]->outbound;
+  OutboundPacket* packet = queue->Reserve();
+  while (packet == NULL) {
+    if (failed_.load()) {
+      return NULL;
+    }
+    std::this_thread::yield();
+    packet = queue->Reserve();
+  }
+  packet->buffer = rooms_[room]->packet_pool.Acquire();
+  return packet;
+}
+
+void NetworkThread::PushPacket(size_t room) {
+  rooms_[room]->outbound.Push();
+}
+
+const PacketPool& NetworkThread::GetPacketPool(size_t room) const {
+  return rooms_[room]->packet_pool;
+}
+
+void NetworkThread::Run() {
+  while (!stop_.load()) {
+    FlushOverflow();
+    if (!ReceiveEvents()) {
+      failed_.store(true);
+      return;
+    }
+    if (!SendPackets()) {
+      failed_.store(true);
+      return;
+    }
+  }
+}
+
+bool NetworkThread::ReceiveEvents() {
+  uint32_t timeout = SERVICE_TIMEOUT;
+  while (true) {
+    if (host_->Service(event_, timeout) == false) {
+      if (errno == EINTR) {
+        // 'recvmsg()' in 'enet_host_service()' failed on 'SIGINT'.
+        break;
+      }
+      return false;
+    }
+    if (event_->GetType() == Event::TYPE_NONE) {
+      break;
+    }
+    timeout = 0;
+
+    if (!HandleEvent()) {
+      return false;
+    }
+  }
+
+  if (recorder_.IsOpen()) {
+    recorder_.Flush();
+  }
+
+  return true;
+}
+
+bool NetworkThread::HandleEvent() {
+  int64_t time = Timestamp();
+  Peer* peer = event_->GetPeer();
+  uint32_t client_id = 0;
+  uint32_t round_trip_time = 0;
+  TrafficEvent::Type type = TrafficEvent::TYPE_CONNECT;
+
+  switch (event_->GetType()) {
+    case Event::TYPE_CONNECT: {
+      client_id = id_manager_.NewId();
+      peer->SetData(reinterpret_cast<void*>(client_id));
+      peers_[client_id] = peer;
+      message_ = PacketView();
+      printf("#%u: Client from %s:%u is trying to connect.\n", client_id,
+          peer->GetIp().c_str(), peer->GetPort());
+      type = TrafficEvent::TYPE_CONNECT;
+    } break;
+
+    case Event::TYPE_DISCONNECT: {
+      client_id = GetClientId(peer);
+      peers_.erase(client_id);
+      // The packets still queued for the client don't reach the next
+      // owner of the id index, its id is of another generation.
+      id_manager_.FreeId(client_id, 0);
+      id_manager_.ReleaseIds(0);
+      message_ = PacketView();
+      type = TrafficEvent::TYPE_DISCONNECT;
+    } break;
+
+    case Event::TYPE_RECEIVE: {
+      client_id = GetClientId(peer);
+      round_trip_time = peer->GetRoundTripTime();
+      message_ = event_->GetDataView();
+      type = TrafficEvent::TYPE_RECEIVE;
+    } break;
+
+    case Event::TYPE_NONE:
+      return true;
+  }
+
+  if (recorder_.IsOpen() &&
+      !recorder_.Record(type, time, client_id, round_trip_time, message_)) {
+    return false;
+  }
+
+  if (type == TrafficEvent::TYPE_RECEIVE) {
+    // Messages before login are decoded with the format of the first
+    // room, only logins are routed anyway and they are never packed.
+    size_t room = lobby_.GetRoom(client_id);
+    const WireFormat& format =
+        rooms_[(room != Lobby::NO_ROOM) ? room : 0]->wire_format;
+    if (!DecodeClientCommand(format, time, message_, &command_)) {
+      printf("#%u: Incorrect message format, client dropped.\n",
+          client_id);
+      peer->Disconnect();
+      return true;
+    }
+    if (command_.type == Packet::TYPE_SYNC_TIME_REQUEST) {
+      command_.sync.server_time = Timestamp();
+      bool rv = SendPacket(&sync_packet_pool_, peer,
+          Packet::TYPE_SYNC_TIME_RESPONSE, command_.sync);
+      if (rv == false) {
+        return false;
+      }
+      host_->Flush();
+      return true;
+    }
+  }
+
+  bool drop_client = false;
+  size_t room = lobby_.Route(type, client_id, command_, &drop_client);
+  if (drop_client) {
+    peer->Disconnect();
+  }
+  if (room != Lobby::NO_ROOM) {
+    PushEvent(room, peer, type, time, client_id, round_trip_time, command_);
+  }
+
+  return true;
+}
+
+void NetworkThread::PushEvent(size_t room, Peer* peer,
+    TrafficEvent::Type type, int64_t time, uint32_t client_id,
+    uint32_t round_trip_time, const ClientCommand& command) {
+  RoomQueues* queues = rooms_[room];
+  NetworkEvent* event = NULL;
+  if (queues->overflow.empty()) {
+    event = queues->inbound.Reserve();
+  }
+  bool overflowed = (event == NULL);
+  if (overflowed) {
+    // The room is behind. Its clients' messages can't wait without
+    // stalling every other room, but the room has to see every client
+    // come and go.
+    if (type == TrafficEvent::TYPE_RECEIVE) {
+      printf("#%u: Room is overloaded, client dropped.\n", client_id);
+      peer->Disconnect();
+      return;
+    }
+    queues->overflow.push_back(NetworkEvent());
+    event = &queues->overflow.back();
+  }
+  event->type = type;
+  event->time = time;
+  event->client_id = client_id;
+  event->round_trip_time = round_trip_time;
+  event->command = command;
+  if (!overflowed) {
+    queues->inbound.Push();
+  }
+}
+
+void NetworkThread::FlushOverflow() {
+  for (size_t i = 0; i < rooms_.size(); i++) {
+    RoomQueues* queues = rooms_[i];
+    while (!queues->overflow.empty()) {
+      NetworkEvent* event = queues->inbound.Reserve();
+      if (event == NULL) {
+        break;
+      }
+      *event = queues->overflow.front();
+      queues->inbound.Push();
+      queues->overflow.pop_front();
+    }
+  }
+}
+
+bool NetworkThread::SendPackets() {
+  bool sent = false;
+  for (size_t i = 0; i < rooms_.size(); i++) {
+    if (!SendRoomPackets(rooms_[i], &sent)) {
+      return false;
+    }
+  }
+  if (sent) {
+    host_->Flush();
+  }
+  return true;
+}
+
+bool NetworkThread::SendRoomPackets(RoomQueues* room, bool* sent) {
+  CHECK(sent != NULL);
+  OutboundPacket* packet;
+  while ((packet = room->outbound.Front()) != NULL) {
+    // The client may have disconnected since the packet was queued.
+    std::map<uint32_t, Peer*>::iterator peer = peers_.find(packet->client_id);
+    if (peer == peers_.end()) {
+      room->packet_pool.Release(packet->buffer);
+      room->outbound.Pop();
+      continue;
+    }
+    switch (packet->type) {
+      case OutboundPacket::TYPE_SEND: {
+        // The buffer is released by ENet from now on.
+        PacketBuffer* buffer = packet->buffer;
+        Packet::Type packet_type = packet->packet_type;
+        room->outbound.Pop();
+        if (!SendBuffer(peer->second, packet_type, buffer)) {
+          return false;
+        }
+        *sent = true;
+      } break;
+
+      case OutboundPacket::TYPE_DISCONNECT: {
+        peer->second->Disconnect();
+        room->packet_pool.Release(packet->buffer);
+        room->outbound.Pop();
+      } break;
+    }
+  }
+  return true;
+}
+
+void NetworkThread::DropRoomPackets(RoomQueues* room) {
+  OutboundPacket* packet;
+  while ((packet = room->outbound.Front()) != NULL) {
+    room->packet_pool.Release(packet->buffer);
+    room->outbound.Pop();
+  }
+}
+
+uint32_t NetworkThread::GetClientId(Peer* peer) {
+  void* peer_data = peer->GetData();
+  // So complicated to make it work under both x32 and x64.
+  return static_cast<uint32_t>(reinterpret_cast<size_t>(peer_data));
+}
+
+}  // namespace bm
@@ -0,0 +1,175 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef SERVER_NETWORK_THREAD_H_
+#define SERVER_NETWORK_THREAD_H_
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/id_manager.h"
+#include "base/macros.h"
+#include "base/pstdint.h"
+#include "base/spsc_queue.h"
+
+#include "net/enet.h"
+#include "net/packet_pool.h"
+
+#include "engine/protocol.h"
+#include "engine/wire_format.h"
+
+#include "server/client_command.h"
+#include "server/lobby.h"
+#include "server/traffic_log.h"
+
+namespace bm {
+
+// Passed from the network thread to a room.
+struct NetworkEvent {
+  TrafficEvent::Type type;
+  // Server time of the event in ms.
+  int64_t time;
+  uint32_t client_id;
+  // Set for 'TYPE_RECEIVE' events.
+  uint32_t round_trip_time;
+  ClientCommand command;
+};
+
+// Passed from a room to the network thread.
+struct OutboundPacket {
+  enum Type {
+    TYPE_SEND,
+    TYPE_DISCONNECT
+  };
+
+  Type type;
+  uint32_t client_id;
+  // The encoded packet for 'TYPE_SEND', which is sent on the channel
+  // of 'packet_type'. The buffer is attached by 'ReservePacket()' and
+  // owned by the network thread once the packet is pushed.
+  Packet::Type packet_type;
+  PacketBuffer* buffer;
+};
+
+// Services the ENet host on its own thread, so the simulation doesn't delay
+// acknowledgements, time synchronization and packet sends. Received
+// messages are decoded and recorded here, malformed ones get their client
+// dropped. Time sync requests are answered right away and never reach the
+// rooms. The other events are routed to the rooms by the lobby, every room
+// has its own pair of queues. The thread never waits for a room: when its
+// inbound queue is full, the messages for it are dropped along with their
+// clients, and connects and disconnects wait in an overflow list.
+class NetworkThread {
+ public:
+  NetworkThread();
+  ~NetworkThread();
+
+  // The inbound traffic is recorded to 'record_file' unless it's empty,
+  // along with the 'random_seed' of the rooms.
+  bool Initialize(uint16_t port, size_t max_clients,
+      const std::string& record_file, uint32_t random_seed);
+  void Finalize();
+
+  // Adds a room with its wire format before 'Start()'. Returns the index
+  // of the room, which is also its index in the lobby.
+  size_t AddRoom(const std::string& name, const WireFormat& format);
+
+  void Start();
+  void Stop();
+
+  // Set once the thread has stopped on an error. 'Stop()' should be called
+  // before the error is printed.
+  bool HasFailed() const;
+
+  // Room thread side. The events are read in place and released with
+  // 'PopEvent()'.
+  NetworkEvent* FrontEvent(size_t room);
+  void PopEvent(size_t room);
+
+  // Room thread side. Waits while the outbound queue is full and returns
+  // the packet to fill, which is sent after 'PushPacket()'. Returns 'NULL'
+  // if the thread has failed.
+  OutboundPacket* ReservePacket(size_t room);
+  void PushPacket(size_t room);
+
+  // Room thread side. The pool the buffers of the room's packets are
+  // acquired from, for its counters.
+  const PacketPool& GetPacketPool(size_t room) const;
+
+ private:
+  static const size_t INBOUND_QUEUE_SIZE = 1024;
+  static const size_t OUTBOUND_QUEUE_SIZE = 4096;
+  // Enough for the queued packets and the ones waiting to be sent by ENet.
+  static const size_t PACKET_POOL_SIZE = 2 * OUTBOUND_QUEUE_SIZE;
+  static const size_t SYNC_PACKET_POOL_SIZE = 256;
+  // How long servicing the host may block while there is nothing to send.
+  static const uint32_t SERVICE_TIMEOUT = 1;
+
+  struct RoomQueues {
+    RoomQueues();
+
+    WireFormat wire_format;
+    SpscQueue<NetworkEvent> inbound;
+    // Events that didn't fit into 'inbound', passed on in order before
+    // any new ones.
+    std::deque<NetworkEvent> overflow;
+    SpscQueue<OutboundPacket> outbound;
+    // Acquired from by the room, released to by ENet.
+    PacketPool packet_pool;
+  };
+
+  void Run();
+
+  // Services the host until there are no events left.
+  bool ReceiveEvents();
+  bool HandleEvent();
+  // Passes the event to the room. A message that doesn't fit is dropped
+  // and 'peer' is disconnected.
+  void PushEvent(size_t room, Peer* peer, TrafficEvent::Type type,
+      int64_t time, uint32_t client_id, uint32_t round_trip_time,
+      const ClientCommand& command);
+  // Moves the overflowed events into the room queues while there is space.
+  void FlushOverflow();
+  bool SendPackets();
+  // Sets '*sent' if any packets were sent.
+  bool SendRoomPackets(RoomQueues* room, bool* sent);
+  // Releases the buffers of the packets that were never sent.
+  void DropRoomPackets(RoomQueues* room);
+
+  static uint32_t GetClientId(Peer* peer);
+
+  Enet enet_;
+  ServerHost* host_;
+  Event* event_;
+  // For the time sync responses, which are sent by this thread.
+  PacketPool sync_packet_pool_;
+
+  IdManager id_manager_;
+  std::map<uint32_t, Peer*> peers_;
+
+  TrafficRecorder recorder_;
+  // Borrowed from the current event, empty unless it's 'TYPE_RECEIVE'.
+  PacketView message_;
+  ClientCommand command_;
+
+  Lobby lobby_;
+  std::vector<RoomQueues*> rooms_;
+
+  std::thread thread_;
+  std::atomic<bool> stop_;
+  std::atomic<bool> failed_;
+
+  enum {
+    STATE_FINALIZED,
+    STATE_INITIALIZED
+  } state_;
+
+  DISALLOW_COPY_AND_ASSIGN(NetworkThread);
+};
+
+}  // namespace bm
+
+#endif  // SERVER_NETWORK_THREAD_H_
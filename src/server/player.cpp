@@ -22,22 +22,23 @@ namespace bm {
 
 Player::Player(
     Controller* controller,
-    std::string entity_name,
+    uint32_t prototype_id,
     uint32_t id,
     const b2Vec2& position
-) : ServerEntity(controller, id, Entity::TYPE_PLAYER, entity_name, position,
+) : ServerEntity(controller, id, Entity::TYPE_PLAYER, prototype_id, position,
         Entity::FILTER_PLAYER, Entity::FILTER_ALL & ~Entity::FILTER_PLAYER) {
-  auto config = Config::GetInstance()->GetPlayersConfig();
-  CHECK(config.count(entity_name) == 1);
-  _speed = config.at(entity_name).speed;
+  _speed = prototype_->speed;
   _score = 0;
   _killer_id = ServerEntity::BAD_ID;
-  _max_health = config.at(entity_name).health_max;
-  _health_regeneration = config.at(entity_name).health_regen;
+  _max_health = prototype_->health_max;
+  _health_regeneration = prototype_->health_regen;
   _health = _max_health;
-  _energy_capacity = config.at(entity_name).energy_max;
-  _energy_regeneration = config.at(entity_name).energy_regen;
+  _energy_capacity = prototype_->energy_max;
+  _energy_regeneration = prototype_->energy_regen;
   _energy = _energy_capacity;
+  _input_sequence = 0;
+  _round_trip_time = 0;
+  _interpolation_delay = -1;
 }
 
 Player::~Player() { }
@@ -48,6 +49,7 @@ void Player::GetSnapshot(int64_t time, EntitySnapshot* output) {
   output->data[0] = _health;
   output->data[1] = _energy;
   output->data[2] = _score;
+  output->data[3] = static_cast<int32_t>(_input_sequence);
 }
 
 void Player::Damage(int damage, uint32_t source_id) {
@@ -134,6 +136,28 @@ void Player::OnKeyboardEvent(const KeyboardEvent& event) {
   }
 }
 
+bool Player::OnInputCommand(const InputCommand& command) {
+  if (_input_sequence != 0 &&
+      static_cast<int32_t>(command.sequence - _input_sequence) <= 0) {
+    return false;
+  }
+  _input_sequence = command.sequence;
+  _interpolation_delay = command.interpolation_delay;
+
+  _keyboard_state.up = (command.keys & (1u << KeyboardEvent::KEY_UP)) != 0;
+  _keyboard_state.down =
+      (command.keys & (1u << KeyboardEvent::KEY_DOWN)) != 0;
+  _keyboard_state.right =
+      (command.keys & (1u << KeyboardEvent::KEY_RIGHT)) != 0;
+  _keyboard_state.left =
+      (command.keys & (1u << KeyboardEvent::KEY_LEFT)) != 0;
+  _keyboard_update_time.up = command.time;
+  _keyboard_update_time.down = command.time;
+  _keyboard_update_time.right = command.time;
+  _keyboard_update_time.left = command.time;
+  return true;
+}
+
 float Player::GetSpeed() const {
   return _speed;
 }
@@ -152,6 +176,17 @@ uint32_t Player::GetKillerId() const {
   return _killer_id;
 }
 
+int64_t Player::GetRoundTripTime() const {
+  return _round_trip_time;
+}
+void Player::SetRoundTripTime(int64_t round_trip_time) {
+  _round_trip_time = round_trip_time;
+}
+
+int64_t Player::GetInterpolationDelay() const {
+  return _interpolation_delay;
+}
+
 Player::KeyboardState* Player::GetKeyboardState() {
   return &_keyboard_state;
 }
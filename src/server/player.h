@@ -40,7 +40,7 @@ class Player : public ServerEntity {
   };
 
  public:
-  Player(Controller* controller, std::string entity_name,
+  Player(Controller* controller, uint32_t prototype_id,
     uint32_t id, const b2Vec2& position);
   virtual ~Player();
 
@@ -48,6 +48,9 @@ class Player : public ServerEntity {
   virtual void Damage(int damage, uint32_t source_id);
 
   void OnKeyboardEvent(const KeyboardEvent& event);
+  // Applies the key state of the command. Returns 'false' if the command
+  // is older than the last applied one and should be ignored.
+  bool OnInputCommand(const InputCommand& command);
 
   float GetSpeed() const;
   void SetSpeed(float speed);
@@ -57,6 +60,14 @@ class Player : public ServerEntity {
 
   uint32_t GetKillerId() const;
 
+  // Round trip time to the client in ms.
+  int64_t GetRoundTripTime() const;
+  void SetRoundTripTime(int64_t round_trip_time);
+
+  // Interpolation delay of the client in ms from the last applied
+  // 'InputCommand', -1 if none.
+  int64_t GetInterpolationDelay() const;
+
   KeyboardState* GetKeyboardState();
 
   void Regenerate(int64_t delta_time);
@@ -101,6 +112,11 @@ class Player : public ServerEntity {
 
   KeyboardState _keyboard_state;
   KeyboardUpdateTime _keyboard_update_time;
+  // Sequence number of the last applied 'InputCommand', 0 if none.
+  uint32_t _input_sequence;
+
+  int64_t _round_trip_time;
+  int64_t _interpolation_delay;
 
   int _max_health;
   int _health_regeneration;  // Points per ms.
@@ -0,0 +1,151 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "server/position_history.h"
+
+#include <cmath>
+
+#include <algorithm>
+#include <vector>
+
+#include <Box2D/Box2D.h>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+#include "engine/entity.h"
+#include "engine/world.h"
+
+namespace bm {
+
+PositionHistory::PositionHistory()
+    : next_(0), size_(0), before_(NULL), after_(NULL), alpha_(0.0f),
+      max_displacement_(0.0f) { }
+
+PositionHistory::~PositionHistory() { }
+
+void PositionHistory::Reset(size_t capacity) {
+  CHECK(capacity > 0);
+  steps_.resize(capacity);
+  next_ = 0;
+  size_ = 0;
+  before_ = NULL;
+  after_ = NULL;
+}
+
+void PositionHistory::Record(int64_t time, const EntityMap& entities,
+    Entity::Type type) {
+  CHECK(!steps_.empty());
+  Step* step = &steps_[next_];
+  step->time = time;
+  step->positions.clear();
+  EntityMap::const_iterator i;
+  for (i = entities.begin(); i != entities.end(); ++i) {
+    if (i->second->GetType() != type) {
+      continue;
+    }
+    Position position;
+    position.id = i->first;
+    position.position = i->second->GetPosition();
+    step->positions.push_back(position);
+  }
+  std::sort(step->positions.begin(), step->positions.end(), HasLowerId);
+  step->max_displacement = 0.0f;
+  if (size_ > 0 && steps_.size() > 1) {
+    size_t previous = (next_ + steps_.size() - 1) % steps_.size();
+    step->max_displacement = GetMaxDisplacement(steps_[previous], *step);
+  }
+  next_ = (next_ + 1) % steps_.size();
+  size_ = std::min(size_ + 1, steps_.size());
+  before_ = NULL;
+  after_ = NULL;
+}
+
+bool PositionHistory::Rewind(int64_t time) {
+  before_ = NULL;
+  after_ = NULL;
+  max_displacement_ = 0.0f;
+  // Walk back from the newest step.
+  for (size_t i = 0; i < size_; i++) {
+    size_t index = (next_ + steps_.size() - 1 - i) % steps_.size();
+    const Step* step = &steps_[index];
+    if (step->time <= time) {
+      before_ = step;
+      break;
+    }
+    after_ = step;
+    max_displacement_ += step->max_displacement;
+  }
+  if (before_ == NULL) {
+    after_ = NULL;
+    return false;
+  }
+  alpha_ = 0.0f;
+  if (after_ != NULL) {
+    alpha_ = static_cast<float32_t>(time - before_->time) /
+        static_cast<float32_t>(after_->time - before_->time);
+  }
+  return true;
+}
+
+bool PositionHistory::GetPosition(uint32_t id, b2Vec2* position) const {
+  CHECK(position != NULL);
+  if (before_ == NULL) {
+    return false;
+  }
+  size_t index = Find(*before_, id);
+  if (index == before_->positions.size()) {
+    return false;
+  }
+  *position = before_->positions[index].position;
+  if (after_ != NULL) {
+    size_t next_index = Find(*after_, id);
+    if (next_index != after_->positions.size()) {
+      b2Vec2 next = after_->positions[next_index].position;
+      *position += alpha_ * (next - *position);
+    }
+  }
+  return true;
+}
+
+float32_t PositionHistory::GetMaxDisplacement() const {
+  return max_displacement_;
+}
+
+bool PositionHistory::HasLowerId(const Position& a, const Position& b) {
+  return a.id < b.id;
+}
+
+size_t PositionHistory::Find(const Step& step, uint32_t id) {
+  Position key;
+  key.id = id;
+  std::vector<Position>::const_iterator i = std::lower_bound(
+      step.positions.begin(), step.positions.end(), key, HasLowerId);
+  if (i == step.positions.end() || i->id != id) {
+    return step.positions.size();
+  }
+  return static_cast<size_t>(i - step.positions.begin());
+}
+
+float32_t PositionHistory::GetMaxDisplacement(const Step& from,
+    const Step& to) {
+  // Both steps are sorted by id.
+  float32_t max_distance2 = 0.0f;
+  size_t i = 0, j = 0;
+  while (i < from.positions.size() && j < to.positions.size()) {
+    if (from.positions[i].id < to.positions[j].id) {
+      i++;
+    } else if (to.positions[j].id < from.positions[i].id) {
+      j++;
+    } else {
+      float32_t distance2 =
+          (to.positions[j].position - from.positions[i].position)
+          .LengthSquared();
+      max_distance2 = std::max(max_distance2, distance2);
+      i++;
+      j++;
+    }
+  }
+  return std::sqrt(max_distance2);
+}
+
+}  // namespace bm
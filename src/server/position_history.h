@@ -0,0 +1,82 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef SERVER_POSITION_HISTORY_H_
+#define SERVER_POSITION_HISTORY_H_
+
+#include <vector>
+
+#include <Box2D/Box2D.h>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+#include "engine/entity.h"
+#include "engine/world.h"
+
+namespace bm {
+
+// The positions of the dynamic entities of one type after each of the
+// last simulation steps, used to see the world as a lagging client saw
+// it. Every step is stored as an array sorted by entity id, which is
+// reused once the history wraps around, so recording and lookups don't
+// allocate.
+class PositionHistory {
+ public:
+  PositionHistory();
+  ~PositionHistory();
+
+  // Keeps the last 'capacity' steps and drops the recorded ones.
+  void Reset(size_t capacity);
+
+  // Records the positions of the 'entities' of 'type' after the step that
+  // ended at 'time'. The steps are recorded in order.
+  void Record(int64_t time, const EntityMap& entities, Entity::Type type);
+
+  // Selects the recorded steps around 'time' for 'GetPosition()'.
+  // Returns 'false' if nothing is recorded at or before 'time'.
+  bool Rewind(int64_t time);
+  // Sets '*position' to the position of the entity 'id' at the rewound
+  // time, interpolated between the steps. Returns 'false' if the entity
+  // wasn't recorded then.
+  bool GetPosition(uint32_t id, b2Vec2* position) const;
+  // Returns how far at most a recorded entity moved from the rewound time
+  // to the newest step, so the entities around a rewound point can be
+  // found around it in the present.
+  float32_t GetMaxDisplacement() const;
+
+ private:
+  struct Position {
+    uint32_t id;
+    b2Vec2 position;
+  };
+  struct Step {
+    int64_t time;
+    std::vector<Position> positions;
+    // The farthest an entity moved since the previous step.
+    float32_t max_displacement;
+  };
+
+  static bool HasLowerId(const Position& a, const Position& b);
+  // Returns the index of 'id' in 'step' or 'step.positions.size()'.
+  static size_t Find(const Step& step, uint32_t id);
+  // Returns the farthest an entity present in both steps moved.
+  static float32_t GetMaxDisplacement(const Step& from, const Step& to);
+
+  std::vector<Step> steps_;
+  // Index of the next step to record and the number of recorded ones.
+  size_t next_;
+  size_t size_;
+
+  // Set by 'Rewind()'. 'after_' is 'NULL' if the time is past the newest
+  // step.
+  const Step* before_;
+  const Step* after_;
+  float32_t alpha_;
+  float32_t max_displacement_;
+
+  DISALLOW_COPY_AND_ASSIGN(PositionHistory);
+};
+
+}  // namespace bm
+
+#endif  // SERVER_POSITION_HISTORY_H_
@@ -0,0 +1,186 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "server/profiler.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <string>
+
+#include <Box2D/Box2D.h>
+
+#include "base/error.h"
+#include "base/macros.h"
+#include "base/pstdint.h"
+#include "base/time.h"
+
+namespace bm {
+
+Profiler::Profiler() : output_(NULL), report_period_(0), last_report_(0) {
+  Reset();
+}
+
+Profiler::~Profiler() {
+  Finalize();
+}
+
+bool Profiler::Initialize(const std::string& file, int64_t report_period,
+    const std::string& room) {
+  CHECK(output_ == NULL);
+  CHECK(report_period > 0);
+  if (file.empty()) {
+    output_ = stdout;
+  } else {
+    output_ = fopen(file.c_str(), "a");
+    if (output_ == NULL) {
+      REPORT_ERROR("Can't open profile file '%s'.", file.c_str());
+      return false;
+    }
+  }
+  report_period_ = report_period;
+  room_ = room;
+  last_report_ = Timestamp();
+  Reset();
+  return true;
+}
+
+void Profiler::Finalize() {
+  if (output_ != NULL && output_ != stdout) {
+    fclose(output_);
+  }
+  output_ = NULL;
+}
+
+void Profiler::Record(Phase phase, int64_t microseconds) {
+  CHECK(0 <= phase && phase < PHASE_COUNT);
+  microseconds = std::max(microseconds, static_cast<int64_t>(0));
+  PhaseStats* stats = &stats_[phase];
+  if (stats->count == 0 || microseconds < stats->min) {
+    stats->min = microseconds;
+  }
+  if (stats->count == 0 || microseconds > stats->max) {
+    stats->max = microseconds;
+  }
+  stats->count++;
+  stats->total += microseconds;
+  stats->buckets[GetBucket(microseconds)]++;
+}
+
+void Profiler::RecordBox2DProfile(const b2Profile& profile) {
+  // Box2D measures the phases in milliseconds.
+  Record(PHASE_B2_COLLIDE, static_cast<int64_t>(profile.collide * 1000));
+  Record(PHASE_B2_SOLVE, static_cast<int64_t>(profile.solve * 1000));
+  Record(PHASE_B2_SOLVE_INIT,
+      static_cast<int64_t>(profile.solveInit * 1000));
+  Record(PHASE_B2_SOLVE_VELOCITY,
+      static_cast<int64_t>(profile.solveVelocity * 1000));
+  Record(PHASE_B2_SOLVE_POSITION,
+      static_cast<int64_t>(profile.solvePosition * 1000));
+  Record(PHASE_B2_BROADPHASE,
+      static_cast<int64_t>(profile.broadphase * 1000));
+  Record(PHASE_B2_SOLVE_TOI, static_cast<int64_t>(profile.solveTOI * 1000));
+}
+
+void Profiler::ReportIfNeeded(int64_t time) {
+  if (output_ == NULL || time - last_report_ < report_period_) {
+    return;
+  }
+
+  for (int phase = 0; phase < PHASE_COUNT; phase++) {
+    const PhaseStats& stats = stats_[phase];
+    if (stats.count == 0) {
+      continue;
+    }
+
+    int64_t p99 = stats.max;
+    int64_t threshold = stats.count - stats.count / 100;
+    int64_t seen = 0;
+    for (int bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+      seen += stats.buckets[bucket];
+      if (seen >= threshold) {
+        p99 = std::min(GetBucketUpperBound(bucket), stats.max);
+        break;
+      }
+    }
+
+    fprintf(output_, "{\"room\": \"%s\", \"time\": %ld, \"period\": %ld, "
+        "\"phase\": \"%s\", \"count\": %ld, \"min_us\": %ld, "
+        "\"avg_us\": %ld, \"p99_us\": %ld, \"max_us\": %ld}\n",
+        room_.c_str(), time, time - last_report_,
+        GetPhaseName(static_cast<Phase>(phase)),
+        stats.count, stats.min, stats.total / stats.count, p99, stats.max);
+  }
+  fflush(output_);
+
+  last_report_ = time;
+  Reset();
+}
+
+const char* Profiler::GetPhaseName(Phase phase) {
+  switch (phase) {
+    case PHASE_TICK_OVERRUN: return "tick_overrun";
+    case PHASE_PUMP_EVENTS: return "pump_events";
+    case PHASE_GAME_EVENTS: return "game_events";
+    case PHASE_SNAPSHOTS: return "snapshots";
+    case PHASE_UPDATE: return "update";
+    case PHASE_SPAWN_ZOMBIES: return "spawn_zombies";
+    case PHASE_UPDATE_ENTITIES: return "update_entities";
+    case PHASE_STEP_PHYSICS: return "step_physics";
+    case PHASE_B2_COLLIDE: return "b2_collide";
+    case PHASE_B2_SOLVE: return "b2_solve";
+    case PHASE_B2_SOLVE_INIT: return "b2_solve_init";
+    case PHASE_B2_SOLVE_VELOCITY: return "b2_solve_velocity";
+    case PHASE_B2_SOLVE_POSITION: return "b2_solve_position";
+    case PHASE_B2_BROADPHASE: return "b2_broadphase";
+    case PHASE_B2_SOLVE_TOI: return "b2_solve_toi";
+    case PHASE_DESTROY_OUTLYING_ENTITIES: return "destroy_outlying_entities";
+    case PHASE_RESPAWN_DEAD_PLAYERS: return "respawn_dead_players";
+    case PHASE_DELETE_DESTROYED_ENTITIES: return "delete_destroyed_entities";
+    case PHASE_UPDATE_INTEREST_GRID: return "update_interest_grid";
+    case PHASE_SLIME_EXPLOSIONS: return "slime_explosions";
+    case PHASE_COUNT: break;
+  }
+  CHECK(false);
+  return NULL;
+}
+
+int Profiler::GetBucket(int64_t microseconds) {
+  if (microseconds < SUBBUCKETS) {
+    return static_cast<int>(microseconds);
+  }
+  // 'exponent' is the position of the highest set bit, the two bits
+  // after it select the subbucket.
+  int exponent = 0;
+  while ((microseconds >> (exponent + 1)) != 0) {
+    exponent++;
+  }
+  int subbucket = static_cast<int>(microseconds >> (exponent - 2)) &
+      (SUBBUCKETS - 1);
+  int bucket = (exponent - 1) * SUBBUCKETS + subbucket;
+  return std::min(bucket, BUCKET_COUNT - 1);
+}
+
+int64_t Profiler::GetBucketUpperBound(int bucket) {
+  if (bucket < SUBBUCKETS) {
+    return bucket;
+  }
+  int exponent = bucket / SUBBUCKETS + 1;
+  int64_t subbucket = bucket % SUBBUCKETS;
+  return ((SUBBUCKETS + subbucket + 1) << (exponent - 2)) - 1;
+}
+
+void Profiler::Reset() {
+  memset(stats_, 0, sizeof(stats_));
+}
+
+ScopedPhaseTimer::ScopedPhaseTimer(Profiler* profiler, Profiler::Phase phase)
+    : profiler_(profiler), phase_(phase), start_(TimestampUs()) {
+  CHECK(profiler != NULL);
+}
+
+ScopedPhaseTimer::~ScopedPhaseTimer() {
+  profiler_->Record(phase_, TimestampUs() - start_);
+}
+
+}  // namespace bm
@@ -0,0 +1,111 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef SERVER_PROFILER_H_
+#define SERVER_PROFILER_H_
+
+#include <cstdio>
+
+#include <string>
+
+#include <Box2D/Box2D.h>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+namespace bm {
+
+// Collects the durations of the server tick phases and periodically
+// reports their min, average, 99th percentile and max over the last
+// period. Recording a duration only increments a few counters.
+class Profiler {
+ public:
+  enum Phase {
+    PHASE_TICK_OVERRUN,
+    PHASE_PUMP_EVENTS,
+    PHASE_GAME_EVENTS,
+    PHASE_SNAPSHOTS,
+    PHASE_UPDATE,
+    PHASE_SPAWN_ZOMBIES,
+    PHASE_UPDATE_ENTITIES,
+    PHASE_STEP_PHYSICS,
+    PHASE_B2_COLLIDE,
+    PHASE_B2_SOLVE,
+    PHASE_B2_SOLVE_INIT,
+    PHASE_B2_SOLVE_VELOCITY,
+    PHASE_B2_SOLVE_POSITION,
+    PHASE_B2_BROADPHASE,
+    PHASE_B2_SOLVE_TOI,
+    PHASE_DESTROY_OUTLYING_ENTITIES,
+    PHASE_RESPAWN_DEAD_PLAYERS,
+    PHASE_DELETE_DESTROYED_ENTITIES,
+    PHASE_UPDATE_INTEREST_GRID,
+    PHASE_SLIME_EXPLOSIONS,
+    PHASE_COUNT
+  };
+
+  Profiler();
+  ~Profiler();
+
+  // Reports are written as JSON lines to 'file' or to stdout if
+  // 'file' is empty. Every line is tagged with the 'room' name.
+  bool Initialize(const std::string& file, int64_t report_period,
+      const std::string& room);
+  void Finalize();
+
+  void Record(Phase phase, int64_t microseconds);
+  // Records the phases of the last 'b2World::Step()'.
+  void RecordBox2DProfile(const b2Profile& profile);
+
+  // Writes the report if 'report_period' has passed since the last one
+  // and starts a new period. 'time' is in milliseconds.
+  void ReportIfNeeded(int64_t time);
+
+  static const char* GetPhaseName(Phase phase);
+
+ private:
+  // Durations are put into buckets that grow exponentially with
+  // 'SUBBUCKETS' buckets per power of two, which keeps the percentiles
+  // within 25% of the real values.
+  static const int SUBBUCKETS = 4;
+  static const int BUCKET_COUNT = 40 * SUBBUCKETS;
+
+  static int GetBucket(int64_t microseconds);
+  static int64_t GetBucketUpperBound(int bucket);
+
+  struct PhaseStats {
+    int64_t count;
+    int64_t total;
+    int64_t min;
+    int64_t max;
+    uint32_t buckets[BUCKET_COUNT];
+  };
+
+  void Reset();
+
+  PhaseStats stats_[PHASE_COUNT];
+
+  FILE* output_;
+  std::string room_;
+  int64_t report_period_;
+  int64_t last_report_;
+
+  DISALLOW_COPY_AND_ASSIGN(Profiler);
+};
+
+// Records the time spent in its scope as 'phase'.
+class ScopedPhaseTimer {
+ public:
+  ScopedPhaseTimer(Profiler* profiler, Profiler::Phase phase);
+  ~ScopedPhaseTimer();
+
+ private:
+  Profiler* profiler_;
+  Profiler::Phase phase_;
+  int64_t start_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedPhaseTimer);
+};
+
+}  // namespace bm
+
+#endif  // SERVER_PROFILER_H_
@@ -25,12 +25,10 @@ Projectile::Projectile(
   uint32_t owner_id,
   const b2Vec2& start,
   const b2Vec2& end,
-  const std::string& entity_name
-) : ServerEntity(controller, id, Entity::TYPE_PROJECTILE, entity_name, start,
+  uint32_t prototype_id
+) : ServerEntity(controller, id, Entity::TYPE_PROJECTILE, prototype_id, start,
         Entity::FILTER_PROJECTILE, Entity::FILTER_ALL & ~Entity::FILTER_KIT) {
-  auto config = Config::GetInstance()->GetProjectilesConfig();
-  CHECK(config.count(entity_name) == 1);
-  float speed = config.at(entity_name).speed;
+  float speed = prototype_->speed;
 
   b2Vec2 velocity = end - start;
   velocity.Normalize();
@@ -42,17 +40,14 @@ Projectile::Projectile(
 
   owner_id_ = owner_id;
 
-  Config::ProjectileConfig::Type type = config.at(entity_name).type;
+  Config::ProjectileConfig::Type type = prototype_->projectile_type;
   if (type == Config::ProjectileConfig::TYPE_ROCKET) {
     type_ = TYPE_ROCKET;
-    rocket_explosion_radius_ = config.at(entity_name).
-        rocket_config.explosion_radius;
-    rocket_explosion_damage_ = config.at(entity_name).
-        rocket_config.explosion_damage;
+    rocket_explosion_radius_ = prototype_->rocket_config.explosion_radius;
+    rocket_explosion_damage_ = prototype_->rocket_config.explosion_damage;
   } else if (type == Config::ProjectileConfig::TYPE_SLIME) {
     type_ = TYPE_SLIME;
-    slime_explosion_radius_ = config.at(entity_name).
-        slime_config.explosion_radius;
+    slime_explosion_radius_ = prototype_->slime_config.explosion_radius;
   } else {
     CHECK(false);  // Unreachable.
   }
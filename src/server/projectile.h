@@ -33,7 +33,7 @@ class Projectile : public ServerEntity {
     uint32_t owner_id,
     const b2Vec2& start,
     const b2Vec2& end,
-    const std::string& entity_name);
+    uint32_t prototype_id);
   virtual ~Projectile();
 
   virtual void GetSnapshot(int64_t time, EntitySnapshot* output);
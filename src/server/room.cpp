@@ -0,0 +1,916 @@
+// Copyright (c) 2013 Blowmorph Team
+
+#include "server/room.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/bit_stream.h"
+#include "base/error.h"
+#include "base/macros.h"
+
+#include "base/pstdint.h"
+#include "base/time.h"
+#include "base/utils.h"
+
+#include "net/utils.h"
+
+#include "engine/config.h"
+#include "engine/protocol.h"
+#include "engine/snapshot_delta.h"
+#include "engine/wire_format.h"
+
+#include "server/client_command.h"
+#include "server/client_manager.h"
+#include "server/controller.h"
+#include "server/entity.h"
+#include "server/network_thread.h"
+#include "server/traffic_log.h"
+#include "server/world.h"
+
+#include "server/activator.h"
+#include "server/critter.h"
+#include "server/kit.h"
+#include "server/projectile.h"
+#include "server/player.h"
+#include "server/wall.h"
+
+namespace bm {
+
+Room::Room() : snapshot_sequence_(0), network_(NULL), room_index_(0),
+  stop_(false), failed_(false), controller_(&profiler_),
+  state_(STATE_FINALIZED) { }
+
+Room::~Room() {
+  if (state_ == STATE_INITIALIZED) {
+    Finalize();
+  }
+}
+
+static EntitySnapshot::EntityType GetSnapshotType(
+    Config::Prototype::Kind kind) {
+  switch (kind) {
+    case Config::Prototype::KIND_ACTIVATOR:
+      return EntitySnapshot::ENTITY_TYPE_ACTIVATOR;
+    case Config::Prototype::KIND_CRITTER:
+      return EntitySnapshot::ENTITY_TYPE_CRITTER;
+    case Config::Prototype::KIND_DOOR:
+      return EntitySnapshot::ENTITY_TYPE_DOOR;
+    case Config::Prototype::KIND_KIT:
+      return EntitySnapshot::ENTITY_TYPE_KIT;
+    case Config::Prototype::KIND_PLAYER:
+      return EntitySnapshot::ENTITY_TYPE_PLAYER;
+    case Config::Prototype::KIND_PROJECTILE:
+      return EntitySnapshot::ENTITY_TYPE_PROJECTILE;
+    case Config::Prototype::KIND_WALL:
+      return EntitySnapshot::ENTITY_TYPE_WALL;
+    default:
+      CHECK(false);  // Unreachable.
+      return EntitySnapshot::ENTITY_TYPE_UNKNOWN;
+  }
+}
+
+// The names are checked to fit when the config is loaded.
+static void BuildEntityKinds(std::vector<EntityKind>* kinds) {
+  const Config* config = Config::GetInstance();
+  kinds->resize(config->GetPrototypeCount());
+  for (size_t i = 0; i < kinds->size(); i++) {
+    const Config::Prototype& prototype =
+        config->GetPrototype(static_cast<uint32_t>(i));
+    EntityKind* kind = &(*kinds)[i];
+    kind->type = GetSnapshotType(prototype.kind);
+    CHECK(prototype.name.size() <= EntityKind::MAX_NAME_LENGTH);
+    std::copy(prototype.name.c_str(),
+        prototype.name.c_str() + prototype.name.size() + 1, &kind->name[0]);
+    CHECK(prototype.sprite_name.size() <= EntityKind::MAX_NAME_LENGTH);
+    std::copy(prototype.sprite_name.c_str(),
+        prototype.sprite_name.c_str() + prototype.sprite_name.size() + 1,
+        &kind->sprite_name[0]);
+  }
+}
+
+bool Room::Initialize(const std::string& name, const std::string& map,
+    const std::string& profile_file, NetworkThread* network) {
+  CHECK(state_ == STATE_FINALIZED);
+
+  const Config::ServerConfig& config =
+    Config::GetInstance()->GetServerConfig();
+
+  name_ = name;
+  network_ = network;
+
+  uint32_t update_rate = config.tick_rate;
+  update_timeout_ = 1000 / update_rate;
+  replaying_ = (network == NULL);
+  replay_time_ = 0;
+  last_update_ = GetTime();
+  update_accumulator_ = 0;
+  max_catch_up_steps_ = config.max_catch_up_steps;
+  report_stats_ = config.profile_stats;
+  tick_ = 0;
+  simulation_time_ = last_update_;
+
+  uint32_t broadcast_rate = config.broadcast_rate;
+  broadcast_timeout_ = 1000 / broadcast_rate;
+  last_broadcast_ = 0;
+
+  if (!profiler_.Initialize(profile_file, config.profile_report_period,
+      name)) {
+    return false;
+  }
+
+  if (!controller_.GetWorld()->LoadMap(map)) {
+    return false;
+  }
+
+  wire_format_.bound = controller_.GetWorld()->GetBound();
+  wire_format_.position_precision = config.position_precision;
+  for (auto name : config.packed_messages) {
+    Packet::Type type;
+    if (!WireFormat::GetPackableType(name, &type)) {
+      REPORT_ERROR("Message type '%s' can't be packed.", name.c_str());
+      return false;
+    }
+    wire_format_.SetPacked(type, true);
+  }
+
+  BuildEntityKinds(&entity_kinds_);
+
+  snapshot_bytes_ = 0;
+  snapshot_count_ = 0;
+  reported_allocation_count_ = 0;
+  reported_pool_misses_ = 0;
+  last_snapshot_report_ = GetTime();
+
+  if (network_ != NULL) {
+    room_index_ = network_->AddRoom(name_, wire_format_);
+  }
+
+  state_ = STATE_INITIALIZED;
+  return true;
+}
+
+void Room::Finalize() {
+  CHECK(state_ == STATE_INITIALIZED);
+  Stop();
+  profiler_.Finalize();
+  state_ = STATE_FINALIZED;
+}
+
+const std::string& Room::GetName() const {
+  return name_;
+}
+
+const WireFormat& Room::GetWireFormat() const {
+  return wire_format_;
+}
+
+uint32_t Room::GetTick() const {
+  return tick_;
+}
+
+void Room::Start(uint32_t random_seed) {
+  CHECK(state_ == STATE_INITIALIZED);
+  CHECK(!replaying_);
+  CHECK(!thread_.joinable());
+  controller_.SetRandomSeed(random_seed);
+  stop_.store(false);
+  failed_.store(false);
+  thread_ = std::thread(&Room::Run, this);
+}
+
+void Room::Stop() {
+  if (thread_.joinable()) {
+    stop_.store(true);
+    thread_.join();
+  }
+}
+
+bool Room::HasFailed() const {
+  return failed_.load();
+}
+
+void Room::StartReplay(int64_t start_time, uint32_t random_seed) {
+  CHECK(state_ == STATE_INITIALIZED);
+  CHECK(replaying_);
+  controller_.SetRandomSeed(random_seed);
+  replay_time_ = start_time;
+  last_update_ = start_time;
+  simulation_time_ = start_time;
+  last_broadcast_ = start_time;
+  last_snapshot_report_ = start_time;
+}
+
+void Room::SetReplayTime(int64_t time) {
+  CHECK(replaying_);
+  replay_time_ = time;
+}
+
+void Room::Run() {
+  while (!stop_.load()) {
+    if (!Tick()) {
+      failed_.store(true);
+      return;
+    }
+  }
+}
+
+bool Room::Tick() {
+  if (!Update()) {
+    return false;
+  }
+
+  {
+    ScopedPhaseTimer timer(&profiler_, Profiler::PHASE_PUMP_EVENTS);
+    if (!PumpEvents()) {
+      return false;
+    }
+  }
+
+  int64_t sleep_until = GetNextUpdateTime();
+  int64_t current_time = GetTime();
+
+  if (current_time <= sleep_until) {
+    // The events received meanwhile wait in the queue until the next step.
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(sleep_until - current_time));
+  } else {
+    printf("%s: Can't keep up, %ld ms behind!\n", name_.c_str(),
+        current_time - sleep_until);
+    profiler_.Record(Profiler::PHASE_TICK_OVERRUN,
+        (current_time - sleep_until) * 1000);
+  }
+
+  return true;
+}
+
+int64_t Room::GetTime() const {
+  return replaying_ ? replay_time_ : Timestamp();
+}
+
+int64_t Room::GetNextUpdateTime() const {
+  int64_t next_broadcast = last_broadcast_ + broadcast_timeout_;
+  int64_t next_update = last_update_ + update_timeout_ - update_accumulator_;
+  return std::min(next_broadcast, next_update);
+}
+
+bool Room::Update() {
+  int64_t current_time = GetTime();
+  if (current_time - last_broadcast_ >= broadcast_timeout_) {
+    // Game events are checked against the entities the clients could see
+    // before the snapshots update them.
+    {
+      ScopedPhaseTimer timer(&profiler_, Profiler::PHASE_GAME_EVENTS);
+      if (!SendGameEvents()) {
+        return false;
+      }
+    }
+    {
+      ScopedPhaseTimer timer(&profiler_, Profiler::PHASE_SNAPSHOTS);
+      snapshot_sequence_++;
+      world_snapshot_.clear();
+      SnapshotDynamicEntities(simulation_time_, &world_snapshot_);
+      static_updates_.clear();
+      SnapshotStaticEntities(simulation_time_, &static_updates_);
+      if (!SendWorldSnapshots(simulation_time_)) {
+        return false;
+      }
+      ReleaseEntityIds();
+    }
+    last_broadcast_ = current_time;
+  }
+
+  UpdateSimulation();
+
+  profiler_.ReportIfNeeded(current_time);
+
+  return true;
+}
+
+void Room::UpdateSimulation() {
+  int64_t current_time = GetTime();
+  update_accumulator_ += current_time - last_update_;
+  last_update_ = current_time;
+
+  // The entities removed now are missing from the next snapshot on.
+  controller_.GetWorld()->SetIdEpoch(snapshot_sequence_ + 1);
+
+  int32_t steps = 0;
+  while (update_accumulator_ >= update_timeout_ &&
+         steps < max_catch_up_steps_) {
+    controller_.Update(simulation_time_, update_timeout_);
+    simulation_time_ += update_timeout_;
+    update_accumulator_ -= update_timeout_;
+    tick_++;
+    steps++;
+  }
+
+  // Running more steps would only make the server fall further behind.
+  // The dropped time is skipped to keep the simulation time close to
+  // the server time the clients are synchronized with.
+  if (update_accumulator_ >= update_timeout_) {
+    int64_t dropped = update_accumulator_ -
+        update_accumulator_ % update_timeout_;
+    printf("%s: Can't keep up, dropped %ld ms of simulation!\n",
+        name_.c_str(), dropped);
+    simulation_time_ += dropped;
+    update_accumulator_ -= dropped;
+  }
+}
+
+void Room::ReportPoolMisses() {
+  ServerWorld* world = controller_.GetWorld();
+  uint64_t entity_hits = world->GetCritterPool().GetHitCount() +
+      world->GetProjectilePool().GetHitCount() +
+      world->GetWallPool().GetHitCount();
+  uint64_t entity_misses = world->GetCritterPool().GetMissCount() +
+      world->GetProjectilePool().GetMissCount() +
+      world->GetWallPool().GetMissCount();
+  uint64_t body_hits = world->GetBodyPool()->GetHitCount();
+  uint64_t body_misses = world->GetBodyPool()->GetMissCount();
+  if (entity_misses + body_misses == reported_pool_misses_) {
+    return;
+  }
+  printf("%s: Pools: entities %u hits, %u misses; bodies %u hits, "
+      "%u misses.\n", name_.c_str(),
+      static_cast<unsigned>(entity_hits), static_cast<unsigned>(entity_misses),
+      static_cast<unsigned>(body_hits), static_cast<unsigned>(body_misses));
+  reported_pool_misses_ = entity_misses + body_misses;
+}
+
+void Room::ReleaseEntityIds() {
+  // A client has seen the entities removed before the snapshots it has
+  // acknowledged, or before the first one sent to it, disappear.
+  // A client that stopped acknowledging would keep the ids forever. Once
+  // its last acknowledged snapshot has left the history it gets full
+  // snapshots, and it can only acknowledge the snapshots still kept, so
+  // the removals before them count as seen.
+  uint32_t last_evicted = snapshot_sequence_ - SnapshotHistory::SIZE;
+  uint32_t seen = snapshot_sequence_;
+  for (auto itr : *client_manager_.GetClients()) {
+    Client* client = itr.second;
+    if (client->first_snapshot == 0) {
+      continue;
+    }
+    uint32_t client_seen = (client->acked_snapshot != 0) ?
+        client->acked_snapshot : client->first_snapshot - 1;
+    if (static_cast<int32_t>(client_seen - last_evicted) < 0) {
+      client_seen = last_evicted;
+    }
+    if (static_cast<int32_t>(client_seen - seen) < 0) {
+      seen = client_seen;
+    }
+  }
+  controller_.GetWorld()->ReleaseIds(seen);
+}
+
+void Room::SnapshotDynamicEntities(int64_t time,
+    std::vector<EntitySnapshot>* output) {
+  for (auto itr : *controller_.GetWorld()->GetDynamicEntities()) {
+    ServerEntity* entity = static_cast<ServerEntity*>(itr.second);
+    output->push_back(EntitySnapshot());
+    entity->GetSnapshot(time, &output->back());
+  }
+  // The world doesn't keep the entities in id order.
+  SortEntitySnapshots(output);
+}
+
+void Room::SnapshotStaticEntities(int64_t time,
+    std::vector<EntitySnapshot>* output) {
+  for (auto itr : *controller_.GetWorld()->GetStaticEntities()) {
+    ServerEntity* entity = static_cast<ServerEntity*>(itr.second);
+    if (entity->IsUpdated()) {
+      output->push_back(EntitySnapshot());
+      entity->GetSnapshot(time, &output->back());
+      entity->SetUpdatedFlag(false);
+    }
+  }
+  SortEntitySnapshots(output);
+}
+
+void Room::UpdateInterest(Client* client,
+    std::vector<uint32_t>* entered_static,
+    std::vector<uint32_t>* left_static) {
+  CHECK(client != NULL);
+  CHECK(entered_static != NULL);
+  CHECK(left_static != NULL);
+
+  const Config::ServerConfig& config =
+    Config::GetInstance()->GetServerConfig();
+  float32_t radius = config.interest_radius;
+  float32_t outer_radius = radius + config.interest_hysteresis;
+
+  ServerWorld* world = controller_.GetWorld();
+  b2Vec2 center = client->entity->GetPosition();
+
+  interest_candidates_.clear();
+  world->GetInterestGrid()->Query(center, outer_radius,
+      &interest_candidates_);
+
+  visible_static_.clear();
+  visible_dynamic_.clear();
+  for (size_t i = 0; i < interest_candidates_.size(); i++) {
+    uint32_t id = interest_candidates_[i];
+    Entity* entity = world->GetEntity(id);
+    CHECK(entity != NULL);
+    const std::vector<uint32_t>& old_visible = entity->IsStatic() ?
+        client->visible_static : client->visible_dynamic;
+    float32_t distance = (entity->GetPosition() - center).Length();
+    // Entities near the border don't flicker in and out of the set.
+    if (distance <= radius || (distance <= outer_radius &&
+        std::binary_search(old_visible.begin(), old_visible.end(), id))) {
+      if (entity->IsStatic()) {
+        visible_static_.push_back(id);
+      } else {
+        visible_dynamic_.push_back(id);
+      }
+    }
+  }
+
+  // Players are always visible to keep the score table complete.
+  for (auto itr : *client_manager_.GetClients()) {
+    visible_dynamic_.push_back(itr.second->entity->GetId());
+  }
+
+  std::sort(visible_static_.begin(), visible_static_.end());
+  std::sort(visible_dynamic_.begin(), visible_dynamic_.end());
+  visible_dynamic_.erase(
+      std::unique(visible_dynamic_.begin(), visible_dynamic_.end()),
+      visible_dynamic_.end());
+
+  entered_static->clear();
+  std::set_difference(visible_static_.begin(), visible_static_.end(),
+      client->visible_static.begin(), client->visible_static.end(),
+      std::back_inserter(*entered_static));
+  left_static->clear();
+  std::set_difference(client->visible_static.begin(),
+      client->visible_static.end(), visible_static_.begin(),
+      visible_static_.end(), std::back_inserter(*left_static));
+
+  client->visible_static.swap(visible_static_);
+  client->visible_dynamic.swap(visible_dynamic_);
+}
+
+bool Room::SendWorldSnapshots(int64_t time) {
+  ServerWorld* world = controller_.GetWorld();
+
+  for (auto itr : *client_manager_.GetClients()) {
+    Client* client = itr.second;
+    if (!client->synchronized) {
+      continue;
+    }
+
+    UpdateInterest(client, &entered_static_, &left_static_);
+
+    // Dynamic entities. Both snapshots are sorted by id.
+    client_snapshot_.clear();
+    for (size_t i = 0; i < client->visible_dynamic.size(); i++) {
+      const EntitySnapshot* snapshot =
+          FindEntitySnapshot(world_snapshot_, client->visible_dynamic[i]);
+      CHECK(snapshot != NULL);
+      client_snapshot_.push_back(*snapshot);
+    }
+
+    const std::vector<EntitySnapshot>* baseline =
+        client->snapshot_history.Get(client->acked_snapshot);
+    uint32_t baseline_sequence = (baseline != NULL) ?
+        client->acked_snapshot : 0;
+    removed_ids_.clear();
+    if (baseline != NULL) {
+      for (size_t i = 0; i < baseline->size(); i++) {
+        uint32_t id = (*baseline)[i].id;
+        if (FindEntitySnapshot(client_snapshot_, id) == NULL) {
+          removed_ids_.push_back(id);
+        }
+      }
+    }
+    if (!SendWorldSnapshot(client, Packet::TYPE_WORLD_SNAPSHOT, time,
+        removed_ids_, client_snapshot_, baseline_sequence, baseline)) {
+      return false;
+    }
+    // The slot's previous entities are cleared below and their storage
+    // is reused.
+    client->snapshot_history.Put(snapshot_sequence_)->swap(client_snapshot_);
+    if (client->first_snapshot == 0) {
+      client->first_snapshot = snapshot_sequence_;
+    }
+    snapshot_count_++;
+
+    // Static entities.
+    client_snapshot_.clear();
+    for (size_t i = 0; i < client->visible_static.size(); i++) {
+      uint32_t id = client->visible_static[i];
+      if (std::binary_search(entered_static_.begin(), entered_static_.end(),
+          id)) {
+        ServerEntity* entity = static_cast<ServerEntity*>(
+            world->GetEntity(id));
+        client_snapshot_.push_back(EntitySnapshot());
+        entity->GetSnapshot(time, &client_snapshot_.back());
+        continue;
+      }
+      const EntitySnapshot* snapshot = FindEntitySnapshot(static_updates_, id);
+      if (snapshot != NULL) {
+        client_snapshot_.push_back(*snapshot);
+      }
+    }
+    if (client_snapshot_.empty() && left_static_.empty()) {
+      continue;
+    }
+    if (!SendWorldSnapshot(client, Packet::TYPE_WORLD_UPDATE, time,
+        left_static_, client_snapshot_, 0, NULL)) {
+      return false;
+    }
+  }
+
+  if (report_stats_ &&
+      time - last_snapshot_report_ >= SNAPSHOT_REPORT_PERIOD) {
+    if (snapshot_count_ > 0) {
+      printf("%s: Snapshots: %.1f bytes per client on average.\n",
+          name_.c_str(),
+          static_cast<double>(snapshot_bytes_) / snapshot_count_);
+    }
+    if (network_ != NULL) {
+      uint64_t allocation_count =
+          network_->GetPacketPool(room_index_).GetAllocationCount();
+      if (allocation_count != reported_allocation_count_) {
+        printf("%s: Packet buffers: %u allocated since the last report.\n",
+            name_.c_str(), static_cast<unsigned>(
+                allocation_count - reported_allocation_count_));
+        reported_allocation_count_ = allocation_count;
+      }
+    }
+    ReportPoolMisses();
+    snapshot_bytes_ = 0;
+    snapshot_count_ = 0;
+    last_snapshot_report_ = time;
+  }
+
+  return true;
+}
+
+bool Room::SendWorldSnapshot(const Client* client, Packet::Type packet_type,
+    int64_t time, const std::vector<uint32_t>& removed,
+    const std::vector<EntitySnapshot>& entities, uint32_t baseline_sequence,
+    const std::vector<EntitySnapshot>* baseline) {
+  CHECK(packet_type == Packet::TYPE_WORLD_SNAPSHOT ||
+        packet_type == Packet::TYPE_WORLD_UPDATE);
+  CHECK((baseline == NULL) == (baseline_sequence == 0));
+
+  // The header is never larger than the raw 'WorldSnapshot'.
+  const size_t max_data_bits = (WorldSnapshot::MAX_PACKET_SIZE -
+      sizeof(Packet::Type) - sizeof(WorldSnapshot)) * 8;
+  bool packed = wire_format_.IsPacked(packet_type);
+
+  // Every snapshot has at least one packet, even an empty one,
+  // so that the client can acknowledge it.
+  size_t fragment_count = 0;
+  NewSnapshotFragment(&fragment_count);
+
+  for (size_t i = 0; i < removed.size(); i++) {
+    SnapshotFragment* fragment = &snapshot_fragments_[fragment_count - 1];
+    if (fragment->data.GetBitCount() + 32 > max_data_bits) {
+      fragment = NewSnapshotFragment(&fragment_count);
+    }
+    FieldWriter writer(wire_format_, packed, &fragment->data);
+    writer.WriteUInt32(removed[i], 32);
+    fragment->removed_count++;
+  }
+
+  for (size_t i = 0; i < entities.size(); i++) {
+    const EntitySnapshot* base = (baseline != NULL) ?
+        FindEntitySnapshot(*baseline, entities[i].id) : NULL;
+    entity_delta_.Clear();
+    FieldWriter writer(wire_format_, packed, &entity_delta_);
+    if (!AppendEntityDelta(base, entities[i], &writer)) {
+      continue;
+    }
+    SnapshotFragment* fragment = &snapshot_fragments_[fragment_count - 1];
+    if (fragment->data.GetBitCount() + entity_delta_.GetBitCount() >
+        max_data_bits) {
+      fragment = NewSnapshotFragment(&fragment_count);
+    }
+    fragment->data.Write(entity_delta_);
+    fragment->entity_count++;
+  }
+
+  for (size_t i = 0; i < fragment_count; i++) {
+    const SnapshotFragment& fragment = snapshot_fragments_[i];
+
+    WorldSnapshot world_snapshot;
+    world_snapshot.time = time;
+    world_snapshot.tick = tick_;
+    world_snapshot.sequence = snapshot_sequence_;
+    world_snapshot.baseline = baseline_sequence;
+    world_snapshot.fragment_index = static_cast<uint16_t>(i);
+    world_snapshot.fragment_count = static_cast<uint16_t>(fragment_count);
+    world_snapshot.removed_count = fragment.removed_count;
+    world_snapshot.entity_count = fragment.entity_count;
+
+    snapshot_packet_.Clear();
+    WriteWorldSnapshot(wire_format_, packet_type, world_snapshot,
+        &snapshot_packet_);
+    snapshot_packet_.Write(fragment.data);
+
+    OutboundPacket* packet = NULL;
+    std::vector<char>* buffer = &replay_buffer_;
+    if (!replaying_) {
+      packet = NewOutboundPacket(client->id, packet_type);
+      if (packet == NULL) {
+        return false;
+      }
+      buffer = &packet->buffer->data;
+    }
+    buffer->clear();
+    AppendPacketToBuffer(*buffer, packet_type, snapshot_packet_);
+
+    if (packet_type == Packet::TYPE_WORLD_SNAPSHOT) {
+      snapshot_bytes_ += buffer->size();
+    }
+    if (packet != NULL) {
+      network_->PushPacket(room_index_);
+    }
+  }
+
+  return true;
+}
+
+Room::SnapshotFragment* Room::NewSnapshotFragment(size_t* fragment_count) {
+  CHECK(fragment_count != NULL);
+  if (snapshot_fragments_.size() <= *fragment_count) {
+    snapshot_fragments_.resize(*fragment_count + 1);
+  }
+  SnapshotFragment* fragment = &snapshot_fragments_[*fragment_count];
+  fragment->removed_count = 0;
+  fragment->entity_count = 0;
+  fragment->data.Clear();
+  (*fragment_count)++;
+  return fragment;
+}
+
+bool Room::SendGameEvents() {
+  std::vector<GameEvent> *events = controller_.GetGameEvents();
+  std::vector<GameEvent>::iterator it;
+  for (it = events->begin(); it != events->end(); ++it) {
+    for (auto itr : *client_manager_.GetClients()) {
+      Client* client = itr.second;
+      if (!client->synchronized || !IsGameEventVisible(client, *it)) {
+        continue;
+      }
+      bool rv = SendToClient(client, Packet::TYPE_GAME_EVENT, *it);
+      if (rv == false) {
+        return false;
+      }
+    }
+  }
+  events->clear();
+  return true;
+}
+
+bool Room::IsGameEventVisible(const Client* client,
+    const GameEvent& event) const {
+  switch (event.type) {
+    case GameEvent::TYPE_EXPLOSION: {
+      const Config::ServerConfig& config =
+        Config::GetInstance()->GetServerConfig();
+      b2Vec2 distance = b2Vec2(event.x, event.y) -
+          client->entity->GetPosition();
+      return distance.Length() <=
+          config.interest_radius + config.interest_hysteresis;
+    }
+
+    case GameEvent::TYPE_ENTITY_DISAPPEARED: {
+      uint32_t id = event.entity.id;
+      return std::binary_search(client->visible_static.begin(),
+          client->visible_static.end(), id) ||
+          std::binary_search(client->visible_dynamic.begin(),
+          client->visible_dynamic.end(), id);
+    }
+  }
+  return false;
+}
+
+bool Room::PumpEvents() {
+  NetworkEvent* event;
+  while ((event = network_->FrontEvent(room_index_)) != NULL) {
+    if (!OnNetworkEvent(event->type, event->client_id,
+        event->round_trip_time, event->command)) {
+      return false;
+    }
+    network_->PopEvent(room_index_);
+  }
+  return true;
+}
+
+bool Room::OnNetworkEvent(TrafficEvent::Type type, uint32_t client_id,
+    uint32_t round_trip_time, const ClientCommand& command) {
+  switch (type) {
+    case TrafficEvent::TYPE_CONNECT:
+      // The lobby passes the clients to the room once they log in.
+      return true;
+
+    case TrafficEvent::TYPE_DISCONNECT:
+      return OnDisconnect(client_id);
+
+    case TrafficEvent::TYPE_RECEIVE:
+      return OnReceive(client_id, round_trip_time, command);
+  }
+  return true;
+}
+
+OutboundPacket* Room::NewOutboundPacket(uint32_t client_id,
+    Packet::Type type) {
+  OutboundPacket* packet = network_->ReservePacket(room_index_);
+  if (packet == NULL) {
+    REPORT_ERROR("Network thread has stopped.");
+    return NULL;
+  }
+  packet->type = OutboundPacket::TYPE_SEND;
+  packet->client_id = client_id;
+  packet->packet_type = type;
+  return packet;
+}
+
+bool Room::OnDisconnect(uint32_t id) {
+  if (!client_manager_.HasClient(id)) {
+    printf("#%u: Client disconnected before logging in.\n", id);
+    return true;
+  }
+
+  Client* client = client_manager_.GetClient(id);
+
+  controller_.OnPlayerDisconnected(client->entity);
+
+  client_manager_.DeleteClient(id, true);
+
+  printf("#%u: Client disconnected.\n", id);
+
+  return true;
+}
+
+bool Room::OnReceive(uint32_t id, uint32_t round_trip_time,
+    const ClientCommand& command) {
+  if (command.type == Packet::TYPE_LOGIN) {
+    if (client_manager_.HasClient(id)) {
+      printf("#%u: Repeated login ignored.\n", id);
+      return true;
+    }
+    if (!OnLogin(id, command.login)) {
+      return false;
+    }
+    return true;
+  }
+
+  if (!client_manager_.HasClient(id)) {
+    printf("#%u: Message before login ignored.\n", id);
+    return true;
+  }
+
+  Client* client = client_manager_.GetClient(id);
+  client->entity->SetRoundTripTime(round_trip_time);
+
+  switch (command.type) {
+    case Packet::TYPE_CLIENT_STATUS: {
+      if (!OnClientStatus(id)) {
+        return false;
+      }
+    } break;
+
+    case Packet::TYPE_KEYBOARD_EVENT: {
+      controller_.OnKeyboardEvent(client->entity, command.keyboard_event);
+    } break;
+
+    case Packet::TYPE_MOUSE_EVENT: {
+      controller_.OnMouseEvent(client->entity, command.mouse_event);
+    } break;
+
+    case Packet::TYPE_PLAYER_ACTION: {
+      controller_.OnPlayerAction(client->entity, command.player_action);
+    } break;
+
+    case Packet::TYPE_INPUT_COMMAND: {
+      controller_.OnInputCommand(client->entity, command.input_command);
+    } break;
+
+    case Packet::TYPE_SNAPSHOT_ACK: {
+      const SnapshotAck& ack = command.snapshot_ack;
+      // Acks may be reordered, only the newest one matters.
+      if (client->snapshot_history.Get(ack.sequence) != NULL &&
+          (client->acked_snapshot == 0 || static_cast<int32_t>(
+              ack.sequence - client->acked_snapshot) > 0)) {
+        client->acked_snapshot = ack.sequence;
+      }
+    } break;
+
+    default: {
+      // Decoded commands have only the types above.
+      CHECK(false);
+    } break;
+  }
+
+  return true;
+}
+
+bool Room::OnLogin(uint32_t client_id, const LoginData& login_data) {
+  printf("#%u: Login data has been received.\n", client_id);
+
+  // Create player.
+
+  Player* player = controller_.OnPlayerConnected();
+
+  std::string login(&login_data.login[0]);
+  Client* client = new Client(client_id, player, login);
+  CHECK(client != NULL);
+  client_manager_.AddClient(client_id, client);
+
+  if (!SendClientOptions(client)) {
+    return false;
+  }
+
+  if (!SendEntityKinds(client)) {
+    return false;
+  }
+
+  printf("#%u: Client options has been sent.\n", client_id);
+
+  // Broadcast the new player info.
+
+  // The new player may not receive this info, as he will be
+  // synchronizing time and ignoring everything else.
+
+  PlayerInfo player_info;
+  player_info.id = player->GetId();
+  std::copy(login.c_str(), login.c_str() + login.size() + 1,
+      &player_info.login[0]);
+  for (auto i : *client_manager_.GetClients()) {
+    bool rv = SendToClient(i.second, Packet::TYPE_PLAYER_INFO, player_info);
+    if (rv == false) {
+      return false;
+    }
+  }
+
+  printf("#%u: Client connected.\n", client_id);
+
+  return true;
+}
+
+bool Room::SendClientOptions(Client* client) {
+  ClientOptions options;
+  options.id = client->entity->GetId();
+  options.speed = client->entity->GetSpeed();
+  options.x = client->entity->GetPosition().x;
+  options.y = client->entity->GetPosition().y;
+  options.max_health = client->entity->GetMaxHealth();
+  options.energy_capacity = client->entity->GetEnergyCapacity();
+  options.packed_types = wire_format_.packed_types;
+  options.bound = wire_format_.bound;
+  options.position_precision = wire_format_.position_precision;
+
+  Packet::Type packet_type = Packet::TYPE_CLIENT_OPTIONS;
+
+  bool rv = SendToClient(client, packet_type, options);
+  if (rv == false) {
+    return false;
+  }
+
+  return true;
+}
+
+bool Room::SendEntityKinds(Client* client) {
+  EntityKindTable table;
+  table.kind_count = static_cast<uint32_t>(entity_kinds_.size());
+  return SendToClient(client, Packet::TYPE_ENTITY_KINDS, table,
+      entity_kinds_);
+}
+
+bool Room::OnClientStatus(uint32_t client_id) {
+  // Send to the new player all players' info.
+
+  PlayerInfo player_info;
+  Client* client = client_manager_.GetClient(client_id);
+
+  for (auto i : *client_manager_.GetClients()) {
+    player_info.id = i.second->entity->GetId();
+    std::string& login = i.second->login;
+    std::copy(login.c_str(), login.c_str() + login.size() + 1,
+        &player_info.login[0]);
+    bool rv = SendToClient(client, Packet::TYPE_PLAYER_INFO, player_info);
+    if (rv == false) {
+      return false;
+    }
+  }
+
+  // The entities around the player are sent with the next snapshots.
+  client->synchronized = true;
+
+  return true;
+}
+
+}  // namespace bm
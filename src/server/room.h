@@ -0,0 +1,266 @@
+// Copyright (c) 2013 Blowmorph Team
+
+#ifndef SERVER_ROOM_H_
+#define SERVER_ROOM_H_
+
+#include <cstring>
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/bit_stream.h"
+#include "base/error.h"
+#include "base/macros.h"
+#include "base/pstdint.h"
+#include "base/timer.h"
+
+#include "net/utils.h"
+
+#include "engine/protocol.h"
+#include "engine/wire_format.h"
+
+#include "server/client_command.h"
+#include "server/client_manager.h"
+#include "server/controller.h"
+#include "server/entity.h"
+#include "server/network_thread.h"
+#include "server/profiler.h"
+#include "server/traffic_log.h"
+
+namespace bm {
+
+// A single match with its own world and clients. Live rooms run on their
+// own threads and talk to the clients through the network thread. When
+// the traffic is replayed, the server drives the rooms directly.
+class Room {
+ public:
+  Room();
+  ~Room();
+
+  // Registers the room with 'network' or, if it's 'NULL', prepares
+  // it for replaying. Profiler reports are written to 'profile_file'.
+  bool Initialize(const std::string& name, const std::string& map,
+      const std::string& profile_file, NetworkThread* network);
+  void Finalize();
+
+  const std::string& GetName() const;
+  const WireFormat& GetWireFormat() const;
+  uint32_t GetTick() const;
+
+  // Runs the room on its own thread. The simulation draws its random
+  // numbers from a generator seeded with 'random_seed'.
+  void Start(uint32_t random_seed);
+  void Stop();
+  // Set once the thread has stopped on an error. 'Stop()' should be called
+  // before the error is printed.
+  bool HasFailed() const;
+
+  // Replaying. The room follows the time set with 'SetReplayTime()',
+  // starting from 'start_time', with the 'random_seed' it was recorded with.
+  void StartReplay(int64_t start_time, uint32_t random_seed);
+  void SetReplayTime(int64_t time);
+
+  // Returns the time of the next broadcast or simulation step.
+  int64_t GetNextUpdateTime() const;
+
+  // Broadcasts the world state and runs the simulation steps if it's time.
+  bool Update();
+
+  // 'round_trip_time' is the client's at the time of 'TYPE_RECEIVE'.
+  bool OnNetworkEvent(TrafficEvent::Type type, uint32_t client_id,
+      uint32_t round_trip_time, const ClientCommand& command);
+
+ private:
+  void Run();
+  bool Tick();
+
+  // Server time, which is the recorded one when replaying.
+  int64_t GetTime() const;
+  // Runs the simulation steps for the time passed since the last call.
+  void UpdateSimulation();
+
+  // Prints the pool counters if the pools missed since the last report.
+  void ReportPoolMisses();
+
+  // Lets the world reuse the ids of the removed entities that every client
+  // has seen disappear.
+  void ReleaseEntityIds();
+
+  // The snapshots are sorted by id.
+  void SnapshotDynamicEntities(int64_t time,
+      std::vector<EntitySnapshot>* output);
+  // Snapshots the static entities updated since the last call.
+  void SnapshotStaticEntities(int64_t time,
+      std::vector<EntitySnapshot>* output);
+
+  // Recomputes the sets of entities visible to 'client'. Fills
+  // 'entered_static' and 'left_static' with the sorted ids of the static
+  // entities that have entered and left its area of interest.
+  void UpdateInterest(Client* client, std::vector<uint32_t>* entered_static,
+      std::vector<uint32_t>* left_static);
+
+  // Sends to every synchronized client the dynamic entities from
+  // 'world_snapshot_' it can see encoded against the last snapshot it has
+  // acknowledged, and the static entities it can see from
+  // 'static_updates_' or in full if they have just become visible.
+  bool SendWorldSnapshots(int64_t time);
+
+  // Encodes 'removed' ids and 'entities' against 'baseline' with the
+  // sequence number 'baseline_sequence' or, if 'baseline' is 'NULL', in
+  // full. Splits them into 'packet_type' packets, which is either
+  // 'TYPE_WORLD_SNAPSHOT' or 'TYPE_WORLD_UPDATE', and sends them to
+  // 'client'.
+  bool SendWorldSnapshot(const Client* client, Packet::Type packet_type,
+      int64_t time,
+      const std::vector<uint32_t>& removed,
+      const std::vector<EntitySnapshot>& entities, uint32_t baseline_sequence,
+      const std::vector<EntitySnapshot>* baseline);
+
+  // Removed entity ids and entity deltas of a single snapshot packet.
+  struct SnapshotFragment {
+    uint16_t removed_count;
+    uint16_t entity_count;
+    BitWriter data;
+  };
+
+  // Appends an empty fragment to the first '*fragment_count' ones
+  // in 'snapshot_fragments_' and increments '*fragment_count'.
+  SnapshotFragment* NewSnapshotFragment(size_t* fragment_count);
+
+  // Sends every game event to the clients that can see it.
+  bool SendGameEvents();
+  bool IsGameEventVisible(const Client* client, const GameEvent& event) const;
+
+  // Handles the events received by the network thread.
+  bool PumpEvents();
+
+  bool OnDisconnect(uint32_t client_id);
+
+  bool OnReceive(uint32_t client_id, uint32_t round_trip_time,
+      const ClientCommand& command);
+
+  bool OnLogin(uint32_t client_id, const LoginData& login_data);
+  bool SendClientOptions(Client* client);
+  bool SendEntityKinds(Client* client);
+
+  bool OnClientStatus(uint32_t client_id);
+
+  // Returns the packet to be sent to the client by the network thread
+  // or 'NULL' if the thread has failed.
+  OutboundPacket* NewOutboundPacket(uint32_t client_id, Packet::Type type);
+
+  // Nothing is sent to the clients when replaying.
+  template<class DataType>
+  bool SendToClient(const Client* client, Packet::Type type,
+      const DataType& data) {
+    if (replaying_) {
+      return true;
+    }
+    OutboundPacket* packet = NewOutboundPacket(client->id, type);
+    if (packet == NULL) {
+      return false;
+    }
+    AppendPacketToBuffer(packet->buffer->data, type, data);
+    network_->PushPacket(room_index_);
+    return true;
+  }
+  template<class DataType, class ItemType>
+  bool SendToClient(const Client* client, Packet::Type type,
+      const DataType& data, const std::vector<ItemType>& items) {
+    if (replaying_) {
+      return true;
+    }
+    OutboundPacket* packet = NewOutboundPacket(client->id, type);
+    if (packet == NULL) {
+      return false;
+    }
+    AppendPacketToBuffer(packet->buffer->data, type, data,
+        items.empty() ? NULL : &items[0], items.size());
+    network_->PushPacket(room_index_);
+    return true;
+  }
+
+  uint32_t snapshot_sequence_;
+
+  // Reused between broadcasts to avoid reallocations.
+  std::vector<EntitySnapshot> world_snapshot_;
+  std::vector<EntitySnapshot> static_updates_;
+  std::vector<EntitySnapshot> client_snapshot_;
+  std::vector<uint32_t> removed_ids_;
+  std::vector<uint32_t> interest_candidates_;
+  std::vector<uint32_t> visible_static_;
+  std::vector<uint32_t> visible_dynamic_;
+  std::vector<uint32_t> entered_static_;
+  std::vector<uint32_t> left_static_;
+  std::vector<SnapshotFragment> snapshot_fragments_;
+  BitWriter entity_delta_;
+  BitWriter snapshot_packet_;
+  // Snapshots are still encoded when replaying to measure the cost.
+  std::vector<char> replay_buffer_;
+
+  WireFormat wire_format_;
+  // The prototypes of the config sent to the clients at login, the kinds
+  // in the snapshots are the prototype ids.
+  std::vector<EntityKind> entity_kinds_;
+
+  // How often the average snapshot size is printed if 'report_stats_' is
+  // set, in milliseconds.
+  static const int64_t SNAPSHOT_REPORT_PERIOD = 10000;
+  bool report_stats_;
+
+  // Bytes in 'TYPE_WORLD_SNAPSHOT' packets and the number of snapshots
+  // sent to clients since the last report.
+  size_t snapshot_bytes_;
+  size_t snapshot_count_;
+  // Packet buffer allocations as of the last report, which should stop
+  // growing once the pool is warmed up.
+  uint64_t reported_allocation_count_;
+  // Entity and body pool misses as of the last report.
+  uint64_t reported_pool_misses_;
+  int64_t last_snapshot_report_;
+
+  int64_t broadcast_timeout_;
+  int64_t last_broadcast_;
+
+  // The world is simulated in fixed steps of 'update_timeout_'
+  // milliseconds. 'update_accumulator_' is the real time passed since
+  // 'last_update_' that hasn't been simulated yet.
+  int64_t update_timeout_;
+  int64_t last_update_;
+  int64_t update_accumulator_;
+  int32_t max_catch_up_steps_;
+
+  // Number of simulation steps done and the server time they've reached.
+  uint32_t tick_;
+  int64_t simulation_time_;
+
+  std::string name_;
+
+  // 'NULL' when replaying.
+  NetworkThread* network_;
+  size_t room_index_;
+  bool replaying_;
+  int64_t replay_time_;
+
+  std::thread thread_;
+  std::atomic<bool> stop_;
+  std::atomic<bool> failed_;
+
+  Profiler profiler_;
+  Controller controller_;
+  ClientManager client_manager_;
+
+  enum {
+    STATE_FINALIZED,
+    STATE_INITIALIZED
+  } state_;
+
+  DISALLOW_COPY_AND_ASSIGN(Room);
+};
+
+}  // namespace bm
+
+#endif  // SERVER_ROOM_H_
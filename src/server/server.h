@@ -3,72 +3,52 @@
 #ifndef SERVER_SERVER_H_
 #define SERVER_SERVER_H_
 
-#include <cstring>
-
-#include <map>
 #include <string>
 #include <vector>
 
-#include "base/error.h"
-#include "base/id_manager.h"
 #include "base/macros.h"
 #include "base/pstdint.h"
-#include "base/timer.h"
-
-#include "net/enet.h"
 
-#include "engine/protocol.h"
-
-#include "server/client_manager.h"
-#include "server/controller.h"
-#include "server/entity.h"
+#include "server/lobby.h"
+#include "server/network_thread.h"
+#include "server/room.h"
 
 namespace bm {
 
+// Runs the rooms listed in the config, every one on its own thread, behind
+// a single network thread that routes the clients to them.
 class Server {
  public:
   Server();
   ~Server();
 
-  bool Initialize();
+  // Doesn't open a socket if 'listen' is 'false', which is used for
+  // replaying recorded traffic. Otherwise starts the network thread, which
+  // records all the inbound traffic to 'record_file' unless it's empty,
+  // and the rooms.
+  bool Initialize(bool listen, const std::string& record_file);
   void Finalize();
 
+  // Waits for a while. Returns 'false' if any of the threads has failed.
   bool Tick();
 
- private:
-  bool BroadcastDynamicEntities();
-  bool BroadcastStaticEntities(bool force = false);
-
-  bool BroadcastGameEvents();
-
-  bool PumpEvents();
-
-  void OnConnect();
-  bool OnDisconnect();
+  // Feeds the traffic recorded to 'file' to the rooms without a network.
+  // The simulation follows the recorded time, which passes as fast as
+  // possible or, if 'realtime' is set, at the recorded speed.
+  bool Replay(const std::string& file, bool realtime);
 
-  bool OnReceive();
-
-  bool OnLogin(uint32_t client_id);
-  bool SendClientOptions(Client* client);
-
-  bool OnClientStatus(uint32_t client_id);
-
-  bool BroadcastEntityRelatedMessage(Packet::Type packet_type,
-      ServerEntity* entity);
-
-  int64_t broadcast_timeout_;
-  int64_t last_broadcast_;
-
-  int64_t update_timeout_;
-  int64_t last_update_;
+ private:
+  // How often 'Tick()' checks the threads, in milliseconds.
+  static const int64_t TICK_TIMEOUT = 100;
 
-  Enet enet_;
-  ServerHost* host_;
-  Event* event_;
+  void Stop();
 
-  IdManager id_manager_;
-  Controller controller_;
-  ClientManager client_manager_;
+  NetworkThread network_;
+  std::vector<Room*> rooms_;
+  bool replaying_;
+  // Routes the clients to the rooms when replaying, the network thread
+  // has its own lobby otherwise.
+  Lobby replay_lobby_;
 
   enum {
     STATE_FINALIZED,
@@ -0,0 +1,213 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "server/spatial_query.h"
+
+#include <cmath>
+
+#include <algorithm>
+#include <vector>
+
+#include <Box2D/Box2D.h>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+#include "engine/entity.h"
+#include "engine/utils.h"
+
+namespace bm {
+
+// Places a circle with 'center' and 'radius' in world units into the Box2D
+// world.
+static void MakeCircle(const b2Vec2& center, float radius,
+    b2CircleShape* circle, b2Transform* transform) {
+  circle->m_p.SetZero();
+  circle->m_radius = radius / BOX2D_SCALE;
+  transform->Set(1.0f / BOX2D_SCALE * center, 0.0f);
+}
+
+// Whether any child of the shape of 'fixture' overlaps 'circle' with the
+// body of the fixture at 'transform'.
+static bool OverlapsCircle(b2Fixture* fixture, const b2Transform& transform,
+    const b2CircleShape& circle, const b2Transform& circle_transform) {
+  const b2Shape* shape = fixture->GetShape();
+  for (int32 child = 0; child < shape->GetChildCount(); child++) {
+    if (b2TestOverlap(&circle, 0, shape, child, circle_transform,
+        transform)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The broad-phase reports a body once for every child of its fixtures.
+// Bodies with a single child, which are most of them, are never reported
+// twice, so only the others are looked up among the entities appended
+// since 'first'.
+static bool IsReported(b2Fixture* fixture, Entity* entity,
+    const std::vector<Entity*>& entities, size_t first) {
+  if (fixture->GetBody()->GetFixtureList() == fixture &&
+      fixture->GetNext() == NULL && fixture->GetShape()->GetChildCount() == 1) {
+    return false;
+  }
+  return std::find(entities.begin() + first, entities.end(), entity) !=
+      entities.end();
+}
+
+struct AABBQueryCallback : public b2QueryCallback {
+  AABBQueryCallback(const b2AABB& aabb, std::vector<Entity*>* entities)
+      : aabb(aabb), entities(entities), first(entities->size()) { }
+
+  bool ReportFixture(b2Fixture* fixture) {
+    b2Body* body = fixture->GetBody();
+    Entity* entity = static_cast<Entity*>(body->GetUserData());
+    if (entity == NULL) {
+      return true;
+    }
+    // The broad-phase works with enlarged boxes, the precise ones are
+    // computed from the shapes.
+    const b2Shape* shape = fixture->GetShape();
+    for (int32 child = 0; child < shape->GetChildCount(); child++) {
+      b2AABB child_aabb;
+      shape->ComputeAABB(&child_aabb, body->GetTransform(), child);
+      if (b2TestOverlap(child_aabb, aabb)) {
+        if (!IsReported(fixture, entity, *entities, first)) {
+          entities->push_back(entity);
+        }
+        break;
+      }
+    }
+    return true;
+  }
+
+  b2AABB aabb;
+  std::vector<Entity*>* entities;
+  size_t first;
+};
+
+struct RadiusQueryCallback : public b2QueryCallback {
+  RadiusQueryCallback(const b2Vec2& center, float radius,
+      std::vector<Entity*>* entities)
+      : entities(entities), first(entities->size()) {
+    MakeCircle(center, radius, &circle, &circle_transform);
+  }
+
+  bool ReportFixture(b2Fixture* fixture) {
+    b2Body* body = fixture->GetBody();
+    Entity* entity = static_cast<Entity*>(body->GetUserData());
+    if (entity == NULL) {
+      return true;
+    }
+    if (OverlapsCircle(fixture, body->GetTransform(), circle,
+        circle_transform) && !IsReported(fixture, entity, *entities, first)) {
+      entities->push_back(entity);
+    }
+    return true;
+  }
+
+  b2CircleShape circle;
+  b2Transform circle_transform;
+  std::vector<Entity*>* entities;
+  size_t first;
+};
+
+SpatialQuery::SpatialQuery() : world_(NULL), bound_(0.0f) { }
+SpatialQuery::~SpatialQuery() { }
+
+void SpatialQuery::Initialize(b2World* world, float bound) {
+  CHECK(world != NULL);
+  CHECK(bound > 0.0f);
+  world_ = world;
+  bound_ = bound;
+}
+
+void SpatialQuery::QueryAABB(const b2Vec2& lower, const b2Vec2& upper,
+    std::vector<Entity*>* entities) const {
+  CHECK(world_ != NULL);
+  CHECK(entities != NULL);
+  b2AABB aabb;
+  aabb.lowerBound = 1.0f / BOX2D_SCALE * lower;
+  aabb.upperBound = 1.0f / BOX2D_SCALE * upper;
+  AABBQueryCallback callback(aabb, entities);
+  world_->QueryAABB(&callback, aabb);
+}
+
+void SpatialQuery::QueryRadius(const b2Vec2& center, float radius,
+    std::vector<Entity*>* entities) const {
+  CHECK(world_ != NULL);
+  CHECK(entities != NULL);
+  b2AABB aabb;
+  aabb.lowerBound = 1.0f / BOX2D_SCALE * (center - b2Vec2(radius, radius));
+  aabb.upperBound = 1.0f / BOX2D_SCALE * (center + b2Vec2(radius, radius));
+  RadiusQueryCallback callback(center, radius, entities);
+  world_->QueryAABB(&callback, aabb);
+}
+
+Entity* SpatialQuery::FindNearest(const b2Vec2& center, Entity::Type type) {
+  CHECK(world_ != NULL);
+  // The circle covers the bound once it reaches the farthest corner.
+  b2Vec2 corner(std::abs(center.x) + bound_, std::abs(center.y) + bound_);
+  float max_radius = corner.Length();
+  float radius = bound_ / 16;
+
+  while (true) {
+    candidates_.clear();
+    QueryRadius(center, radius, &candidates_);
+
+    Entity* nearest = NULL;
+    float nearest_distance2 = 0.0f;
+    for (size_t i = 0; i < candidates_.size(); i++) {
+      Entity* entity = candidates_[i];
+      if (entity->GetType() != type) {
+        continue;
+      }
+      float distance2 = (entity->GetPosition() - center).LengthSquared();
+      if (nearest == NULL || distance2 < nearest_distance2) {
+        nearest = entity;
+        nearest_distance2 = distance2;
+      }
+    }
+
+    if (nearest != NULL) {
+      // The entity may only touch the circle with its position outside,
+      // then an entity with a closer position can be outside it as well.
+      float distance = std::sqrt(nearest_distance2);
+      if (distance > radius) {
+        radius = distance;
+        continue;
+      }
+      return nearest;
+    }
+
+    if (radius >= max_radius) {
+      return NULL;
+    }
+    radius = std::min(2 * radius, max_radius);
+  }
+}
+
+bool SpatialQuery::IsInRadius(Entity* entity, const b2Vec2& position,
+    const b2Vec2& center, float radius) {
+  CHECK(entity != NULL);
+  b2CircleShape circle;
+  b2Transform circle_transform;
+  MakeCircle(center, radius, &circle, &circle_transform);
+  b2Body* body = entity->GetBody();
+  b2Transform transform = body->GetTransform();
+  transform.p = 1.0f / BOX2D_SCALE * position;
+  for (b2Fixture* fixture = body->GetFixtureList(); fixture != NULL;
+      fixture = fixture->GetNext()) {
+    if (OverlapsCircle(fixture, transform, circle, circle_transform)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SpatialQuery::IsInRadius(Entity* entity, const b2Vec2& center,
+    float radius) {
+  CHECK(entity != NULL);
+  return IsInRadius(entity, entity->GetPosition(), center, radius);
+}
+
+}  // namespace bm
@@ -0,0 +1,61 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef SERVER_SPATIAL_QUERY_H_
+#define SERVER_SPATIAL_QUERY_H_
+
+#include <vector>
+
+#include <Box2D/Box2D.h>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+#include "engine/entity.h"
+
+namespace bm {
+
+// Finds the entities around a point through the broad-phase of the Box2D
+// world, so the cost of a query depends on the number of bodies near it
+// and not on the size of the map. The entities are matched against the
+// shapes of their fixtures, not their centers. Parked bodies are inactive
+// and never found. Positions and distances are in world units.
+class SpatialQuery {
+ public:
+  SpatialQuery();
+  ~SpatialQuery();
+
+  // The searches of 'FindNearest()' stop once they cover the square of
+  // half-size 'bound' around the origin.
+  void Initialize(b2World* world, float bound);
+
+  // Append the entities overlapping the box or the circle to '*entities',
+  // every entity once, in the order of the broad-phase.
+  void QueryAABB(const b2Vec2& lower, const b2Vec2& upper,
+      std::vector<Entity*>* entities) const;
+  void QueryRadius(const b2Vec2& center, float radius,
+      std::vector<Entity*>* entities) const;
+
+  // Returns the entity of 'type' with the position closest to 'center'
+  // or 'NULL' if there is none within the bound. The search radius starts
+  // small and is doubled until an entity is found.
+  Entity* FindNearest(const b2Vec2& center, Entity::Type type);
+
+  // Whether the fixtures of 'entity' overlap the circle, with the entity
+  // moved to 'position' in the first variant.
+  static bool IsInRadius(Entity* entity, const b2Vec2& position,
+      const b2Vec2& center, float radius);
+  static bool IsInRadius(Entity* entity, const b2Vec2& center, float radius);
+
+ private:
+  b2World* world_;
+  float bound_;
+
+  // Reused by 'FindNearest()'.
+  std::vector<Entity*> candidates_;
+
+  DISALLOW_COPY_AND_ASSIGN(SpatialQuery);
+};
+
+}  // namespace bm
+
+#endif  // SERVER_SPATIAL_QUERY_H_
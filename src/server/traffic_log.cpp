@@ -0,0 +1,201 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#include "server/traffic_log.h"
+
+#include <cstdio>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/error.h"
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+#include "net/event.h"
+
+namespace bm {
+
+static const char LOG_MAGIC[4] = { 'B', 'M', 'T', 'L' };
+static const uint8_t LOG_VERSION = 4;
+
+// Messages are never that large, anything bigger means corruption.
+static const uint64_t MAX_MESSAGE_SIZE = 1 << 20;
+
+static bool WriteVarint(FILE* file, uint64_t value) {
+  do {
+    int byte = static_cast<int>(value & 0x7f);
+    value >>= 7;
+    if (value != 0) {
+      byte |= 0x80;
+    }
+    if (fputc(byte, file) == EOF) {
+      return false;
+    }
+  } while (value != 0);
+  return true;
+}
+
+static bool ReadVarint(FILE* file, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int byte = fgetc(file);
+    if (byte == EOF) {
+      return false;
+    }
+    *value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+TrafficRecorder::TrafficRecorder() : file_(NULL), last_time_(0) { }
+
+TrafficRecorder::~TrafficRecorder() {
+  Close();
+}
+
+bool TrafficRecorder::Open(const std::string& file, uint32_t random_seed) {
+  CHECK(file_ == NULL);
+  file_ = fopen(file.c_str(), "wb");
+  if (file_ == NULL) {
+    REPORT_ERROR("Can't open traffic log '%s' for writing.", file.c_str());
+    return false;
+  }
+  last_time_ = 0;
+  if (fwrite(LOG_MAGIC, sizeof(LOG_MAGIC), 1, file_) != 1 ||
+      fputc(LOG_VERSION, file_) == EOF ||
+      !WriteVarint(file_, random_seed)) {
+    REPORT_ERROR("Can't write traffic log '%s'.", file.c_str());
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void TrafficRecorder::Close() {
+  if (file_ != NULL) {
+    fclose(file_);
+    file_ = NULL;
+  }
+}
+
+bool TrafficRecorder::IsOpen() const {
+  return file_ != NULL;
+}
+
+bool TrafficRecorder::Record(TrafficEvent::Type type, int64_t time,
+    uint32_t client_id, uint32_t round_trip_time, const PacketView& data) {
+  CHECK(file_ != NULL);
+  // The timestamps come from the wall clock, which can be set back.
+  time = std::max(time, last_time_);
+  bool rv = fputc(static_cast<int>(type), file_) != EOF &&
+      WriteVarint(file_, static_cast<uint64_t>(time - last_time_)) &&
+      WriteVarint(file_, client_id);
+  if (rv && type == TrafficEvent::TYPE_RECEIVE) {
+    rv = WriteVarint(file_, round_trip_time) &&
+        WriteVarint(file_, data.size) && (data.size == 0 ||
+        fwrite(data.data, data.size, 1, file_) == 1);
+  }
+  if (rv == false) {
+    REPORT_ERROR("Can't write traffic log.");
+    return false;
+  }
+  last_time_ = time;
+  return true;
+}
+
+void TrafficRecorder::Flush() {
+  CHECK(file_ != NULL);
+  fflush(file_);
+}
+
+TrafficReader::TrafficReader()
+    : file_(NULL), last_time_(0), random_seed_(0) { }
+
+TrafficReader::~TrafficReader() {
+  Close();
+}
+
+bool TrafficReader::Open(const std::string& file) {
+  CHECK(file_ == NULL);
+  file_ = fopen(file.c_str(), "rb");
+  if (file_ == NULL) {
+    REPORT_ERROR("Can't open traffic log '%s'.", file.c_str());
+    return false;
+  }
+  last_time_ = 0;
+  char magic[sizeof(LOG_MAGIC)];
+  uint64_t random_seed;
+  if (fread(magic, sizeof(magic), 1, file_) != 1 ||
+      !std::equal(magic, magic + sizeof(magic), LOG_MAGIC) ||
+      fgetc(file_) != LOG_VERSION ||
+      !ReadVarint(file_, &random_seed) || random_seed > 0xffffffff) {
+    REPORT_ERROR("'%s' is not a traffic log.", file.c_str());
+    Close();
+    return false;
+  }
+  random_seed_ = static_cast<uint32_t>(random_seed);
+  return true;
+}
+
+void TrafficReader::Close() {
+  if (file_ != NULL) {
+    fclose(file_);
+    file_ = NULL;
+  }
+}
+
+uint32_t TrafficReader::GetRandomSeed() const {
+  return random_seed_;
+}
+
+bool TrafficReader::Read(TrafficEvent* event, bool* end) {
+  CHECK(file_ != NULL);
+  CHECK(event != NULL);
+  CHECK(end != NULL);
+
+  int type = fgetc(file_);
+  if (type == EOF) {
+    *end = true;
+    return true;
+  }
+  *end = false;
+
+  uint64_t time_delta, client_id;
+  if (type > TrafficEvent::TYPE_RECEIVE ||
+      !ReadVarint(file_, &time_delta) ||
+      !ReadVarint(file_, &client_id) || client_id > 0xffffffff) {
+    REPORT_ERROR("Traffic log is corrupted.");
+    return false;
+  }
+  event->type = static_cast<TrafficEvent::Type>(type);
+  event->time = last_time_ + static_cast<int64_t>(time_delta);
+  event->client_id = static_cast<uint32_t>(client_id);
+  event->round_trip_time = 0;
+  event->data.clear();
+  last_time_ = event->time;
+
+  if (event->type == TrafficEvent::TYPE_RECEIVE) {
+    uint64_t round_trip_time, size;
+    if (!ReadVarint(file_, &round_trip_time) ||
+        round_trip_time > 0xffffffff ||
+        !ReadVarint(file_, &size) || size > MAX_MESSAGE_SIZE) {
+      REPORT_ERROR("Traffic log is corrupted.");
+      return false;
+    }
+    event->round_trip_time = static_cast<uint32_t>(round_trip_time);
+    event->data.resize(static_cast<size_t>(size));
+    if (size > 0 && fread(&event->data[0], event->data.size(), 1,
+        file_) != 1) {
+      REPORT_ERROR("Traffic log is corrupted.");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace bm
@@ -0,0 +1,90 @@
+// Copyright (c) 2015 Blowmorph Team
+
+#ifndef SERVER_TRAFFIC_LOG_H_
+#define SERVER_TRAFFIC_LOG_H_
+
+#include <cstdio>
+
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/pstdint.h"
+
+#include "net/event.h"
+
+namespace bm {
+
+struct TrafficEvent {
+  enum Type {
+    TYPE_CONNECT,
+    TYPE_DISCONNECT,
+    TYPE_RECEIVE
+  };
+
+  Type type;
+  // Server time of the event in ms.
+  int64_t time;
+  uint32_t client_id;
+  // Round trip time to the client in ms when the message was received,
+  // 0 for the other events.
+  uint32_t round_trip_time;
+  // The received message for 'TYPE_RECEIVE' events, empty otherwise.
+  std::vector<char> data;
+};
+
+// The log starts with a header, which holds the random seed of the rooms
+// as a varint, followed by the events. Every event is
+// its type byte, the time since the previous event, the client id and,
+// for 'TYPE_RECEIVE', the round trip time, the message size and the
+// message. All the numbers are stored as varints of 7-bit groups.
+
+class TrafficRecorder {
+ public:
+  TrafficRecorder();
+  ~TrafficRecorder();
+
+  // The rooms are seeded from 'random_seed' when the log is replayed.
+  bool Open(const std::string& file, uint32_t random_seed);
+  void Close();
+  bool IsOpen() const;
+
+  // 'round_trip_time' and 'data' are only written for 'TYPE_RECEIVE'
+  // events. The time doesn't go back in the log even if the clock does.
+  bool Record(TrafficEvent::Type type, int64_t time, uint32_t client_id,
+      uint32_t round_trip_time, const PacketView& data);
+  // Writes the buffered events to the file.
+  void Flush();
+
+ private:
+  FILE* file_;
+  int64_t last_time_;
+
+  DISALLOW_COPY_AND_ASSIGN(TrafficRecorder);
+};
+
+class TrafficReader {
+ public:
+  TrafficReader();
+  ~TrafficReader();
+
+  bool Open(const std::string& file);
+  void Close();
+
+  uint32_t GetRandomSeed() const;
+
+  // Reads the next event. Sets '*end' and returns 'true' if there are no
+  // events left. Returns 'false' if the log is corrupted.
+  bool Read(TrafficEvent* event, bool* end);
+
+ private:
+  FILE* file_;
+  int64_t last_time_;
+  uint32_t random_seed_;
+
+  DISALLOW_COPY_AND_ASSIGN(TrafficReader);
+};
+
+}  // namespace bm
+
+#endif  // SERVER_TRAFFIC_LOG_H_
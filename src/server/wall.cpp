@@ -24,12 +24,10 @@ Wall::Wall(
   Controller* controller,
   uint32_t id,
   const b2Vec2& position,
-  const std::string& entity_name
-) : ServerEntity(controller, id, Entity::TYPE_WALL, entity_name, position,
+  uint32_t prototype_id
+) : ServerEntity(controller, id, Entity::TYPE_WALL, prototype_id, position,
                  Entity::FILTER_WALL, Entity::FILTER_ALL) {
-  auto config = Config::GetInstance()->GetWallsConfig();
-  CHECK(config.count(entity_name) == 1);
-  Config::WallConfig::Type type = config.at(entity_name).type;
+  Config::WallConfig::Type type = prototype_->wall_type;
   if (type == Config::WallConfig::TYPE_ORDINARY) {
     _type = TYPE_ORDINARY;
   } else if (type == Config::WallConfig::TYPE_UNBREAKABLE) {
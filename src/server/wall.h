@@ -31,7 +31,7 @@ class Wall : public ServerEntity {
     Controller* controller,
     uint32_t id,
     const b2Vec2& position,
-    const std::string& entity_name);
+    uint32_t prototype_id);
   virtual ~Wall();
 
   virtual void GetSnapshot(int64_t time, EntitySnapshot* output);
@@ -13,13 +13,16 @@
 
 #include "base/error.h"
 #include "base/id_manager.h"
+#include "base/object_pool.h"
 #include "base/pstdint.h"
 
+#include "engine/config.h"
 #include "engine/map.h"
 #include "engine/world.h"
 
 #include "server/entity.h"
 #include "server/controller.h"
+#include "server/spatial_query.h"
 
 #include "server/activator.h"
 #include "server/critter.h"
@@ -31,7 +34,10 @@
 
 namespace bm {
 
-ServerWorld::ServerWorld(Controller* controller) : controller_(controller) { }
+ServerWorld::ServerWorld(Controller* controller)
+    : id_epoch_(0), critter_pool_(MAX_FREE_ENTITIES),
+      projectile_pool_(MAX_FREE_ENTITIES), wall_pool_(MAX_FREE_ENTITIES),
+      controller_(controller) { }
 ServerWorld::~ServerWorld() { }
 
 float ServerWorld::GetBound() const {
@@ -42,12 +48,48 @@ float ServerWorld::GetBlockSize() const {
   return block_size_;
 }
 
+void ServerWorld::AddEntity(uint32_t id, Entity* entity) {
+  World::AddEntity(id, entity);
+  interest_grid_.Update(id, entity->GetPosition());
+}
+
+void ServerWorld::RemoveEntity(uint32_t id) {
+  World::RemoveEntity(id);
+  interest_grid_.Remove(id);
+  id_manager_.FreeId(id, id_epoch_);
+}
+
+void ServerWorld::SetIdEpoch(uint32_t epoch) {
+  id_epoch_ = epoch;
+}
+
+void ServerWorld::ReleaseIds(uint32_t epoch) {
+  id_manager_.ReleaseIds(epoch);
+}
+
+void ServerWorld::UpdateInterestGrid() {
+  EntityMap::iterator itr, end;
+  end = GetDynamicEntities()->end();
+  for (itr = GetDynamicEntities()->begin(); itr != end; ++itr) {
+    interest_grid_.Update(itr->first, itr->second->GetPosition());
+  }
+}
+
+const InterestGrid* ServerWorld::GetInterestGrid() const {
+  return &interest_grid_;
+}
+
+SpatialQuery* ServerWorld::GetSpatialQuery() {
+  return &spatial_query_;
+}
+
 Activator* ServerWorld::CreateActivator(
   const b2Vec2& position,
-  const std::string& entity_name
+  uint32_t prototype_id
 ) {
   uint32_t id = id_manager_.NewId();
-  Activator* activator = new Activator(controller_, id, position, entity_name);
+  Activator* activator =
+      new Activator(controller_, id, position, prototype_id);
   CHECK(activator != NULL);
   AddEntity(id, activator);
   return activator;
@@ -55,10 +97,11 @@ Activator* ServerWorld::CreateActivator(
 
 Critter* ServerWorld::CreateCritter(
   const b2Vec2& position,
-  const std::string& entity_name
+  uint32_t prototype_id
 ) {
   uint32_t id = id_manager_.NewId();
-  Critter* critter = new Critter(controller_, id, position, entity_name);
+  Critter* critter = new(critter_pool_.Allocate())
+      Critter(controller_, id, position, prototype_id);
   CHECK(critter != NULL);
   AddEntity(id, critter);
   return critter;
@@ -66,10 +109,10 @@ Critter* ServerWorld::CreateCritter(
 
 Door* ServerWorld::CreateDoor(
   const b2Vec2& position,
-  const std::string& entity_name
+  uint32_t prototype_id
 ) {
   uint32_t id = id_manager_.NewId();
-  Door* door = new Door(controller_, id, position, entity_name);
+  Door* door = new Door(controller_, id, position, prototype_id);
   CHECK(door != NULL);
   AddEntity(id, door);
   return door;
@@ -77,10 +120,10 @@ Door* ServerWorld::CreateDoor(
 
 Kit* ServerWorld::CreateKit(
   const b2Vec2& position,
-  const std::string& entity_name
+  uint32_t prototype_id
 ) {
   uint32_t id = id_manager_.NewId();
-  Kit* kit = new Kit(controller_, id, position, entity_name);
+  Kit* kit = new Kit(controller_, id, position, prototype_id);
   CHECK(kit != NULL);
   AddEntity(id, kit);
   return kit;
@@ -88,10 +131,10 @@ Kit* ServerWorld::CreateKit(
 
 Player* ServerWorld::CreatePlayer(
     const b2Vec2& position,
-    const std::string& entity_name
+    uint32_t prototype_id
 ) {
   uint32_t id = id_manager_.NewId();
-  Player* player = new Player(controller_, entity_name, id, position);
+  Player* player = new Player(controller_, prototype_id, id, position);
   CHECK(player != NULL);
   AddEntity(id, player);
   return player;
@@ -101,12 +144,12 @@ Projectile* ServerWorld::CreateProjectile(
   uint32_t owner_id,
   const b2Vec2& start,
   const b2Vec2& end,
-  const std::string& entity_name
+  uint32_t prototype_id
 ) {
   CHECK(GetEntity(owner_id) != NULL);
   uint32_t id = id_manager_.NewId();
-  Projectile* projectile = new Projectile(controller_,
-    id, owner_id, start, end, entity_name);
+  Projectile* projectile = new(projectile_pool_.Allocate())
+      Projectile(controller_, id, owner_id, start, end, prototype_id);
   CHECK(projectile != NULL);
   AddEntity(id, projectile);
   return projectile;
@@ -114,19 +157,61 @@ Projectile* ServerWorld::CreateProjectile(
 
 Wall* ServerWorld::CreateWall(
   const b2Vec2& position,
-  const std::string& entity_name
+  uint32_t prototype_id
 ) {
   uint32_t id = id_manager_.NewId();
-  Wall* wall = new Wall(controller_, id, position, entity_name);
+  Wall* wall = new(wall_pool_.Allocate())
+      Wall(controller_, id, position, prototype_id);
   CHECK(wall != NULL);
   AddEntity(id, wall);
   return wall;
 }
 
+void ServerWorld::DeleteEntity(Entity* entity) {
+  CHECK(entity != NULL);
+  switch (entity->GetType()) {
+    case Entity::TYPE_CRITTER:
+      critter_pool_.Delete(static_cast<Critter*>(entity));
+      break;
+    case Entity::TYPE_PROJECTILE:
+      projectile_pool_.Delete(static_cast<Projectile*>(entity));
+      break;
+    case Entity::TYPE_WALL:
+      wall_pool_.Delete(static_cast<Wall*>(entity));
+      break;
+    default:
+      delete entity;
+  }
+}
+
+const ObjectPool<Critter>& ServerWorld::GetCritterPool() const {
+  return critter_pool_;
+}
+
+const ObjectPool<Projectile>& ServerWorld::GetProjectilePool() const {
+  return projectile_pool_;
+}
+
+const ObjectPool<Wall>& ServerWorld::GetWallPool() const {
+  return wall_pool_;
+}
+
 std::vector<b2Vec2>* ServerWorld::GetSpawnPositions() {
   return &spawn_positions_;
 }
 
+// Reports an error if there is no prototype of 'kind' named 'name'.
+static bool FindPrototypeId(Config::Prototype::Kind kind,
+    const std::string& name, const std::string& map_file, uint32_t* id) {
+  *id = Config::GetInstance()->FindPrototypeId(kind, name);
+  if (*id == Config::BAD_PROTOTYPE_ID) {
+    REPORT_ERROR("Entity '%s' of map '%s' not found.",
+        name.c_str(), map_file.c_str());
+    return false;
+  }
+  return true;
+}
+
 bool ServerWorld::LoadMap(const std::string& file) {
   Map map;
   if (!map.Load(file)) {
@@ -136,6 +221,13 @@ bool ServerWorld::LoadMap(const std::string& file) {
 
   block_size_ = map.GetBlockSize();
   bound_ = (std::max(map.GetWidth(), map.GetHeight()) + 1) * block_size_;
+  // Cells of half the interest radius keep a query of a client's
+  // surroundings to a few dozen cells.
+  const Config::ServerConfig& config =
+    Config::GetInstance()->GetServerConfig();
+  interest_grid_.Initialize(bound_,
+      std::max(block_size_, config.interest_radius / 2));
+  spatial_query_.Initialize(GetBox2DWorld(), bound_);
 
   for (auto spawn : map.GetSpawns()) {
     float x = spawn.x * block_size_;
@@ -146,21 +238,36 @@ bool ServerWorld::LoadMap(const std::string& file) {
   for (auto kit : map.GetKits()) {
     float x = kit.x * block_size_;
     float y = kit.y * block_size_;
-    Kit* entity = CreateKit(b2Vec2(x, y), kit.entity_name);
+    uint32_t prototype_id;
+    if (!FindPrototypeId(Config::Prototype::KIND_KIT, kit.entity_name, file,
+        &prototype_id)) {
+      return false;
+    }
+    Kit* entity = CreateKit(b2Vec2(x, y), prototype_id);
     entity->SetRotation(static_cast<float>(M_PI) * kit.rotation / 180);
   }
 
   for (auto door : map.GetDoors()) {
     float x = door.x * block_size_;
     float y = door.y * block_size_;
-    Door* entity = CreateDoor(b2Vec2(x, y), door.entity_name);
+    uint32_t prototype_id;
+    if (!FindPrototypeId(Config::Prototype::KIND_DOOR, door.entity_name, file,
+        &prototype_id)) {
+      return false;
+    }
+    Door* entity = CreateDoor(b2Vec2(x, y), prototype_id);
 	entity->SetRotation(static_cast<float>(M_PI) * door.rotation / 180);
   }
 
   for (auto wall : map.GetWalls()) {
     float x = wall.x * block_size_;
     float y = wall.y * block_size_;
-    Wall* entity = CreateWall(b2Vec2(x, y), wall.entity_name);
+    uint32_t prototype_id;
+    if (!FindPrototypeId(Config::Prototype::KIND_WALL, wall.entity_name, file,
+        &prototype_id)) {
+      return false;
+    }
+    Wall* entity = CreateWall(b2Vec2(x, y), prototype_id);
 	entity->SetRotation(static_cast<float>(M_PI) * wall.rotation / 180);
   }
 
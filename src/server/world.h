@@ -10,11 +10,14 @@
 #include <Box2D/Box2D.h>
 
 #include "base/id_manager.h"
+#include "base/object_pool.h"
 #include "base/pstdint.h"
 
 #include "engine/world.h"
 
 #include "server/entity.h"
+#include "server/interest_grid.h"
+#include "server/spatial_query.h"
 
 class Activator;
 class Critter;
@@ -40,45 +43,87 @@ class ServerWorld : public World {
 
   bool LoadMap(const std::string& file);
 
+  // Keep the interest grid in sync with the 'World' entities. The ids
+  // of the removed entities are freed at the current id epoch.
+  virtual void AddEntity(uint32_t id, Entity* entity);
+  virtual void RemoveEntity(uint32_t id);
+
+  // The ids freed at an epoch are reused after 'ReleaseIds()' is called
+  // with it or a later one.
+  void SetIdEpoch(uint32_t epoch);
+  void ReleaseIds(uint32_t epoch);
+
+  // Moves the dynamic entities to the grid cells of their current positions.
+  // Static entities never change their positions.
+  void UpdateInterestGrid();
+  const InterestGrid* GetInterestGrid() const;
+
+  // Finds the entities around a point, valid after 'LoadMap()'.
+  SpatialQuery* GetSpatialQuery();
+
+  // The entities are made from the prototypes with 'prototype_id', see
+  // 'Config::GetPrototype()'.
+
   Activator* CreateActivator(
     const b2Vec2& position,
-    const std::string& entity_name);
+    uint32_t prototype_id);
 
   Critter* CreateCritter(
     const b2Vec2& position,
-    const std::string& entity_name);
+    uint32_t prototype_id);
 
   Door* CreateDoor(
     const b2Vec2& position,
-    const std::string& entity_name);
+    uint32_t prototype_id);
 
   Kit* CreateKit(
     const b2Vec2& position,
-    const std::string& entity_name);
+    uint32_t prototype_id);
 
   Player* CreatePlayer(
     const b2Vec2& position,
-    const std::string& entity_name);
+    uint32_t prototype_id);
 
   Projectile* CreateProjectile(
     uint32_t owner_id,
     const b2Vec2& start,
     const b2Vec2& end,
-    const std::string& entity_name);
+    uint32_t prototype_id);
 
   Wall* CreateWall(
     const b2Vec2& position,
-    const std::string& entity_name);
+    uint32_t prototype_id);
+
+  // Deletes 'entity' after it's removed. Critters, projectiles and walls
+  // come and go all the time, so their memory is kept in pools for the
+  // next ones.
+  void DeleteEntity(Entity* entity);
+
+  const ObjectPool<Critter>& GetCritterPool() const;
+  const ObjectPool<Projectile>& GetProjectilePool() const;
+  const ObjectPool<Wall>& GetWallPool() const;
 
   std::vector<b2Vec2>* GetSpawnPositions();
 
  private:
+  // Memory kept for every pooled entity type after a burst, e.g. of the
+  // walls of slime explosions.
+  static const size_t MAX_FREE_ENTITIES = 256;
+
   float block_size_;
   float bound_;
 
   std::vector<b2Vec2> spawn_positions_;
 
+  InterestGrid interest_grid_;
+  SpatialQuery spatial_query_;
+
   IdManager id_manager_;
+  uint32_t id_epoch_;
+
+  ObjectPool<Critter> critter_pool_;
+  ObjectPool<Projectile> projectile_pool_;
+  ObjectPool<Wall> wall_pool_;
   Controller* controller_;  // !refactor
 };
 